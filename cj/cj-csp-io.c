@@ -1,3 +1,5 @@
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,6 +8,7 @@
 #define JSMN_PARENT_LINKS
 #include "jsmn.h"
 #include "cj-csp-io.h"
+#include "cj-csp-probe.h"
 
 //#define CJ_DEBUG
 
@@ -13,17 +16,31 @@
 // json helpers
 //
 
+#ifdef CJ_STATS
+/** fprintf() counting the bytes written in the thread stats. */
+static int cjFprintf(FILE* f, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  const int written = vfprintf(f, format, args);
+  va_end(args);
+  if (written > 0) { CJ_STATS_ADD(bytesWritten, written); }
+  return written;
+}
+#else
+#define cjFprintf fprintf
+#endif
+
 /**
  * Copy a JSON field into a new allocated string.
  * Return CJ_ERROR_OK on success.
- * Free the output string with free().
+ * Free the output string with cjFree().
  *
  * JSON strings will not have enclosing quotes. Braces are included.
  */
 static int jsonStrCpy(int includeQuotes, const char* json, jsmntok_t* t, char** out) {
   if (!json || !t || !out) { return CJ_ERROR_ARG; }
   const int offset = includeQuotes && t->type == JSMN_STRING ? 1 : 0;
-  *out = malloc(t->end - t->start + 1 + 2*offset);
+  *out = cjMalloc(t->end - t->start + 1 + 2*offset);
   if (!(*out)) { return CJ_ERROR_NOMEM; }
   strncpy(*out, json + t->start - offset, t->end - t->start + 2*offset);
   (*out)[t->end - t->start + 2*offset] = '\0';
@@ -185,6 +202,7 @@ static int cjIntTuplesParseTok(
     return CJ_ERROR_INTTUPLES_ITEM_TYPE;
   }
 
+  CJ_STATS_ADD(integers, (uint64_t) ts->size * abs(ts->arity));
   return consumed;
 }
 
@@ -231,6 +249,17 @@ static int cjCspJsonParseDomain(const char* json, jsmntok_t* t, CjDomain* domain
   logTok("values:", json, t);
   if (!json || !t || !domain) { return CJ_ERROR_ARG; }
   if (t->type != JSMN_OBJECT || t->size != 1) { return CJ_ERROR_DOMAIN_IS_NOT_OBJECT; }
+  if (jsonEq(json, t + 1, "range")) {
+    if (t[2].type != JSMN_ARRAY || t[2].size != 2
+        || !jsonIsInt(json, &t[3]) || !jsonIsInt(json, &t[4]))
+    {
+      return CJ_ERROR_DOMAIN_RANGE_IS_NOT_PAIR;
+    }
+    const int lo = strtol(json + t[3].start, NULL, 10);
+    const int hi = strtol(json + t[4].start, NULL, 10);
+    if (cjDomainRangeInit(lo, hi, domain) != CJ_ERROR_OK) { return CJ_ERROR_DOMAIN_RANGE_IS_NOT_PAIR; }
+    return 5;
+  }
   if (! jsonEq(json, t + 1, "values")) { return CJ_ERROR_DOMAIN_UNKNOWN_TYPE; }
   if (t[2].type != JSMN_ARRAY) { return CJ_ERROR_DOMAIN_VALUES_IS_NOT_ARRAY; }
 
@@ -269,39 +298,164 @@ static int cjCspJsonParseDomains(const char* json, jsmntok_t* t, CjCsp* csp) {
   return consumed;
 }
 
+/** Parse {"runs": [[domain, count], ...]} into csp->varRuns. */
+static int cjCspJsonParseVarRuns(const char* json, jsmntok_t* t, CjCsp* csp) {
+  logTok("vars-runs:", json, t);
+  if (t->size != 1 || !jsonEq(json, t + 1, "runs")) { return CJ_ERROR_VARS_IS_NOT_ARRAY; }
+  if (t[2].type != JSMN_ARRAY) { return CJ_ERROR_VARS_RUNS_IS_NOT_PAIRS; }
+
+  const int defaultArity = 2;
+  int stat = cjIntTuplesParseTok(defaultArity, json, &t[2], &csp->varRuns);
+  if (stat < 0) { return stat; }
+  if (csp->varRuns.arity != 2) {
+    cjIntTuplesFree(&csp->varRuns);
+    return CJ_ERROR_VARS_RUNS_IS_NOT_PAIRS;
+  }
+
+  // Turn counts into cumulative ends.
+  long end = 0;
+  for (int iRun = 0; iRun < csp->varRuns.size; ++iRun) {
+    const int count = csp->varRuns.data[2*iRun + 1];
+    end += count;
+    if (count <= 0 || end > INT_MAX) {
+      cjIntTuplesFree(&csp->varRuns);
+      return CJ_ERROR_VARS_RUNS_IS_NOT_PAIRS;
+    }
+    csp->varRuns.data[2*iRun + 1] = (int) end;
+  }
+  csp->vars.arity = -1;
+  return 2 + stat;
+}
+
 static int cjCspJsonParseVars(const char* json, jsmntok_t* t, CjCsp* csp) {
   logTok("vars:", json, t);
   if (!json || !t || !csp) { return CJ_ERROR_ARG; }
+  if (t->type == JSMN_OBJECT) { return cjCspJsonParseVarRuns(json, t, csp); }
   if (t->type != JSMN_ARRAY) { return CJ_ERROR_VARS_IS_NOT_ARRAY; }
 
   const int defaultArity = -1;
   return cjIntTuplesParseTok(defaultArity, json, t, &csp->vars);
 }
 
-static int cjCspJsonParseNoGoods(const char* json, jsmntok_t* t, CjConstraintDef* constraintDef) {
-  logTok("noGoods:", json, t);
+/**
+ * Parse a table of tuples into constraintDef as a def of the given type:
+ * CJ_CONSTRAINT_DEF_NO_GOODS or CJ_CONSTRAINT_DEF_GOODS.
+ */
+static int cjCspJsonParseTable(int type, const char* json, jsmntok_t* t, CjConstraintDef* constraintDef) {
+  logTok(type == CJ_CONSTRAINT_DEF_GOODS ? "goods:" : "noGoods:", json, t);
   if (!json || !t || !constraintDef) { return CJ_ERROR_ARG; }
   if (t->type != JSMN_ARRAY) { return CJ_ERROR_NOGOODS_IS_NOT_ARRAY; }
 
   const int defaultArity = 0;
-  int stat = cjIntTuplesParseTok(defaultArity, json, t, &constraintDef->noGoods);
+  CjIntTuples* table = type == CJ_CONSTRAINT_DEF_GOODS ? &constraintDef->goods : &constraintDef->noGoods;
+  int stat = cjIntTuplesParseTok(defaultArity, json, t, table);
   if (stat < 0) {
     return stat;
   }
-  constraintDef->type = CJ_CONSTRAINT_DEF_NO_GOODS;
+  constraintDef->type = type;
   return stat;
 }
 
+/** Parse {"arity": INT, "nodes": [INT...], "edges": [[INT, INT]...]} into constraintDef. */
+static int cjCspJsonParseNoGoodsMdd(const char* json, jsmntok_t* t, CjConstraintDef* constraintDef) {
+  logTok("noGoodsMdd:", json, t);
+  if (t->type != JSMN_OBJECT || t->size != 3) { return CJ_ERROR_MDD_INVALID; }
+
+  CjMdd mdd = cjMddInit();
+  int hasArity = 0;
+  int consumed = 1;
+  for (int iChild = 0; iChild < t->size; ++iChild) {
+    int stat = CJ_ERROR_MDD_INVALID;
+    if (jsonEq(json, t + consumed, "arity") && jsonIsInt(json, t + consumed + 1)) {
+      mdd.arity = strtol(json + t[consumed + 1].start, NULL, 10);
+      hasArity = 1;
+      stat = 1;
+    }
+    else if (jsonEq(json, t + consumed, "nodes") && mdd.nodes.size == 0) {
+      stat = cjIntTuplesParseTok(-1, json, t + consumed + 1, &mdd.nodes);
+      if (stat >= 0 && mdd.nodes.arity != -1) { stat = CJ_ERROR_MDD_INVALID; }
+    }
+    else if (jsonEq(json, t + consumed, "edges") && mdd.edges.size == 0) {
+      stat = cjIntTuplesParseTok(2, json, t + consumed + 1, &mdd.edges);
+      if (stat >= 0 && mdd.edges.arity != 2) { stat = CJ_ERROR_MDD_INVALID; }
+    }
+    if (stat < 0) {
+      cjMddFree(&mdd);
+      return stat == CJ_ERROR_NOMEM ? stat : CJ_ERROR_MDD_INVALID;
+    }
+    consumed += 1 + stat;
+  }
+  if (!hasArity || mdd.nodes.size == 0) {
+    cjMddFree(&mdd);
+    return CJ_ERROR_MDD_INVALID;
+  }
+  constraintDef->type = CJ_CONSTRAINT_DEF_NO_GOODS_MDD;
+  constraintDef->noGoodsMdd = mdd;
+  return consumed;
+}
+
+/** The JSON names of CjPredicateOp values. */
+static const char* cjPredicateOpNames[CJ_PREDICATE_SIZE] = {
+  "eq", "neq", "lt", "le", "gt", "ge", "absDiffEq", "absDiffNeq"
+};
+
+/** Parse {"op": NAME} or {"op": NAME, "k": INT} into constraintDef. */
+static int cjCspJsonParsePredicate(const char* json, jsmntok_t* t, CjConstraintDef* constraintDef) {
+  logTok("predicate:", json, t);
+  if (t->type != JSMN_OBJECT || t->size < 1 || t->size > 2) { return CJ_ERROR_PREDICATE_INVALID; }
+
+  int op = -1;
+  int k = 0;
+  int consumed = 1;
+  for (int iChild = 0; iChild < t->size; ++iChild, consumed += 2) {
+    if (jsonEq(json, t + consumed, "op")) {
+      for (int iOp = 0; iOp < CJ_PREDICATE_SIZE; ++iOp) {
+        if (jsonEq(json, t + consumed + 1, cjPredicateOpNames[iOp])) { op = iOp; }
+      }
+    }
+    else if (jsonEq(json, t + consumed, "k") && jsonIsInt(json, t + consumed + 1)) {
+      k = strtol(json + t[consumed + 1].start, NULL, 10);
+    }
+    else {
+      return CJ_ERROR_PREDICATE_INVALID;
+    }
+  }
+  if (op < 0 || cjConstraintDefPredicateInit((CjPredicateOp) op, k, constraintDef) != CJ_ERROR_OK) {
+    return CJ_ERROR_PREDICATE_INVALID;
+  }
+  return consumed;
+}
+
 static int cjCspJsonParseConstraintsDef(const char* json, jsmntok_t* t, CjConstraintDef* constraintDef) {
   logTok("noGoods:", json, t);
   if (!json || !t || !constraintDef) { return CJ_ERROR_ARG; }
   if (t->type != JSMN_OBJECT) { return CJ_ERROR_CONSTRAINTDEF_IS_NOT_OBJECT; }
 
   if (jsonEq(json, t + 1, "noGoods")) {
-    int stat = cjCspJsonParseNoGoods(json, t + 2, constraintDef);
+    int stat = cjCspJsonParseTable(CJ_CONSTRAINT_DEF_NO_GOODS, json, t + 2, constraintDef);
     if (stat < 0) { return stat; }
     return 2 + stat;
   }
+  else if (jsonEq(json, t + 1, "goods")) {
+    int stat = cjCspJsonParseTable(CJ_CONSTRAINT_DEF_GOODS, json, t + 2, constraintDef);
+    if (stat < 0) { return stat; }
+    return 2 + stat;
+  }
+  else if (jsonEq(json, t + 1, "noGoodsMdd")) {
+    int stat = cjCspJsonParseNoGoodsMdd(json, t + 2, constraintDef);
+    if (stat < 0) { return stat; }
+    return 2 + stat;
+  }
+  else if (jsonEq(json, t + 1, "predicate")) {
+    int stat = cjCspJsonParsePredicate(json, t + 2, constraintDef);
+    if (stat < 0) { return stat; }
+    return 2 + stat;
+  }
+  else if (jsonEq(json, t + 1, "allDifferent")) {
+    if (t[2].type != JSMN_OBJECT || t[2].size != 0) { return CJ_ERROR_ALLDIFFERENT_IS_NOT_EMPTY_OBJECT; }
+    cjConstraintDefAllDifferentInit(constraintDef);
+    return 3;
+  }
   else {
     return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
   }
@@ -366,7 +520,11 @@ static int cjCspJsonParseConstraint(const char* json, jsmntok_t* t, CjConstraint
   return consumed;
 }
 
-static int cjCspJsonParseConstraints(const char* json, jsmntok_t* t, CjCsp* csp) {
+/**
+ * validate non-zero: cjCspValidateConstraint() each constraint right after
+ * parsing it, vars and constraintDefs need to be parsed and validated.
+ */
+static int cjCspJsonParseConstraints(const char* json, jsmntok_t* t, int validate, CjCsp* csp) {
   logTok("constraints:", json, t);
   if (!json || !t || !csp) { return CJ_ERROR_ARG; }
   if (t->type != JSMN_ARRAY) { return CJ_ERROR_CONSTRAINTS_IS_NOT_ARRAY; }
@@ -381,6 +539,12 @@ static int cjCspJsonParseConstraints(const char* json, jsmntok_t* t, CjCsp* csp)
   int consumed = 1;
   for (int iChild = 0; iChild < t->size; ++iChild) {
     int stat = cjCspJsonParseConstraint(json, t + consumed, &csp->constraints[iChild]);
+    if (stat >= 0 && validate) {
+      CJ_STATS_BEGIN(start);
+      CjError err = cjCspValidateConstraint(csp, &csp->constraints[iChild]);
+      CJ_STATS_END(start, CJ_PHASE_VALIDATE);
+      if (err != CJ_ERROR_OK) { stat = err; }
+    }
     if (stat < 0) {
       cjConstraintArrayFree(&csp->constraints, csp->constraintsSize);
       csp->constraintsSize = 0;
@@ -392,13 +556,59 @@ static int cjCspJsonParseConstraints(const char* json, jsmntok_t* t, CjCsp* csp)
   return consumed;
 }
 
-/** Return negative on error, otherwise number of tokens consumed. */
-static int cjCspJsonParseTop(const char* json, jsmntok_t* t, CjCsp* csp) {
+/** Sections of the csp-json top object, for validating while parsing. */
+enum {
+  CJ_SECTION_DOMAINS = 1,
+  CJ_SECTION_VARS = 2,
+  CJ_SECTION_CONSTRAINT_DEFS = 4,
+  CJ_SECTION_CONSTRAINTS = 8,
+};
+
+/**
+ * Validate each section of parsed which is not in (*checked) yet and whose
+ * dependencies are checked, and add it to (*checked).
+ */
+static CjError cjCspJsonValidateSections(const CjCsp* csp, int parsed, int* checked) {
+  CjError err = CJ_ERROR_OK;
+  if ((parsed & ~*checked) & CJ_SECTION_DOMAINS) {
+    err = cjCspValidateDomains(csp);
+    if (err != CJ_ERROR_OK) { return err; }
+    *checked |= CJ_SECTION_DOMAINS;
+  }
+  if ((parsed & ~*checked) & CJ_SECTION_VARS && *checked & CJ_SECTION_DOMAINS) {
+    err = cjCspValidateVars(csp);
+    if (err != CJ_ERROR_OK) { return err; }
+    *checked |= CJ_SECTION_VARS;
+  }
+  if ((parsed & ~*checked) & CJ_SECTION_CONSTRAINT_DEFS) {
+    err = cjCspValidateConstraintDefs(csp);
+    if (err != CJ_ERROR_OK) { return err; }
+    *checked |= CJ_SECTION_CONSTRAINT_DEFS;
+  }
+  const int constraintDeps = CJ_SECTION_VARS | CJ_SECTION_CONSTRAINT_DEFS;
+  if ((parsed & ~*checked) & CJ_SECTION_CONSTRAINTS && (*checked & constraintDeps) == constraintDeps) {
+    for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+      err = cjCspValidateConstraint(csp, &csp->constraints[iC]);
+      if (err != CJ_ERROR_OK) { return err; }
+    }
+    *checked |= CJ_SECTION_CONSTRAINTS;
+  }
+  return CJ_ERROR_OK;
+}
+
+/**
+ * validate non-zero: validate each section as soon as it and the sections it
+ * refers to are parsed, so the instance is checked in the same pass.
+ * Return negative on error, otherwise number of tokens consumed.
+ */
+static int cjCspJsonParseTop(const char* json, jsmntok_t* t, int validate, CjCsp* csp) {
   logTok("top:", json, t);
   if (!json || !t || !csp) { return CJ_ERROR_ARG; }
   if (t->type != JSMN_OBJECT) { return CJ_ERROR_CSPJSON_IS_NOT_OBJECT; }
   if (t->size != 5) { return CJ_ERROR_CSPJSON_BAD_FIELD_COUNT; }
 
+  int parsed = 0;
+  int checked = 0;
   int consumed = 1;
   for (int iChild = 0; iChild < t->size; ++iChild) {
     logTok("top-child:", json, &t[consumed]);
@@ -411,25 +621,48 @@ static int cjCspJsonParseTop(const char* json, jsmntok_t* t, CjCsp* csp) {
       int stat = cjCspJsonParseDomains(json, t + consumed + 1, csp);
       if (stat < 0) { return stat; }
       consumed += 1 + stat;
+      parsed |= CJ_SECTION_DOMAINS;
     }
     else if (jsonEq(json, t + consumed, "vars")) {
       int stat = cjCspJsonParseVars(json, t + consumed + 1, csp);
       if (stat < 0) { return stat; }
       consumed += 1 + stat;
+      parsed |= CJ_SECTION_VARS;
     }
     else if (jsonEq(json, t + consumed, "constraintDefs")) {
       int stat = cjCspJsonParseConstraintsDefs(json, t + consumed + 1, csp);
       if (stat < 0) { return stat; }
       consumed += 1 + stat;
+      parsed |= CJ_SECTION_CONSTRAINT_DEFS;
     }
     else if (jsonEq(json, t + consumed, "constraints")) {
-      int stat = cjCspJsonParseConstraints(json, t + consumed + 1, csp);
+      const int deps = CJ_SECTION_VARS | CJ_SECTION_CONSTRAINT_DEFS;
+      const int validateEach = validate && (checked & deps) == deps;
+      int stat = cjCspJsonParseConstraints(json, t + consumed + 1, validateEach, csp);
       if (stat < 0) { return stat; }
       consumed += 1 + stat;
+      parsed |= CJ_SECTION_CONSTRAINTS;
+      if (validateEach) { checked |= CJ_SECTION_CONSTRAINTS; }
     }
     else {
       return CJ_ERROR_CSPJSON_UNKNOWN_FIELD;
     }
+    if (validate) {
+      CJ_STATS_BEGIN(start);
+      CjError err = cjCspJsonValidateSections(csp, parsed, &checked);
+      CJ_STATS_END(start, CJ_PHASE_VALIDATE);
+      if (err != CJ_ERROR_OK) { return err; }
+    }
+  }
+
+  if (validate) {
+    const int all = CJ_SECTION_DOMAINS | CJ_SECTION_VARS | CJ_SECTION_CONSTRAINT_DEFS | CJ_SECTION_CONSTRAINTS;
+    if (checked != all) {
+      // A section is missing, leave the remaining checks to cjCspValidate().
+      CjError err = cjCspValidate(csp);
+      if (err != CJ_ERROR_OK) { return err; }
+    }
+    csp->validated = 1;
   }
 
   return consumed;
@@ -445,10 +678,8 @@ static CjError jsmnErrorToCjError(int jsmnErr) {
 }
 
 
-/** jsmn_parse() tokens into (*t). Call free(*t) after use. */
-static CjError jsmnTokenize(const char* json, const size_t jsonLen, jsmntok_t** t, int* numTokens) {
-  if (!json || !t || !numTokens) { return CJ_ERROR_ARG; }
-
+/** jsmnTokenize() of non-null args. */
+static CjError jsmnTokenizeAll(const char* json, const size_t jsonLen, jsmntok_t** t, int* numTokens) {
   jsmn_parser p;
   jsmn_init(&p);
 
@@ -460,7 +691,7 @@ static CjError jsmnTokenize(const char* json, const size_t jsonLen, jsmntok_t**
   if (*numTokens == 0) {
     return CJ_ERROR_OK;
   }
-  *t = malloc(sizeof(jsmntok_t) * (*numTokens));
+  *t = cjMalloc(sizeof(jsmntok_t) * (*numTokens));
   if (! (*t)) {
     return CJ_ERROR_NOMEM;
   }
@@ -469,13 +700,26 @@ static CjError jsmnTokenize(const char* json, const size_t jsonLen, jsmntok_t**
   jsmn_init(&p);
   *numTokens = jsmn_parse(&p, json, jsonLen, *t, *numTokens);
   if (*numTokens < 0) {
-    free(*t);
+    cjFree(*t);
     *t = NULL;
     return jsmnErrorToCjError(*numTokens);
   }
   return CJ_ERROR_OK;
 }
 
+/** jsmn_parse() tokens into (*t). Call cjFree(*t) after use. */
+static CjError jsmnTokenize(const char* json, const size_t jsonLen, jsmntok_t** t, int* numTokens) {
+  if (!json || !t || !numTokens) { return CJ_ERROR_ARG; }
+  CJ_STATS_BEGIN(start);
+  CjError err = jsmnTokenizeAll(json, jsonLen, t, numTokens);
+  CJ_STATS_END(start, CJ_PHASE_TOKENIZE);
+  if (err == CJ_ERROR_OK) {
+    CJ_STATS_ADD(tokens, *numTokens);
+    CJ_STATS_ADD(bytesRead, jsonLen);
+  }
+  return err;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // CjIntTuples IO
 //
@@ -492,10 +736,10 @@ CjError cjIntTuplesParse(
   int numTokens = 0;
   CjError stat = jsmnTokenize(json, jsonLen, &t, &numTokens);
   if (stat != CJ_ERROR_OK) { return stat; }
-  if (numTokens == 0) { free(t); return CJ_ERROR_ARG; }
+  if (numTokens == 0) { cjFree(t); return CJ_ERROR_ARG; }
 
   int consumedOrStat = cjIntTuplesParseTok(defaultArity, json, t, ts);
-  free(t);
+  cjFree(t);
   if (consumedOrStat < 0)       { return consumedOrStat; }
   else if (consumedOrStat == 0) { return CJ_ERROR_ARG; }
   else                          { return CJ_ERROR_OK; }
@@ -504,17 +748,17 @@ CjError cjIntTuplesParse(
 CjError cjIntTuplesJsonPrint(FILE* f, const CjIntTuples* ts) {
   if (!f || !ts) { return CJ_ERROR_ARG; }
   if (ts->size < 0 || ts->arity < -1) { return CJ_ERROR_ARG; }
-  fprintf(f, "[");
+  cjFprintf(f, "[");
   for (int s = 0; s < ts->size; ++s) {
-    if (s > 0) { fprintf(f, ", "); }
-    if (ts->arity >= 0) { fprintf(f, "["); }
+    if (s > 0) { cjFprintf(f, ", "); }
+    if (ts->arity >= 0) { cjFprintf(f, "["); }
     for (int a = 0; a < abs(ts->arity); ++a) {
-      if (a > 0) { fprintf(f, ", "); }
-      fprintf(f, "%d", ts->data[s*abs(ts->arity) + a]);
+      if (a > 0) { cjFprintf(f, ", "); }
+      cjFprintf(f, "%d", cjIntTuplesGet(ts, (size_t) s*abs(ts->arity) + a));
     }
-    if (ts->arity >= 0) { fprintf(f, "]"); }
+    if (ts->arity >= 0) { cjFprintf(f, "]"); }
   }
-  fprintf(f, "]");
+  cjFprintf(f, "]");
 
   return CJ_ERROR_OK;
 }
@@ -534,10 +778,10 @@ CjError cjConstraintDefParse(
   int numTokens = 0;
   CjError stat = jsmnTokenize(json, jsonLen, &t, &numTokens);
   if (stat != CJ_ERROR_OK) { return stat; }
-  if (numTokens == 0) { free(t); return CJ_ERROR_ARG; }
+  if (numTokens == 0) { cjFree(t); return CJ_ERROR_ARG; }
 
   int consumedOrStat = cjCspJsonParseConstraintsDef(json, t, cdef);
-  free(t);
+  cjFree(t);
   if (consumedOrStat < 0)       { return consumedOrStat; }
   else if (consumedOrStat == 0) { return CJ_ERROR_ARG; }
   else                          { return CJ_ERROR_OK; }
@@ -547,10 +791,40 @@ CjError cjConstraintDefJsonPrint(FILE* f, const CjConstraintDef* cdef) {
   if (!f || !cdef) { return CJ_ERROR_ARG; }
 
   if (cdef->type == CJ_CONSTRAINT_DEF_NO_GOODS) {
-    fprintf(f, "{\"noGoods\": ");
+    cjFprintf(f, "{\"noGoods\": ");
     CjError err = cjIntTuplesJsonPrint(f, &cdef->noGoods);
     if (err != CJ_ERROR_OK) { return err; }
-    fprintf(f, "}");
+    cjFprintf(f, "}");
+    return CJ_ERROR_OK;
+  }
+  else if (cdef->type == CJ_CONSTRAINT_DEF_GOODS) {
+    cjFprintf(f, "{\"goods\": ");
+    CjError err = cjIntTuplesJsonPrint(f, &cdef->goods);
+    if (err != CJ_ERROR_OK) { return err; }
+    cjFprintf(f, "}");
+    return CJ_ERROR_OK;
+  }
+  else if (cdef->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    cjFprintf(f, "{\"noGoodsMdd\": {\"arity\": %d, \"nodes\": ", cdef->noGoodsMdd.arity);
+    CjError err = cjIntTuplesJsonPrint(f, &cdef->noGoodsMdd.nodes);
+    if (err != CJ_ERROR_OK) { return err; }
+    cjFprintf(f, ", \"edges\": ");
+    err = cjIntTuplesJsonPrint(f, &cdef->noGoodsMdd.edges);
+    if (err != CJ_ERROR_OK) { return err; }
+    cjFprintf(f, "}}");
+    return CJ_ERROR_OK;
+  }
+  else if (cdef->type == CJ_CONSTRAINT_DEF_PREDICATE) {
+    if (cdef->predicate.op < 0 || cdef->predicate.op >= CJ_PREDICATE_SIZE) { return CJ_ERROR_PREDICATE_INVALID; }
+    cjFprintf(f, "{\"predicate\": {\"op\": \"%s\"", cjPredicateOpNames[cdef->predicate.op]);
+    if (cdef->predicate.op == CJ_PREDICATE_ABS_DIFF_EQ || cdef->predicate.op == CJ_PREDICATE_ABS_DIFF_NEQ) {
+      cjFprintf(f, ", \"k\": %d", cdef->predicate.k);
+    }
+    cjFprintf(f, "}}");
+    return CJ_ERROR_OK;
+  }
+  else if (cdef->type == CJ_CONSTRAINT_DEF_ALL_DIFFERENT) {
+    cjFprintf(f, "{\"allDifferent\": {}}");
     return CJ_ERROR_OK;
   }
   else {
@@ -559,95 +833,319 @@ CjError cjConstraintDefJsonPrint(FILE* f, const CjConstraintDef* cdef) {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// CjMdd IO
+//
+
+static const unsigned char cjMddMagic[4] = {'C', 'J', 'M', 'D'};
+
+/** Store value as a little-endian int32 at out[0..3]. */
+static void cjInt32ToLe(int value, unsigned char* out) {
+  const uint32_t v = (uint32_t) value;
+  out[0] = (unsigned char) v;
+  out[1] = (unsigned char) (v >> 8);
+  out[2] = (unsigned char) (v >> 16);
+  out[3] = (unsigned char) (v >> 24);
+}
+
+/** @return the little-endian int32 at in[0..3]. */
+static int cjInt32FromLe(const unsigned char* in) {
+  const uint32_t v = (uint32_t) in[0] | (uint32_t) in[1] << 8 | (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+  return (int) (int32_t) v;
+}
+
+/** Write the n values of ts as little-endian int32. @return 0 on success. */
+static int cjWriteInt32s(FILE* f, const CjIntTuples* ts, size_t n) {
+  unsigned char buf[4 * 256];
+  for (size_t i = 0; i < n; ) {
+    const size_t chunk = n - i < 256 ? n - i : 256;
+    for (size_t j = 0; j < chunk; ++j) { cjInt32ToLe(cjIntTuplesGet(ts, i + j), &buf[4*j]); }
+    if (fwrite(buf, 4, chunk, f) != chunk) { return -1; }
+    CJ_STATS_ADD(bytesWritten, 4 * chunk);
+    i += chunk;
+  }
+  return 0;
+}
+
+/**
+ * Read n little-endian int32 into (*out), cjMalloc()ed. The buffer grows as
+ * values are read, so a count larger than the file fails on the short read
+ * rather than on allocating the count up front.
+ */
+static CjError cjReadInt32s(FILE* f, size_t n, int** out) {
+  *out = NULL;
+  int* data = NULL;
+  size_t capacity = 0;
+  unsigned char buf[4 * 256];
+  for (size_t i = 0; i < n; ) {
+    const size_t chunk = n - i < 256 ? n - i : 256;
+    if (fread(buf, 4, chunk, f) != chunk) {
+      cjFree(data);
+      return CJ_ERROR_MDD_INVALID;
+    }
+    CJ_STATS_ADD(bytesRead, 4 * chunk);
+    if (i + chunk > capacity) {
+      capacity = 2 * capacity < i + chunk ? i + chunk : 2 * capacity;
+      if (capacity > n) { capacity = n; }
+      int* grown = (int*) cjRealloc(data, sizeof(int) * capacity);
+      if (!grown) {
+        cjFree(data);
+        return CJ_ERROR_NOMEM;
+      }
+      data = grown;
+    }
+    for (size_t j = 0; j < chunk; ++j) { data[i + j] = cjInt32FromLe(&buf[4*j]); }
+    i += chunk;
+  }
+  *out = data;
+  return CJ_ERROR_OK;
+}
+
+CjError cjMddBinaryWrite(FILE* f, const CjMdd* mdd) {
+  if (!f || !mdd) { return CJ_ERROR_ARG; }
+  if (mdd->nodes.arity != -1 || (mdd->edges.size > 0 && mdd->edges.arity != 2)) { return CJ_ERROR_ARG; }
+
+  unsigned char header[16];
+  memcpy(header, cjMddMagic, sizeof(cjMddMagic));
+  cjInt32ToLe(mdd->arity, &header[4]);
+  cjInt32ToLe(mdd->nodes.size, &header[8]);
+  cjInt32ToLe(mdd->edges.size, &header[12]);
+  if (fwrite(header, 1, sizeof(header), f) != sizeof(header)
+      || cjWriteInt32s(f, &mdd->nodes, mdd->nodes.size) != 0
+      || cjWriteInt32s(f, &mdd->edges, 2 * (size_t) mdd->edges.size) != 0)
+  {
+    return CJ_ERROR;
+  }
+  CJ_STATS_ADD(bytesWritten, sizeof(header));
+  return CJ_ERROR_OK;
+}
+
+CjError cjMddBinaryRead(FILE* f, CjMdd* out) {
+  if (!f || !out) { return CJ_ERROR_ARG; }
+  *out = cjMddInit();
+
+  unsigned char header[16];
+  if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, cjMddMagic, sizeof(cjMddMagic)) != 0) {
+    return CJ_ERROR_MDD_INVALID;
+  }
+  CJ_STATS_ADD(bytesRead, sizeof(header));
+  const int nodesSize = cjInt32FromLe(&header[8]);
+  const int edgesSize = cjInt32FromLe(&header[12]);
+  if (nodesSize < 0 || edgesSize < 0 || edgesSize > INT_MAX / 2) { return CJ_ERROR_MDD_INVALID; }
+
+  CjMdd mdd = cjMddInit();
+  mdd.arity = cjInt32FromLe(&header[4]);
+  CjError err = cjIntTuplesAlloc(0, -1, &mdd.nodes);
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc(0, 2, &mdd.edges); }
+  if (err == CJ_ERROR_OK) { err = cjReadInt32s(f, nodesSize, &mdd.nodes.data); }
+  if (err == CJ_ERROR_OK) { mdd.nodes.size = nodesSize; }
+  if (err == CJ_ERROR_OK) { err = cjReadInt32s(f, 2 * (size_t) edgesSize, &mdd.edges.data); }
+  if (err == CJ_ERROR_OK) { mdd.edges.size = edgesSize; }
+  if (err == CJ_ERROR_OK) { err = cjMddValidate(&mdd); }
+  if (err != CJ_ERROR_OK) {
+    cjMddFree(&mdd);
+    return err;
+  }
+  *out = mdd;
+  return CJ_ERROR_OK;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // CjCsp IO
 //
 
 CjError cjCspJsonParse(const char* json, const size_t jsonLen, CjCsp* csp) {
-  if (!json || !csp) { return CJ_ERROR_ARG; }
+  return cjCspJsonParseFlags(json, jsonLen, 0, csp);
+}
 
+/** cjCspJsonParseFlags() of non-null args. */
+static CjError cjCspJsonParseAll(const char* json, const size_t jsonLen, int flags, CjCsp* csp) {
   *csp = cjCspInit();
 
   jsmntok_t* t = NULL;
   int numTokens = 0;
   CjError stat = jsmnTokenize(json, jsonLen, &t, &numTokens);
   if (stat != CJ_ERROR_OK) { return stat; }
-  if (numTokens == 0) { free(t); return CJ_ERROR_ARG; }
+  if (numTokens == 0) { cjFree(t); return CJ_ERROR_ARG; }
 
-  int consumedOrStat = cjCspJsonParseTop(json, t, csp);
-  free(t);
+#ifdef CJ_STATS
+  CjStats* stats = cjThreadStats();
+  const uint64_t validateNs = stats ? stats->ns[CJ_PHASE_VALIDATE] : 0;
+#endif
+  CJ_STATS_BEGIN(start);
+  int consumedOrStat = cjCspJsonParseTop(json, t, flags & CJ_PARSE_VALIDATE, csp);
+  CJ_STATS_END(start, CJ_PHASE_PARSE);
+#ifdef CJ_STATS
+  // The checks of CJ_PARSE_VALIDATE are timed as validate, not parse.
+  if (stats && start) { stats->ns[CJ_PHASE_PARSE] -= stats->ns[CJ_PHASE_VALIDATE] - validateNs; }
+#endif
+  cjFree(t);
   if (consumedOrStat < 0)       { return consumedOrStat; }
   else if (consumedOrStat == 0) { return CJ_ERROR_ARG; }
-  else                          { return CJ_ERROR_OK; }
+
+  CjError err = CJ_ERROR_OK;
+  if (flags & CJ_PARSE_VARS_RUNS) { err = cjCspVarsCompress(csp); }
+  if (err == CJ_ERROR_OK && (flags & CJ_PARSE_NARROW)) { err = cjCspNarrow(csp); }
+  return err;
 }
 
-CjError cjCspJsonPrint(FILE* f, const CjCsp* csp) {
-  if (!f || !csp) { return CJ_ERROR_ARG; }
+CjError cjCspJsonParseFlags(const char* json, const size_t jsonLen, int flags, CjCsp* csp) {
+  if (!json || !csp) { return CJ_ERROR_ARG; }
+  *csp = cjCspInit();
+  CJ_PROBE(parse_entry, jsonLen, csp);
+  CjError err = cjCspJsonParseAll(json, jsonLen, flags, csp);
+  CJ_PROBE(parse_return, err, csp);
+  return err;
+}
+
+/** @return the index into the parent csp of item i of the view, i without a view. */
+static int cjViewParentIndex(const CjIntTuples* viewItems, int i) {
+  return viewItems ? viewItems->data[i] : i;
+}
+
+/**
+ * cjCspJsonPrint() of non-null args. With a non-null view print the view of
+ * csp, remapping its vars, domains and constraintDefs on the fly.
+ */
+static CjError cjCspJsonPrintAll(FILE* f, const CjCsp* csp, const CjCspView* view) {
   CjError err = CJ_ERROR_OK;
+  const int domainsSize = view ? view->domains.size : csp->domainsSize;
+  const int constraintDefsSize = view ? view->constraintDefs.size : csp->constraintDefsSize;
+  const int constraintsSize = view ? view->constraints.size : csp->constraintsSize;
 
-  fprintf(f, "{\n");
+  cjFprintf(f, "{\n");
 
-  fprintf(f, "  \"meta\": {\n");
-  fprintf(f, "    \"id\": \"%s\",\n", csp->meta.id);
-  fprintf(f, "    \"algo\": \"%s\",\n", csp->meta.algo);
-  fprintf(f, "    \"params\": %s\n", csp->meta.paramsJSON);
-  fprintf(f, "  },\n");
+  cjFprintf(f, "  \"meta\": {\n");
+  cjFprintf(f, "    \"id\": \"%s\",\n", csp->meta.id);
+  cjFprintf(f, "    \"algo\": \"%s\",\n", csp->meta.algo);
+  cjFprintf(f, "    \"params\": %s\n", csp->meta.paramsJSON);
+  cjFprintf(f, "  },\n");
 
-  if (csp->domainsSize == 0) {
-    fprintf(f, "  \"domains\": [],\n");
+  if (domainsSize == 0) {
+    cjFprintf(f, "  \"domains\": [],\n");
   } else {
-    fprintf(f, "  \"domains\": [\n");
-    for (int iDom = 0; iDom < csp->domainsSize; ++iDom) {
-      if (csp->domains[iDom].type == CJ_DOMAIN_VALUES) {
-        fprintf(f, "    {\"values\": ");
-        cjIntTuplesJsonPrint(f, &csp->domains[iDom].values);
-        fprintf(f, "}");
+    cjFprintf(f, "  \"domains\": [\n");
+    for (int iDom = 0; iDom < domainsSize; ++iDom) {
+      const CjDomain* domain = &csp->domains[cjViewParentIndex(view ? &view->domains : NULL, iDom)];
+      if (domain->type == CJ_DOMAIN_VALUES) {
+        cjFprintf(f, "    {\"values\": ");
+        cjIntTuplesJsonPrint(f, &domain->values);
+        cjFprintf(f, "}");
+      }
+      else if (domain->type == CJ_DOMAIN_RANGE) {
+        cjFprintf(f, "    {\"range\": [%d, %d]}", domain->range.lo, domain->range.hi);
       }
       else {
         return CJ_ERROR_DOMAIN_UNKNOWN_TYPE;
       }
-      if (iDom != csp->domainsSize - 1) { fprintf(f, ",\n"); }
-      else { fprintf(f, "\n");  }
+      if (iDom != domainsSize - 1) { cjFprintf(f, ",\n"); }
+      else { cjFprintf(f, "\n");  }
     }
-    fprintf(f, "  ],\n");
+    cjFprintf(f, "  ],\n");
   }
 
-  fprintf(f, "  \"vars\": ");
-  cjIntTuplesJsonPrint(f, &csp->vars);
-  fprintf(f, ",\n");
+  cjFprintf(f, "  \"vars\": ");
+  if (view) {
+    cjFprintf(f, "[");
+    for (int iVar = 0; iVar < view->vars.size; ++iVar) {
+      if (iVar > 0) { cjFprintf(f, ", "); }
+      cjFprintf(f, "%d", cjCspViewDomainOf(view, cjCspVarDomain(csp, view->vars.data[iVar])));
+    }
+    cjFprintf(f, "]");
+  }
+  else if (csp->varRuns.size > 0) {
+    cjFprintf(f, "{\"runs\": [");
+    int start = 0;
+    for (int iRun = 0; iRun < csp->varRuns.size; ++iRun) {
+      const int end = cjIntTuplesGet(&csp->varRuns, 2 * (size_t) iRun + 1);
+      if (iRun > 0) { cjFprintf(f, ", "); }
+      cjFprintf(f, "[%d, %d]", cjIntTuplesGet(&csp->varRuns, 2 * (size_t) iRun), end - start);
+      start = end;
+    }
+    cjFprintf(f, "]}");
+  }
+  else {
+    cjIntTuplesJsonPrint(f, &csp->vars);
+  }
+  cjFprintf(f, ",\n");
 
-  if (csp->constraintDefsSize == 0) {
-    fprintf(f, "  \"constraintDefs\": [],\n");
+  if (constraintDefsSize == 0) {
+    cjFprintf(f, "  \"constraintDefs\": [],\n");
   }
   else {
-    fprintf(f, "  \"constraintDefs\": [\n");
-    for (int iDef = 0; iDef < csp->constraintDefsSize; ++iDef) {
-      fprintf(f, "    ");
-      err = cjConstraintDefJsonPrint(f, &csp->constraintDefs[iDef]);
+    cjFprintf(f, "  \"constraintDefs\": [\n");
+    for (int iDef = 0; iDef < constraintDefsSize; ++iDef) {
+      cjFprintf(f, "    ");
+      err = cjConstraintDefJsonPrint(f, &csp->constraintDefs[cjViewParentIndex(view ? &view->constraintDefs : NULL, iDef)]);
       if (err != CJ_ERROR_OK) { return err; }
-      if (iDef != csp->constraintDefsSize - 1) { fprintf(f, ",\n"); }
-      else { fprintf(f, "\n");  }
+      if (iDef != constraintDefsSize - 1) { cjFprintf(f, ",\n"); }
+      else { cjFprintf(f, "\n");  }
     }
-    fprintf(f, "  ],\n");
+    cjFprintf(f, "  ],\n");
   }
 
-  if (csp->constraintsSize == 0) {
-    fprintf(f, "  \"constraints\": []\n");
+  if (constraintsSize == 0) {
+    cjFprintf(f, "  \"constraints\": []\n");
   }
   else {
-    fprintf(f, "  \"constraints\": [\n");
-    for (int i = 0; i < csp->constraintsSize; ++i) {
-      fprintf(f, "    {\"id\": %d, \"vars\": ", csp->constraints[i].id);
-      cjIntTuplesJsonPrint(f, &csp->constraints[i].vars);
-      fprintf(f, "}");
-      if (i != csp->constraintsSize - 1) { fprintf(f, ",\n"); }
-      else { fprintf(f, "\n");  }
+    cjFprintf(f, "  \"constraints\": [\n");
+    for (int i = 0; i < constraintsSize; ++i) {
+      const CjConstraint* c = &csp->constraints[cjViewParentIndex(view ? &view->constraints : NULL, i)];
+      if (view) {
+        cjFprintf(f, "    {\"id\": %d, \"vars\": [", cjCspViewConstraintDefOf(view, c->id));
+        for (int iVar = 0; iVar < c->vars.size; ++iVar) {
+          if (iVar > 0) { cjFprintf(f, ", "); }
+          cjFprintf(f, "%d", cjCspViewVarOf(view, cjIntTuplesGet(&c->vars, iVar)));
+        }
+        cjFprintf(f, "]}");
+      }
+      else {
+        cjFprintf(f, "    {\"id\": %d, \"vars\": ", c->id);
+        cjIntTuplesJsonPrint(f, &c->vars);
+        cjFprintf(f, "}");
+      }
+      if (i != constraintsSize - 1) { cjFprintf(f, ",\n"); }
+      else { cjFprintf(f, "\n");  }
     }
-    fprintf(f, "  ]\n");
+    cjFprintf(f, "  ]\n");
   }
 
-  fprintf(f, "}\n");
+  cjFprintf(f, "}\n");
 
   return CJ_ERROR_OK;
 }
 
+CjError cjCspJsonPrint(FILE* f, const CjCsp* csp) {
+  if (!f || !csp) { return CJ_ERROR_ARG; }
+  CJ_PROBE(print_entry, 0, csp);
+  CJ_STATS_BEGIN(start);
+  CjError err = cjCspJsonPrintAll(f, csp, NULL);
+  CJ_STATS_END(start, CJ_PHASE_PRINT);
+  CJ_PROBE(print_return, err, csp);
+  return err;
+}
+
+CjError cjCspViewJsonPrint(FILE* f, const CjCspView* view) {
+  if (!f || !view || !view->csp) { return CJ_ERROR_ARG; }
+  CJ_PROBE(print_entry, 0, view->csp);
+  CJ_STATS_BEGIN(start);
+  CjError err = cjCspJsonPrintAll(f, view->csp, view);
+  CJ_STATS_END(start, CJ_PHASE_PRINT);
+  CJ_PROBE(print_return, err, view->csp);
+  return err;
+}
+
+CjError cjStatsJsonPrint(FILE* f, const CjStats* stats) {
+  if (!f || !stats) { return CJ_ERROR_ARG; }
+  fprintf(f, "{\"enabled\": %s, \"ns\": {", cjStatsEnabled() ? "true" : "false");
+  for (int iPhase = 0; iPhase < CJ_PHASE_SIZE; ++iPhase) {
+    fprintf(f, "%s\"%s\": %llu", iPhase > 0 ? ", " : "", cjPhaseName((CjPhase) iPhase),
+      (unsigned long long) stats->ns[iPhase]);
+  }
+  fprintf(f, "}, \"tokens\": %llu, \"integers\": %llu, \"bytesRead\": %llu, \"bytesWritten\": %llu"
+    ", \"allocations\": %llu, \"frees\": %llu}\n",
+    (unsigned long long) stats->tokens, (unsigned long long) stats->integers,
+    (unsigned long long) stats->bytesRead, (unsigned long long) stats->bytesWritten,
+    (unsigned long long) stats->allocations, (unsigned long long) stats->frees);
+  return CJ_ERROR_OK;
+}
@@ -45,6 +45,26 @@ CjError cjConstraintDefParse(
 /** Print from cdef. @return CJ_ERROR_OK on success */
 CjError cjConstraintDefJsonPrint(FILE* f, const CjConstraintDef* cdef);
 
+////////////////////////////////////////////////////////////////////////////////
+// CjMdd Binary Reading and Writing
+//
+// The binary form of a CjMdd is the 4 bytes "CJMD", then arity, the number
+// of node offsets and the number of edges, then the node offsets and the
+// [value, child] edges: all little-endian int32. It holds the same arrays
+// as the "noGoodsMdd" JSON form without the cost of formatting them.
+//
+
+/** Write mdd in binary form. @return CJ_ERROR_OK on success, CJ_ERROR if a write fails. */
+CjError cjMddBinaryWrite(FILE* f, const CjMdd* mdd);
+
+/**
+ * Read a binary form written by cjMddBinaryWrite() into out, which needs to
+ * be freed prior to call. Free the created object with cjMddFree().
+ * @return CJ_ERROR_MDD_INVALID if f is not a complete binary form,
+ *         CJ_ERROR_VALIDATION_MDD if the MDD it holds is not well formed.
+ */
+CjError cjMddBinaryRead(FILE* f, CjMdd* out);
+
 ////////////////////////////////////////////////////////////////////////////////
 // cjCsp Parsing and Printing
 //
@@ -58,9 +78,35 @@ CjError cjConstraintDefJsonPrint(FILE* f, const CjConstraintDef* cdef);
  * */
 CjError cjCspJsonParse(const char* json, const size_t jsonLen, CjCsp* csp);
 
+/** Flags of cjCspJsonParseFlags(). */
+enum {
+  /** cjCspNarrow() the parsed csp: each table gets the narrowest width. */
+  CJ_PARSE_NARROW = 1,
+  /** cjCspVarsCompress() the parsed csp: vars are stored as runs. */
+  CJ_PARSE_VARS_RUNS = 2,
+  /**
+   * cjCspValidate() the csp while parsing it, each section as soon as the
+   * sections it refers to are parsed, and set csp->validated. Fails with the
+   * cjCspValidate() error of an invalid csp (see cjErrorIsValidation()).
+   */
+  CJ_PARSE_VALIDATE = 4,
+};
+
+/** cjCspJsonParse() with flags, a combination of CJ_PARSE_* values. */
+CjError cjCspJsonParseFlags(const char* json, const size_t jsonLen, int flags, CjCsp* csp);
+
 /** return CJ_ERROR_OK on success */
 CjError cjCspJsonPrint(FILE* f, const CjCsp* csp);
 
+/**
+ * Print view as the standalone csp cjCspViewMaterialize() would make, straight
+ * from the parent csp without copying it.
+ */
+CjError cjCspViewJsonPrint(FILE* f, const CjCspView* view);
+
+/** Print stats as a one line JSON object, with "ns" by phase name. */
+CjError cjStatsJsonPrint(FILE* f, const CjStats* stats);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
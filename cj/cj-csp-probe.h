@@ -0,0 +1,33 @@
+#ifndef __CJ_CSP_PROBE_H__
+#define __CJ_CSP_PROBE_H__
+
+// Internal to cj-csp.c and cj-csp-io.c, not part of the API.
+
+#ifdef CJ_USDT
+#include <sys/sdt.h>
+#endif
+
+#include "cj-csp.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Tracepoints
+//
+// Optional Linux USDT probes of provider "cj": with CJ_USDT defined at build
+// time (needs <sys/sdt.h> from systemtap-sdt-dev), the parse, validate,
+// normalize, is_solved and print calls fire NAME_entry and NAME_return probes,
+// eg. for bpftrace 'usdt:./cj-echo:cj:parse_return'. A probe is a nop until
+// a tracer attaches. Without CJ_USDT they compile to nothing.
+//
+// Every probe has 5 args: arg0 is the call's own argument on entry (json
+// length, normalize threads, solution size or 0) and the CjError on return,
+// then the domains, vars, constraintDefs and constraints sizes of the csp.
+//
+
+#ifdef CJ_USDT
+#define CJ_PROBE(name, arg, csp) DTRACE_PROBE5(cj, name, (int64_t) (arg), \
+  (csp)->domainsSize, cjCspVarsSize(csp), (csp)->constraintDefsSize, (csp)->constraintsSize)
+#else
+#define CJ_PROBE(name, arg, csp) do {} while (0)
+#endif
+
+#endif // __CJ_CSP_PROBE_H__
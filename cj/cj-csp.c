@@ -1,15 +1,675 @@
 #include <assert.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// With CJ_THREADS the library is thread aware: per thread allocators and
+// stats, and cjCspNormalizeParallel() on POSIX threads. Without it the core
+// needs neither, and everything runs on the calling thread.
+#ifdef CJ_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#define CJ_THREAD_LOCAL _Thread_local
+#else
+#define CJ_THREAD_LOCAL
+#endif
 
 #include "cj-csp.h"
+#include "cj-csp-probe.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Allocator
+//
+
+static void* cjDefaultAllocate(void* user, size_t size) {
+  (void) user;
+  return malloc(size);
+}
+
+static void* cjDefaultReallocate(void* user, void* ptr, size_t size) {
+  (void) user;
+  return realloc(ptr, size);
+}
+
+static void cjDefaultDeallocate(void* user, void* ptr) {
+  (void) user;
+  free(ptr);
+}
+
+static CjAllocator cjGlobalAllocator = {cjDefaultAllocate, cjDefaultReallocate, cjDefaultDeallocate, NULL};
+static CJ_THREAD_LOCAL CjAllocator cjThreadAllocator;
+static CJ_THREAD_LOCAL int cjThreadAllocatorSet = 0;
+
+void cjSetAllocator(const CjAllocator* allocator) {
+  if (allocator) {
+    cjGlobalAllocator = *allocator;
+  } else {
+    cjGlobalAllocator.allocate = cjDefaultAllocate;
+    cjGlobalAllocator.reallocate = cjDefaultReallocate;
+    cjGlobalAllocator.deallocate = cjDefaultDeallocate;
+    cjGlobalAllocator.user = NULL;
+  }
+}
+
+void cjSetThreadAllocator(const CjAllocator* allocator) {
+  cjThreadAllocatorSet = allocator != NULL;
+  if (allocator) { cjThreadAllocator = *allocator; }
+}
+
+/** The allocator of the calling thread, without copying it. */
+static const CjAllocator* cjAllocator() {
+  return cjThreadAllocatorSet ? &cjThreadAllocator : &cjGlobalAllocator;
+}
+
+CjAllocator cjGetAllocator() {
+  return *cjAllocator();
+}
+
+void* cjMalloc(size_t size) {
+  CJ_STATS_ADD(allocations, 1);
+  const CjAllocator* a = cjAllocator();
+  return a->allocate(a->user, size);
+}
+
+void* cjCalloc(size_t count, size_t size) {
+  if (size > 0 && count > SIZE_MAX / size) { return NULL; }
+  void* ptr = cjMalloc(count * size);
+  if (ptr) { memset(ptr, 0, count * size); }
+  return ptr;
+}
+
+void* cjRealloc(void* ptr, size_t size) {
+  CJ_STATS_ADD(allocations, 1);
+  const CjAllocator* a = cjAllocator();
+  return a->reallocate(a->user, ptr, size);
+}
+
+void cjFree(void* ptr) {
+  if (ptr) { CJ_STATS_ADD(frees, 1); }
+  const CjAllocator* a = cjAllocator();
+  a->deallocate(a->user, ptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Stats
+//
+
+static CJ_THREAD_LOCAL CjStats* cjThreadStatsPtr = NULL;
+
+CjStats cjStatsInit() {
+  CjStats x;
+  memset(&x, 0, sizeof(x));
+  return x;
+}
+
+int cjStatsEnabled() {
+#ifdef CJ_STATS
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void cjSetThreadStats(CjStats* stats) {
+  cjThreadStatsPtr = stats;
+}
+
+CjStats* cjThreadStats() {
+  return cjThreadStatsPtr;
+}
+
+uint64_t cjStatsNowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+const char* cjPhaseName(CjPhase phase) {
+  switch (phase) {
+    case CJ_PHASE_TOKENIZE:  return "tokenize";
+    case CJ_PHASE_PARSE:     return "parse";
+    case CJ_PHASE_VALIDATE:  return "validate";
+    case CJ_PHASE_NORMALIZE: return "normalize";
+    case CJ_PHASE_PRINT:     return "print";
+    default:                 return "unknown";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Tuple kernels
+//
+// Tables are flat arrays of tuples stored as int8_t, int16_t or int (see
+// CjIntTuples.width). CJ_DEFINE_TUPLE_KERNELS instantiates the kernels below
+// for one element type T, suffixed by the width in bits:
+//   cjTupleCopyN:           copy one tuple.
+//   cjTupleCompareN:        compare two tuples lexicographically.
+//   cjSortTuplesN:          sort a table (insertion sort when small, else LSD
+//                           radix sort). tmp must hold size*arity values.
+//   cjMergeTuplesN:         merge two sorted runs. out must hold size*arity values.
+//   cjTableFindN:           @return the index of an int tuple in a table or -1.
+//   cjRangeN:               min and max of n values.
+//
+
+/** Tables with fewer tuples than this are insertion sorted. */
+#define CJ_SORT_INSERTION_MAX 32
+
+#define CJ_DEFINE_TUPLE_KERNELS(N, T) \
+static inline void cjTupleCopy##N(T* dst, const T* src, int arity) { \
+  switch (arity) { \
+    case 1: dst[0] = src[0]; break; \
+    case 2: dst[0] = src[0]; dst[1] = src[1]; break; \
+    default: memcpy(dst, src, sizeof(T) * arity); break; \
+  } \
+} \
+\
+static inline int cjTupleCompare##N(const T* x, const T* y, int arity) { \
+  for (int i = 0; i < arity; ++i) { \
+    if (x[i] != y[i]) { return x[i] < y[i] ? -1 : 1; } \
+  } \
+  return 0; \
+} \
+\
+static void cjInsertionSortTuples##N(T* data, T* tmp, size_t size, int arity) { \
+  for (size_t i = 1; i < size; ++i) { \
+    if (cjTupleCompare##N(data + (i-1)*arity, data + i*arity, arity) <= 0) { continue; } \
+    cjTupleCopy##N(tmp, data + i*arity, arity); \
+    size_t j = i; \
+    for (; j > 0 && cjTupleCompare##N(data + (j-1)*arity, tmp, arity) > 0; --j) { \
+      cjTupleCopy##N(data + j*arity, data + (j-1)*arity, arity); \
+    } \
+    cjTupleCopy##N(data + j*arity, tmp, arity); \
+  } \
+} \
+\
+/* One stable counting pass per byte of each column from the last column to */ \
+/* the first. Keys are relative to the column minimum so only the bytes that */ \
+/* differ within a column cost a pass. */ \
+static void cjRadixSortTuples##N(T* data, T* tmp, size_t size, int arity) { \
+  size_t counts[4][256]; \
+  T* src = data; \
+  T* dst = tmp; \
+  for (int col = arity - 1; col >= 0; --col) { \
+    int64_t colMin = src[col]; \
+    for (size_t i = 1; i < size; ++i) { \
+      if (src[i*arity + col] < colMin) { colMin = src[i*arity + col]; } \
+    } \
+    memset(counts, 0, sizeof(counts)); \
+    for (size_t i = 0; i < size; ++i) { \
+      const uint32_t key = (uint32_t) (src[i*arity + col] - colMin); \
+      ++counts[0][key & 0xFF]; \
+      ++counts[1][(key >> 8) & 0xFF]; \
+      ++counts[2][(key >> 16) & 0xFF]; \
+      ++counts[3][key >> 24]; \
+    } \
+    for (int byte = 0; byte < (int) sizeof(T); ++byte) { \
+      const int shift = 8 * byte; \
+      if (counts[byte][((uint32_t) (src[col] - colMin) >> shift) & 0xFF] == size) { continue; } \
+      size_t offsets[256]; \
+      size_t offset = 0; \
+      for (int digit = 0; digit < 256; ++digit) { \
+        offsets[digit] = offset; \
+        offset += counts[byte][digit]; \
+      } \
+      for (size_t i = 0; i < size; ++i) { \
+        const int digit = ((uint32_t) (src[i*arity + col] - colMin) >> shift) & 0xFF; \
+        cjTupleCopy##N(dst + offsets[digit]++ * arity, src + i*arity, arity); \
+      } \
+      T* swap = src; \
+      src = dst; \
+      dst = swap; \
+    } \
+  } \
+  if (src != data) { \
+    memcpy(data, src, sizeof(T) * size * arity); \
+  } \
+} \
+\
+static void cjSortTuples##N(T* data, T* tmp, size_t size, int arity) { \
+  if (size < CJ_SORT_INSERTION_MAX) { cjInsertionSortTuples##N(data, tmp, size, arity); } \
+  else                              { cjRadixSortTuples##N(data, tmp, size, arity); } \
+} \
+\
+static void cjMergeTuples##N(T* data, T* out, size_t mid, size_t size, int arity) { \
+  const T* x = data; \
+  const T* xEnd = data + mid * arity; \
+  const T* y = xEnd; \
+  const T* yEnd = data + size * arity; \
+  T* o = out; \
+  while (x < xEnd && y < yEnd) { \
+    if (cjTupleCompare##N(y, x, arity) < 0) { cjTupleCopy##N(o, y, arity); y += arity; } \
+    else                                    { cjTupleCopy##N(o, x, arity); x += arity; } \
+    o += arity; \
+  } \
+  memcpy(o, x, sizeof(T) * (xEnd - x)); \
+  o += xEnd - x; \
+  memcpy(o, y, sizeof(T) * (yEnd - y)); \
+  memcpy(data, out, sizeof(T) * size * arity); \
+} \
+\
+static int cjTableFind##N(const T* data, int size, int arity, const int* tuple) { \
+  for (int iTuple = 0; iTuple < size; ++iTuple) { \
+    const T* t = data + (size_t) iTuple * arity; \
+    int iVal = 0; \
+    while (iVal < arity && t[iVal] == tuple[iVal]) { ++iVal; } \
+    if (iVal == arity) { return iTuple; } \
+  } \
+  return -1; \
+} \
+\
+static void cjRange##N(const T* data, size_t n, int* min, int* max) { \
+  T lo = data[0]; \
+  T hi = data[0]; \
+  for (size_t i = 1; i < n; ++i) { \
+    if (data[i] < lo) { lo = data[i]; } \
+    if (data[i] > hi) { hi = data[i]; } \
+  } \
+  *min = lo; \
+  *max = hi; \
+}
+
+CJ_DEFINE_TUPLE_KERNELS(8, int8_t)
+CJ_DEFINE_TUPLE_KERNELS(16, int16_t)
+CJ_DEFINE_TUPLE_KERNELS(32, int)
+
+/**
+ * Sort size tuples of arity values stored flat in data (arity 1 for a 1D
+ * array) in lexicographic order.
+ * @return CJ_ERROR_NOMEM if the scratch buffer could not be allocated.
+ */
+static CjError cjSortTuples(void* data, int width, int size, int arity) {
+  if (size < 2 || arity <= 0) { return CJ_ERROR_OK; }
+
+  int64_t tupleTmp[8];
+  void* tmp = tupleTmp;
+  if (size >= CJ_SORT_INSERTION_MAX || (size_t) width * arity > sizeof(tupleTmp)) {
+    tmp = cjMalloc((size_t) width * size * arity);
+    if (!tmp) { return CJ_ERROR_NOMEM; }
+  }
+  switch (width) {
+    case 1:  cjSortTuples8((int8_t*) data, (int8_t*) tmp, size, arity); break;
+    case 2:  cjSortTuples16((int16_t*) data, (int16_t*) tmp, size, arity); break;
+    default: cjSortTuples32((int*) data, (int*) tmp, size, arity); break;
+  }
+  if (tmp != tupleTmp) { cjFree(tmp); }
+  return CJ_ERROR_OK;
+}
+
+/** Merge the sorted runs [0, mid) and [mid, size) of data. */
+static CjError cjMergeTuples(void* data, int width, int mid, int size, int arity) {
+  void* out = cjMalloc((size_t) width * size * arity);
+  if (!out) { return CJ_ERROR_NOMEM; }
+  switch (width) {
+    case 1:  cjMergeTuples8((int8_t*) data, (int8_t*) out, mid, size, arity); break;
+    case 2:  cjMergeTuples16((int16_t*) data, (int16_t*) out, mid, size, arity); break;
+    default: cjMergeTuples32((int*) data, (int*) out, mid, size, arity); break;
+  }
+  cjFree(out);
+  return CJ_ERROR_OK;
+}
+
+/** @return the index of tuple (abs(arity) ints) in the table ts, or -1. */
+static int cjTableFind(const CjIntTuples* ts, const int* tuple) {
+  switch (ts->width) {
+    case 1:  return cjTableFind8(ts->data8, ts->size, abs(ts->arity), tuple);
+    case 2:  return cjTableFind16(ts->data16, ts->size, abs(ts->arity), tuple);
+    default: return cjTableFind32(ts->data, ts->size, abs(ts->arity), tuple);
+  }
+}
+
+/** Set min and max to the range of values in ts. ts must not be empty. */
+static void cjIntTuplesRange(const CjIntTuples* ts, int* min, int* max) {
+  const size_t n = (size_t) ts->size * abs(ts->arity);
+  switch (ts->width) {
+    case 1:  cjRange8(ts->data8, n, min, max); break;
+    case 2:  cjRange16(ts->data16, n, min, max); break;
+    default: cjRange32(ts->data, n, min, max); break;
+  }
+}
+
+/** Compare the first n values of xs and ys lexicographically. */
+static int cjIntTuplesCompare(const CjIntTuples* xs, const CjIntTuples* ys, size_t n) {
+  if (xs->width == ys->width) {
+    switch (xs->width) {
+      case 1:  return cjTupleCompare8(xs->data8, ys->data8, n);
+      case 2:  return cjTupleCompare16(xs->data16, ys->data16, n);
+      default: return cjTupleCompare32(xs->data, ys->data, n);
+    }
+  }
+  for (size_t i = 0; i < n; ++i) {
+    const int x = cjIntTuplesGet(xs, i);
+    const int y = cjIntTuplesGet(ys, i);
+    if (x != y) { return x < y ? -1 : 1; }
+  }
+  return 0;
+}
+
+/** Swap the i-th and j-th values of ts. */
+static void cjIntTuplesSwap(CjIntTuples* ts, size_t i, size_t j) {
+  const int x = cjIntTuplesGet(ts, i);
+  cjIntTuplesSet(ts, i, cjIntTuplesGet(ts, j));
+  cjIntTuplesSet(ts, j, x);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CjMdd
+//
+
+CjMdd cjMddInit() {
+  CjMdd x;
+  x.arity = 0;
+  x.nodes = cjIntTuplesInit();
+  x.edges = cjIntTuplesInit();
+  return x;
+}
+
+void cjMddFree(CjMdd* inout) {
+  if (!inout) { return; }
+  cjIntTuplesFree(&inout->nodes);
+  cjIntTuplesFree(&inout->edges);
+  *inout = cjMddInit();
+}
+
+/** Grow *data to hold at least needed ints. */
+static CjError cjIntsReserve(int** data, size_t* capacity, size_t needed) {
+  if (needed <= *capacity) { return CJ_ERROR_OK; }
+  size_t capacityNew = *capacity > 0 ? *capacity : 64;
+  while (capacityNew < needed) { capacityNew *= 2; }
+  int* dataNew = (int*) cjRealloc(*data, sizeof(int) * capacityNew);
+  if (!dataNew) { return CJ_ERROR_NOMEM; }
+  *data = dataNew;
+  *capacity = capacityNew;
+  return CJ_ERROR_OK;
+}
+
+/**
+ * The state of cjMddAlloc(). The edges of the node being built at each level
+ * are stacked on pending until its children are done, then moved to edges
+ * unless an identical node exists already.
+ */
+typedef struct CjMddBuilder {
+  /** Sorted tuples of arity ints. */
+  const int* tuples;
+  int arity;
+  /** [value, child] pairs of the nodes built so far. */
+  int* edges;
+  size_t edgesSize;
+  size_t edgesCapacity;
+  /** The edge (pair) offset of each node built so far, + 1 end offset. */
+  int* nodes;
+  size_t nodesSize;
+  size_t nodesCapacity;
+  /** [value, child] pairs of the nodes being built. */
+  int* pending;
+  size_t pendingSize;
+  size_t pendingCapacity;
+  /** Open-addressing set of 1 + node index by edges, 0 for empty slots. */
+  int* unique;
+  size_t uniqueCapacity;
+} CjMddBuilder;
+
+static uint64_t cjMddEdgesHash(const int* edges, size_t size) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ (uint32_t) edges[i]) * 1099511628211ULL;
+  }
+  return h ^ (h >> 29);
+}
+
+/** Put node iNode of b into b->unique which must have an empty slot. */
+static void cjMddUniquePut(CjMddBuilder* b, int iNode) {
+  const int* edges = b->edges + 2 * (size_t) b->nodes[iNode];
+  const size_t size = 2 * (size_t) (b->nodes[iNode + 1] - b->nodes[iNode]);
+  size_t slot = cjMddEdgesHash(edges, size) & (b->uniqueCapacity - 1);
+  while (b->unique[slot]) { slot = (slot + 1) & (b->uniqueCapacity - 1); }
+  b->unique[slot] = iNode + 1;
+}
+
+/** Insert node iNode of b into b->unique, doubling it when half full. */
+static CjError cjMddUniqueInsert(CjMddBuilder* b, int iNode) {
+  if (2 * (size_t) (iNode + 1) >= b->uniqueCapacity) {
+    const size_t capacity = b->uniqueCapacity > 0 ? 2 * b->uniqueCapacity : 64;
+    int* unique = (int*) cjCalloc(capacity, sizeof(int));
+    if (!unique) { return CJ_ERROR_NOMEM; }
+    cjFree(b->unique);
+    b->unique = unique;
+    b->uniqueCapacity = capacity;
+    for (int i = 0; i < iNode; ++i) { cjMddUniquePut(b, i); }
+  }
+  cjMddUniquePut(b, iNode);
+  return CJ_ERROR_OK;
+}
+
+/**
+ * Build the node of the sorted tuples [lo, hi) that share their first level
+ * values and set *node to its index.
+ */
+static CjError cjMddBuild(CjMddBuilder* b, int lo, int hi, int level, int* node) {
+  const size_t pendingStart = b->pendingSize;
+  CjError err = CJ_ERROR_OK;
+  for (int i = lo; i < hi && err == CJ_ERROR_OK; ) {
+    const int value = b->tuples[(size_t) i * b->arity + level];
+    int j = i + 1;
+    while (j < hi && b->tuples[(size_t) j * b->arity + level] == value) { ++j; }
+    int child = -1;
+    if (level + 1 < b->arity) { err = cjMddBuild(b, i, j, level + 1, &child); }
+    if (err == CJ_ERROR_OK) { err = cjIntsReserve(&b->pending, &b->pendingCapacity, b->pendingSize + 2); }
+    if (err == CJ_ERROR_OK) {
+      b->pending[b->pendingSize++] = value;
+      b->pending[b->pendingSize++] = child;
+    }
+    i = j;
+  }
+  if (err != CJ_ERROR_OK) { return err; }
+
+  // Reuse an identical node if there is one.
+  const int* edges = b->pending + pendingStart;
+  const size_t size = b->pendingSize - pendingStart;
+  if (b->uniqueCapacity > 0) {
+    size_t slot = cjMddEdgesHash(edges, size) & (b->uniqueCapacity - 1);
+    for (; b->unique[slot]; slot = (slot + 1) & (b->uniqueCapacity - 1)) {
+      const int iNode = b->unique[slot] - 1;
+      const size_t nodeSize = 2 * (size_t) (b->nodes[iNode + 1] - b->nodes[iNode]);
+      if (nodeSize == size && memcmp(b->edges + 2 * (size_t) b->nodes[iNode], edges, sizeof(int) * size) == 0) {
+        b->pendingSize = pendingStart;
+        *node = iNode;
+        return CJ_ERROR_OK;
+      }
+    }
+  }
+
+  err = cjIntsReserve(&b->edges, &b->edgesCapacity, b->edgesSize + size);
+  if (err == CJ_ERROR_OK) { err = cjIntsReserve(&b->nodes, &b->nodesCapacity, b->nodesSize + 1); }
+  if (err == CJ_ERROR_OK && (b->edgesSize + size) / 2 > INT_MAX) { err = CJ_ERROR_NOMEM; }
+  if (err != CJ_ERROR_OK) { return err; }
+  memcpy(b->edges + b->edgesSize, edges, sizeof(int) * size);
+  b->edgesSize += size;
+  b->nodes[b->nodesSize++] = (int) (b->edgesSize / 2);
+  b->pendingSize = pendingStart;
+  *node = (int) b->nodesSize - 2;
+  return cjMddUniqueInsert(b, *node);
+}
+
+CjError cjMddAlloc(const CjIntTuples* tuples, CjMdd* out) {
+  if (!tuples || !out || tuples->arity < 1) { return CJ_ERROR_ARG; }
+  *out = cjMddInit();
+
+  CjIntTuples sorted = cjIntTuplesInit();
+  CjError err = cjIntTuplesAlloc(tuples->size, tuples->arity, &sorted);
+  if (err != CJ_ERROR_OK) { return err; }
+  for (size_t i = 0; i < (size_t) tuples->size * tuples->arity; ++i) {
+    sorted.data[i] = cjIntTuplesGet(tuples, i);
+  }
+  err = cjSortTuples(sorted.data, sizeof(int), sorted.size, sorted.arity);
+
+  CjMddBuilder b;
+  memset(&b, 0, sizeof(b));
+  b.tuples = sorted.data;
+  b.arity = tuples->arity;
+  int root = -1;
+  if (err == CJ_ERROR_OK) { err = cjIntsReserve(&b.nodes, &b.nodesCapacity, 1); }
+  if (err == CJ_ERROR_OK) {
+    b.nodes[b.nodesSize++] = 0;
+    err = cjMddBuild(&b, 0, sorted.size, 0, &root);
+  }
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc((int) b.nodesSize, -1, &out->nodes); }
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc((int) b.edgesSize / 2, 2, &out->edges); }
+  if (err == CJ_ERROR_OK) {
+    memcpy(out->nodes.data, b.nodes, sizeof(int) * b.nodesSize);
+    if (b.edgesSize > 0) { memcpy(out->edges.data, b.edges, sizeof(int) * b.edgesSize); }
+    out->arity = tuples->arity;
+  }
+  else {
+    cjMddFree(out);
+  }
+  cjFree(b.edges);
+  cjFree(b.nodes);
+  cjFree(b.pending);
+  cjFree(b.unique);
+  cjIntTuplesFree(&sorted);
+  return err;
+}
+
+CjError cjMddValidate(const CjMdd* mdd) {
+  if (!mdd) { return CJ_ERROR_ARG; }
+  if (mdd->arity < 1) { return CJ_ERROR_VALIDATION_MDD; }
+  if (mdd->nodes.arity != -1 || mdd->nodes.size < 2) { return CJ_ERROR_VALIDATION_MDD; }
+  if (mdd->edges.size > 0 && mdd->edges.arity != 2) { return CJ_ERROR_VALIDATION_MDD; }
+  const int nodesSize = mdd->nodes.size - 1;
+  if (cjIntTuplesGet(&mdd->nodes, 0) != 0) { return CJ_ERROR_VALIDATION_MDD; }
+  if (cjIntTuplesGet(&mdd->nodes, nodesSize) != mdd->edges.size) { return CJ_ERROR_VALIDATION_MDD; }
+  for (int iNode = 0; iNode < nodesSize; ++iNode) {
+    if (cjIntTuplesGet(&mdd->nodes, iNode) > cjIntTuplesGet(&mdd->nodes, iNode + 1)) {
+      return CJ_ERROR_VALIDATION_MDD;
+    }
+  }
+
+  // Walk parents before children, checking each node is on a single level.
+  int* levels = (int*) cjMalloc(sizeof(int) * nodesSize);
+  if (!levels) { return CJ_ERROR_NOMEM; }
+  for (int iNode = 0; iNode < nodesSize; ++iNode) { levels[iNode] = -1; }
+  levels[nodesSize - 1] = 0;
+  CjError err = CJ_ERROR_OK;
+  for (int iNode = nodesSize - 1; iNode >= 0 && err == CJ_ERROR_OK; --iNode) {
+    const int level = levels[iNode];
+    const int lo = cjIntTuplesGet(&mdd->nodes, iNode);
+    const int hi = cjIntTuplesGet(&mdd->nodes, iNode + 1);
+    // Only the root of an empty set has no edges.
+    if (level < 0 || (lo == hi && (iNode != nodesSize - 1 || nodesSize != 1))) {
+      err = CJ_ERROR_VALIDATION_MDD;
+    }
+    for (int e = lo; e < hi && err == CJ_ERROR_OK; ++e) {
+      const int child = cjIntTuplesGet(&mdd->edges, 2 * (size_t) e + 1);
+      if (e > lo && cjIntTuplesGet(&mdd->edges, 2 * (size_t) e) <= cjIntTuplesGet(&mdd->edges, 2 * (size_t) e - 2)) {
+        err = CJ_ERROR_VALIDATION_MDD;
+      }
+      else if (level == mdd->arity - 1) {
+        if (child != -1) { err = CJ_ERROR_VALIDATION_MDD; }
+      }
+      else if (child < 0 || child >= iNode || (levels[child] >= 0 && levels[child] != level + 1)) {
+        err = CJ_ERROR_VALIDATION_MDD;
+      }
+      else {
+        levels[child] = level + 1;
+      }
+    }
+  }
+  cjFree(levels);
+  return err;
+}
+
+int cjMddHas(const CjMdd* mdd, const int* tuple) {
+  int node = mdd->nodes.size - 2;
+  for (int level = 0; level < mdd->arity; ++level) {
+    // Binary search the edges of node for the value.
+    int lo = cjIntTuplesGet(&mdd->nodes, node);
+    int hi = cjIntTuplesGet(&mdd->nodes, node + 1);
+    while (lo < hi) {
+      const int mid = lo + (hi - lo) / 2;
+      if (cjIntTuplesGet(&mdd->edges, 2 * (size_t) mid) < tuple[level]) { lo = mid + 1; }
+      else { hi = mid; }
+    }
+    if (lo == cjIntTuplesGet(&mdd->nodes, node + 1)
+        || cjIntTuplesGet(&mdd->edges, 2 * (size_t) lo) != tuple[level]) {
+      return 0;
+    }
+    node = cjIntTuplesGet(&mdd->edges, 2 * (size_t) lo + 1);
+  }
+  return 1;
+}
+
+CjError cjMddExpand(const CjMdd* mdd, CjIntTuples* out) {
+  if (!mdd || !out) { return CJ_ERROR_ARG; }
+  CjError err = cjMddValidate(mdd);
+  if (err != CJ_ERROR_OK) { return err; }
+  const int nodesSize = mdd->nodes.size - 1;
+
+  // Count the paths below each node: children come before their parents.
+  int64_t* paths = (int64_t*) cjMalloc(sizeof(int64_t) * nodesSize);
+  int* stack = (int*) cjMalloc(sizeof(int) * 2 * mdd->arity);
+  int* tuple = (int*) cjMalloc(sizeof(int) * mdd->arity);
+  if (!paths || !stack || !tuple) {
+    cjFree(paths); cjFree(stack); cjFree(tuple);
+    return CJ_ERROR_NOMEM;
+  }
+  for (int iNode = 0; iNode < nodesSize; ++iNode) {
+    paths[iNode] = 0;
+    for (int e = cjIntTuplesGet(&mdd->nodes, iNode); e < cjIntTuplesGet(&mdd->nodes, iNode + 1); ++e) {
+      const int child = cjIntTuplesGet(&mdd->edges, 2 * (size_t) e + 1);
+      paths[iNode] += child < 0 ? 1 : paths[child];
+      if (paths[iNode] > INT_MAX) { paths[iNode] = INT_MAX + (int64_t) 1; }
+    }
+  }
+  if (paths[nodesSize - 1] > INT_MAX) { err = CJ_ERROR_NOMEM; }
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc((int) paths[nodesSize - 1], mdd->arity, out); }
+
+  // Depth first in edge order, which is lexicographic order. stack holds the
+  // current edge and the end edge of each level.
+  int size = 0;
+  int level = 0;
+  if (err == CJ_ERROR_OK) {
+    stack[0] = cjIntTuplesGet(&mdd->nodes, nodesSize - 1);
+    stack[1] = cjIntTuplesGet(&mdd->nodes, nodesSize);
+  }
+  while (err == CJ_ERROR_OK && level >= 0) {
+    if (stack[2*level] == stack[2*level + 1]) {
+      if (--level >= 0) { stack[2*level]++; }
+      continue;
+    }
+    const int e = stack[2*level];
+    tuple[level] = cjIntTuplesGet(&mdd->edges, 2 * (size_t) e);
+    if (level == mdd->arity - 1) {
+      memcpy(out->data + (size_t) size * mdd->arity, tuple, sizeof(int) * mdd->arity);
+      ++size;
+      stack[2*level]++;
+      continue;
+    }
+    const int child = cjIntTuplesGet(&mdd->edges, 2 * (size_t) e + 1);
+    ++level;
+    stack[2*level] = cjIntTuplesGet(&mdd->nodes, child);
+    stack[2*level + 1] = cjIntTuplesGet(&mdd->nodes, child + 1);
+  }
+
+  cjFree(paths);
+  cjFree(stack);
+  cjFree(tuple);
+  return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Init, Alloc and Free
+//
 
 CjIntTuples cjIntTuplesInit() {
   CjIntTuples x;
   x.size = 0;
   x.arity = 0;
+  x.width = sizeof(int);
   x.data = NULL;
   return x;
 }
@@ -20,9 +680,10 @@ CjError cjIntTuplesAlloc(int size, int arity, CjIntTuples* out) {
   }
   out->size = size;
   out->arity = arity;
+  out->width = sizeof(int);
   out->data = NULL;
   if (size > 0 && abs(arity) > 0) {
-    out->data = (int*) malloc(sizeof(int) * size * abs(arity));
+    out->data = (int*) cjMalloc(sizeof(int) * size * abs(arity));
     if (!out->data) {
       *out = cjIntTuplesInit();
       return CJ_ERROR_NOMEM;
@@ -33,14 +694,15 @@ CjError cjIntTuplesAlloc(int size, int arity, CjIntTuples* out) {
 
 void cjIntTuplesFree(CjIntTuples* inout) {
   if (!inout) { return; }
-  free(inout->data);
+  cjFree(inout->data);
   inout->data = NULL;
   inout->arity = 0;
   inout->size = 0;
+  inout->width = sizeof(int);
 }
 
 CjIntTuples* cjIntTuplesArray(int size) {
-  CjIntTuples* xs = (CjIntTuples*) malloc(sizeof(CjIntTuples) * size);
+  CjIntTuples* xs = (CjIntTuples*) cjMalloc(sizeof(CjIntTuples) * size);
   if (!xs) { return NULL; }
   for (int i = 0; i < size; ++i) {
     xs[i] = cjIntTuplesInit();
@@ -54,10 +716,46 @@ void cjIntTuplesArrayFree(CjIntTuples** inout, int size) {
   for (int i = 0; i < size; ++i) {
     cjIntTuplesFree(&((*inout)[i]));
   }
-  free(*inout);
+  cjFree(*inout);
   *inout = NULL;
 }
 
+/** Copy ts into a new buffer of width bytes per value. */
+static CjError cjIntTuplesRewidth(CjIntTuples* ts, int width) {
+  if (ts->width == width) { return CJ_ERROR_OK; }
+  const size_t n = (size_t) ts->size * abs(ts->arity);
+  CjIntTuples out = *ts;
+  out.width = width;
+  out.data = NULL;
+  if (n > 0) {
+    out.data = (int*) cjMalloc((size_t) width * n);
+    if (!out.data) { return CJ_ERROR_NOMEM; }
+  }
+  for (size_t i = 0; i < n; ++i) {
+    cjIntTuplesSet(&out, i, cjIntTuplesGet(ts, i));
+  }
+  cjFree(ts->data);
+  *ts = out;
+  return CJ_ERROR_OK;
+}
+
+CjError cjIntTuplesNarrow(CjIntTuples* ts) {
+  if (!ts) { return CJ_ERROR_ARG; }
+  int width = 1;
+  if (ts->size > 0 && ts->arity != 0) {
+    int min, max;
+    cjIntTuplesRange(ts, &min, &max);
+    if (min < INT8_MIN || max > INT8_MAX) { width = 2; }
+    if (min < INT16_MIN || max > INT16_MAX) { width = sizeof(int); }
+  }
+  return cjIntTuplesRewidth(ts, width);
+}
+
+CjError cjIntTuplesWiden(CjIntTuples* ts) {
+  if (!ts) { return CJ_ERROR_ARG; }
+  return cjIntTuplesRewidth(ts, sizeof(int));
+}
+
 CjMeta cjMetaInit() {
   CjMeta x;
   x.id = NULL;
@@ -68,9 +766,9 @@ CjMeta cjMetaInit() {
 
 void cjMetaFree(CjMeta* inout) {
   if (!inout) { return; }
-  free(inout->id);
-  free(inout->algo);
-  free(inout->paramsJSON);
+  cjFree(inout->id);
+  cjFree(inout->algo);
+  cjFree(inout->paramsJSON);
   *inout = cjMetaInit();
 }
 
@@ -92,11 +790,28 @@ CjError cjDomainValuesAlloc(int size, CjDomain* out) {
   return CJ_ERROR_OK;
 }
 
+/** @return 1 if lo..hi is not empty and has at most INT_MAX values. */
+static int cjDomainRangeIsValid(int lo, int hi) {
+  return lo <= hi && (int64_t) hi - lo + 1 <= INT_MAX;
+}
+
+CjError cjDomainRangeInit(int lo, int hi, CjDomain* out) {
+  if (!out || !cjDomainRangeIsValid(lo, hi)) { return CJ_ERROR_ARG; }
+  out->type = CJ_DOMAIN_RANGE;
+  out->range.lo = lo;
+  out->range.hi = hi;
+  return CJ_ERROR_OK;
+}
+
 void cjDomainFree(CjDomain* inout) {
   if (!inout) { return; }
   switch (inout->type) {
+    case CJ_DOMAIN_UNDEF:
+    case CJ_DOMAIN_RANGE:
+      break;
     case CJ_DOMAIN_VALUES:
       cjIntTuplesFree(&inout->values);
+      break;
     default:
       assert(0);
       break;
@@ -104,8 +819,27 @@ void cjDomainFree(CjDomain* inout) {
   inout->type = CJ_DOMAIN_UNDEF;
 }
 
+int cjDomainSize(const CjDomain* domain) {
+  switch (domain->type) {
+    case CJ_DOMAIN_VALUES: return domain->values.size;
+    case CJ_DOMAIN_RANGE: {
+      const int64_t size = (int64_t) domain->range.hi - domain->range.lo + 1;
+      return size < 0 ? 0 : size > INT_MAX ? INT_MAX : (int) size;
+    }
+    default:               return 0;
+  }
+}
+
+int cjDomainHasValue(const CjDomain* domain, int value) {
+  switch (domain->type) {
+    case CJ_DOMAIN_VALUES: return cjTableFind(&domain->values, &value) >= 0;
+    case CJ_DOMAIN_RANGE:  return domain->range.lo <= value && value <= domain->range.hi;
+    default:               return 0;
+  }
+}
+
 CjDomain* cjDomainArray(int size) {
-  CjDomain* xs = (CjDomain*) malloc(sizeof(CjDomain) * size);
+  CjDomain* xs = (CjDomain*) cjMalloc(sizeof(CjDomain) * size);
   if (!xs) { return NULL; }
   for (int i = 0; i < size; ++i) {
     xs[i] = cjDomainInit();
@@ -119,7 +853,7 @@ void cjDomainArrayFree(CjDomain** inout, int size) {
   for (int i = 0; i < size; ++i) {
     cjDomainFree(&((*inout)[i]));
   }
-  free(*inout);
+  cjFree(*inout);
   *inout = NULL;
 }
 
@@ -137,19 +871,100 @@ CjError cjConstraintDefNoGoodAlloc(int size, int arity, CjConstraintDef* out) {
   return CJ_ERROR_OK;
 }
 
+void cjConstraintDefAllDifferentInit(CjConstraintDef* out) {
+  if (!out) { return; }
+  out->type = CJ_CONSTRAINT_DEF_ALL_DIFFERENT;
+}
+
+CjError cjConstraintDefGoodAlloc(int size, int arity, CjConstraintDef* out) {
+  if (!out) { return CJ_ERROR_ARG; }
+  out->type = CJ_CONSTRAINT_DEF_GOODS;
+  int stat = cjIntTuplesAlloc(size, arity, &out->goods);
+  if (stat != CJ_ERROR_OK) { return stat; }
+  return CJ_ERROR_OK;
+}
+
+int cjPredicateHolds(CjPredicateOp op, int k, int x, int y) {
+  const int64_t diff = (int64_t) x - (int64_t) y;
+  switch (op) {
+    case CJ_PREDICATE_EQ:           return x == y;
+    case CJ_PREDICATE_NEQ:          return x != y;
+    case CJ_PREDICATE_LT:           return x < y;
+    case CJ_PREDICATE_LE:           return x <= y;
+    case CJ_PREDICATE_GT:           return x > y;
+    case CJ_PREDICATE_GE:           return x >= y;
+    case CJ_PREDICATE_ABS_DIFF_EQ:  return llabs(diff) == k;
+    case CJ_PREDICATE_ABS_DIFF_NEQ: return llabs(diff) != k;
+    default:                        return 0;
+  }
+}
+
+CjError cjConstraintDefPredicateInit(CjPredicateOp op, int k, CjConstraintDef* out) {
+  if (!out || op < 0 || op >= CJ_PREDICATE_SIZE) { return CJ_ERROR_ARG; }
+  const bool hasK = op == CJ_PREDICATE_ABS_DIFF_EQ || op == CJ_PREDICATE_ABS_DIFF_NEQ;
+  if (hasK ? k < 0 : k != 0) { return CJ_ERROR_ARG; }
+  out->type = CJ_CONSTRAINT_DEF_PREDICATE;
+  out->predicate.op = op;
+  out->predicate.k = k;
+  return CJ_ERROR_OK;
+}
+
+CjError cjConstraintDefCompressMdd(CjConstraintDef* def) {
+  if (!def || def->type != CJ_CONSTRAINT_DEF_NO_GOODS) { return CJ_ERROR_ARG; }
+  CjMdd mdd = cjMddInit();
+  CjError err = cjMddAlloc(&def->noGoods, &mdd);
+  if (err != CJ_ERROR_OK) { return err; }
+  cjIntTuplesFree(&def->noGoods);
+  def->type = CJ_CONSTRAINT_DEF_NO_GOODS_MDD;
+  def->noGoodsMdd = mdd;
+  return CJ_ERROR_OK;
+}
+
+CjError cjConstraintDefExpandMdd(CjConstraintDef* def) {
+  if (!def || def->type != CJ_CONSTRAINT_DEF_NO_GOODS_MDD) { return CJ_ERROR_ARG; }
+  CjIntTuples noGoods = cjIntTuplesInit();
+  CjError err = cjMddExpand(&def->noGoodsMdd, &noGoods);
+  if (err != CJ_ERROR_OK) { return err; }
+  cjMddFree(&def->noGoodsMdd);
+  def->type = CJ_CONSTRAINT_DEF_NO_GOODS;
+  def->noGoods = noGoods;
+  return CJ_ERROR_OK;
+}
+
 void cjConstraintDefFree(CjConstraintDef* inout) {
   if (!inout) { return; }
   switch (inout->type) {
+    case CJ_CONSTRAINT_DEF_UNDEF:
+    case CJ_CONSTRAINT_DEF_ALL_DIFFERENT:
+    case CJ_CONSTRAINT_DEF_PREDICATE:
+      break;
     case CJ_CONSTRAINT_DEF_NO_GOODS:
       cjIntTuplesFree(&inout->noGoods);
+      break;
+    case CJ_CONSTRAINT_DEF_GOODS:
+      cjIntTuplesFree(&inout->goods);
+      break;
+    case CJ_CONSTRAINT_DEF_NO_GOODS_MDD:
+      cjMddFree(&inout->noGoodsMdd);
+      break;
     default:
       assert(0);
       break;
   }
+  inout->type = CJ_CONSTRAINT_DEF_UNDEF;
+}
+
+/** @return the table of a noGoods or goods def, NULL for other types. */
+static CjIntTuples* cjConstraintDefTable(const CjConstraintDef* def) {
+  switch (def->type) {
+    case CJ_CONSTRAINT_DEF_NO_GOODS: return (CjIntTuples*) &def->noGoods;
+    case CJ_CONSTRAINT_DEF_GOODS:    return (CjIntTuples*) &def->goods;
+    default:                         return NULL;
+  }
 }
 
 CjConstraintDef* cjConstraintDefArray(int size) {
-  CjConstraintDef* xs = (CjConstraintDef*) malloc(sizeof(CjConstraintDef) * size);
+  CjConstraintDef* xs = (CjConstraintDef*) cjMalloc(sizeof(CjConstraintDef) * size);
   if (!xs) { return NULL; }
   for (int i = 0; i < size; ++i) {
     xs[i] = cjConstraintDefInit();
@@ -163,7 +978,7 @@ void cjConstraintDefArrayFree(CjConstraintDef** inout, int size) {
   for (int i = 0; i < size; ++i) {
     cjConstraintDefFree(&((*inout)[i]));
   }
-  free(*inout);
+  cjFree(*inout);
   *inout = NULL;
 }
 
@@ -190,7 +1005,7 @@ void cjConstraintFree(CjConstraint* inout) {
 }
 
 CjConstraint* cjConstraintArray(int size) {
-  CjConstraint* xs = (CjConstraint*) malloc(sizeof(CjConstraint) * size);
+  CjConstraint* xs = (CjConstraint*) cjMalloc(sizeof(CjConstraint) * size);
   if (!xs) { return NULL; }
   for (int i = 0; i < size; ++i) {
     xs[i] = cjConstraintInit();
@@ -204,10 +1019,12 @@ void cjConstraintArrayFree(CjConstraint** inout, int size) {
   for (int i = 0; i < size; ++i) {
     cjConstraintFree(&((*inout)[i]));
   }
-  free(*inout);
+  cjFree(*inout);
   *inout = NULL;
 }
 
+static void cjCspReleaseShared(CjCsp* csp);
+
 CjCsp cjCspInit() {
   CjCsp x;
 
@@ -217,6 +1034,7 @@ CjCsp cjCspInit() {
   x.domains = NULL;
 
   x.vars = cjIntTuplesInit();
+  x.varRuns = cjIntTuplesInit();
 
   x.constraintDefsSize = 0;
   x.constraintDefs = NULL;
@@ -224,6 +1042,12 @@ CjCsp cjCspInit() {
   x.constraintsSize = 0;
   x.constraints = NULL;
 
+  x.varsRefs = NULL;
+  x.constraintDefsRefs = NULL;
+  x.constraintsRefs = NULL;
+
+  x.validated = 0;
+
   return x;
 }
 
@@ -231,169 +1055,2791 @@ void cjCspFree(CjCsp* inout) {
   if (!inout) { return; }
   cjMetaFree(&inout->meta);
   cjDomainArrayFree(&inout->domains, inout->domainsSize);
-  cjConstraintDefArrayFree(&inout->constraintDefs, inout->constraintDefsSize);
-  cjConstraintArrayFree(&inout->constraints, inout->constraintsSize);
+  cjCspReleaseShared(inout);
   *inout = cjCspInit();
 }
 
-CjError cjCspValidate(const CjCsp* csp) {
-  if (!csp) { return CJ_ERROR_ARG; }
+////////////////////////////////////////////////////////////////////////////////
+// Clone
+//
+// cjCspClone() copies the meta and domains of a csp and shares its vars,
+// constraintDefs and constraints with the clone. Shared arrays carry a
+// reference count and the last cjCspFree() frees them.
+//
+// Writing one def (resp. constraint) of a shared array first gives the csp a
+// shallow copy of the array, which borrows the tables of the shared one and
+// keeps it alive, then copies the tables of that def only: the borrowed
+// items are tracked in CjRefCount.owned. Writing the whole array
+// (cjCspUnshareConstraintDefs()) copies the tables that are still borrowed.
+//
 
-  // Check domains
-  if (csp->domainsSize < 0) { return CJ_ERROR_VALIDATION_DOMAINS_SIZE; }
-  for (int iDom = 0; iDom < csp->domainsSize; ++iDom) {
-    if (csp->domains[iDom].type <= CJ_DOMAIN_UNDEF) { return CJ_ERROR_VALIDATION_DOMAINS_TYPE; }
-    if (csp->domains[iDom].type >= CJ_DOMAIN_SIZE) { return CJ_ERROR_VALIDATION_DOMAINS_TYPE; }
-  }
+/** How to free the items of an array shared by cjCspClone() or replace one by a deep copy. */
+typedef struct CjItemOps {
+  size_t size;
+  void (*free)(void* item);
+  CjError (*own)(void* item);
+} CjItemOps;
 
-  // Check vars
-  if (csp->vars.arity != -1) { return CJ_ERROR_VALIDATION_VARS_ARITY; }
-  if (csp->vars.size < 0) { return CJ_ERROR_VALIDATION_VARS_SIZE; }
-  for (int iVar = 0; iVar < csp->vars.size; ++iVar) {
-    if (csp->vars.data[iVar] < 0) { return CJ_ERROR_VALIDATION_VAR_RANGE; }
-    if (csp->domainsSize <= csp->vars.data[iVar]) { return CJ_ERROR_VALIDATION_VAR_RANGE; }
-  }
+struct CjRefCount {
+  atomic_int refs;
+  /** The shared array of size items, freed by the last reference. NULL for vars. */
+  void* items;
+  int size;
+  const CjItemOps* ops;
+  /**
+   * Non-null when items is a shallow copy of the items of base: item i still
+   * points into the tables of base, which this array holds a reference to,
+   * until it is copied and owned[i] set. ownedSize counts the set ones.
+   */
+  CjRefCount* base;
+  unsigned char* owned;
+  int ownedSize;
+};
 
-  // Check constraintDefs
-  if (csp->constraintDefsSize < 0) { return CJ_ERROR_VALIDATION_CONSTRAINTDEFS_SIZE; }
-  for (int iCDef = 0; iCDef < csp->constraintDefsSize; ++iCDef) {
-    if (csp->constraintDefs[iCDef].type <= CJ_CONSTRAINT_DEF_UNDEF) { return CJ_ERROR_VALIDATION_CONSTRAINTDEF_TYPE; }
-    if (csp->constraintDefs[iCDef].type >= CJ_CONSTRAINT_DEF_SIZE) { return CJ_ERROR_VALIDATION_CONSTRAINTDEF_TYPE; }
+/**
+ * Take a reference to the array items of size items, creating its count if
+ * it is not shared yet.
+ */
+static CjError cjRefCountAcquire(CjRefCount** refs, void* items, int size, const CjItemOps* ops) {
+  if (!*refs) {
+    *refs = (CjRefCount*) cjMalloc(sizeof(CjRefCount));
+    if (!*refs) { return CJ_ERROR_NOMEM; }
+    atomic_init(&(*refs)->refs, 1);
+    (*refs)->items = items;
+    (*refs)->size = size;
+    (*refs)->ops = ops;
+    (*refs)->base = NULL;
+    (*refs)->owned = NULL;
+    (*refs)->ownedSize = 0;
   }
+  atomic_fetch_add(&(*refs)->refs, 1);
+  return CJ_ERROR_OK;
+}
 
-  // Check constraints
-  if (csp->constraintsSize < 0) { return CJ_ERROR_VALIDATION_CONSTRAINTS_SIZE; }
-  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
-    CjConstraint* c = &csp->constraints[iC];
-    if (c->id < 0) { return CJ_ERROR_VALIDATION_CONSTRAINT_ID_RANGE; }
-    if (c->id >= csp->constraintDefsSize) { return CJ_ERROR_VALIDATION_CONSTRAINT_ID_RANGE; }
-    if (c->vars.arity != -1) { return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_ARITY; }
-    if (c->vars.size < 0) { return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE; }
-    for (int iVar = 0; iVar < c->vars.size; ++iVar) {
-      if (c->vars.data[iVar] < 0) { return CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE; }
-      if (c->vars.data[iVar] >= csp->vars.size) { return CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE; }
-    }
-    if (csp->constraintDefs[c->id].type == CJ_CONSTRAINT_DEF_NO_GOODS) {
-      if (c->vars.size != csp->constraintDefs[c->id].noGoods.arity) {
-        return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE;
-      }
-    }
-    else {
-      return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
-    }
+/**
+ * Drop a reference to a shared array and null (*refs).
+ * @return 1 if it was the last one (or the array was not shared), in which
+ * case the caller frees the array.
+ */
+static int cjRefCountRelease(CjRefCount** refs) {
+  if (!*refs) { return 1; }
+  const int last = atomic_fetch_sub(&(*refs)->refs, 1) == 1;
+  if (last) { cjFree(*refs); }
+  *refs = NULL;
+  return last;
+}
+
+/** Free the count of an array that is neither shared nor borrowing: the csp owns it all. */
+static void cjRefCountFreeOwner(CjRefCount** refs) {
+  cjFree((*refs)->owned);
+  cjFree(*refs);
+  *refs = NULL;
+}
+
+/** Free the items array of size items, or only its owned items if owned is non-null. */
+static void cjItemsFree(void* items, int size, const unsigned char* owned, const CjItemOps* ops) {
+  for (int i = 0; i < size; ++i) {
+    if (!owned || owned[i]) { ops->free((char*) items + ops->size * i); }
   }
+  cjFree(items);
+}
 
-  return CJ_ERROR_OK;
+/** Drop a reference to an array: the last one frees the items it owns and drops its base. */
+static void cjRefCountReleaseItems(CjRefCount* r) {
+  while (r && atomic_fetch_sub(&r->refs, 1) == 1) {
+    CjRefCount* base = r->base;
+    cjItemsFree(r->items, r->size, r->owned, r->ops);
+    cjFree(r->owned);
+    cjFree(r);
+    r = base;
+  }
 }
 
-static int compareInts(const void* x, const void* y) {
-   return ( *(int*)x - *(int*)y );
+/** Drop a reference to the array (*items) of size items, or free it if not shared, and null both. */
+static void cjSharedArrayRelease(CjRefCount** refs, void** items, int size, const CjItemOps* ops) {
+  if (*refs) { cjRefCountReleaseItems(*refs); }
+  else       { cjItemsFree(*items, size, NULL, ops); }
+  *refs = NULL;
+  *items = NULL;
 }
 
-static int compareIntTuples2(const void* xPtr, const void* yPtr) {
-  int x0 = ((int*) xPtr)[0];
-  int y0 = ((int*) yPtr)[0];
-  int x1 = ((int*) xPtr)[1];
-  int y1 = ((int*) yPtr)[1];
+/**
+ * Make (*items), of size items, the csp's own array, sharing the tables of
+ * the items with the array it was shared as, unless it is already.
+ */
+static CjError cjSharedArrayUnshareShallow(CjRefCount** refs, void** items, int size, const CjItemOps* ops) {
+  if (!*refs || atomic_load(&(*refs)->refs) == 1) { return CJ_ERROR_OK; }
+  CjRefCount* r = (CjRefCount*) cjMalloc(sizeof(CjRefCount));
+  void* copy = size > 0 ? cjMalloc(ops->size * size) : NULL;
+  unsigned char* owned = (unsigned char*) cjCalloc(size > 0 ? size : 1, 1);
+  if (!r || (size > 0 && !copy) || !owned) {
+    cjFree(r);
+    cjFree(copy);
+    cjFree(owned);
+    return CJ_ERROR_NOMEM;
+  }
+  if (size > 0) { memcpy(copy, *items, ops->size * size); }
+  atomic_init(&r->refs, 1);
+  r->items = copy;
+  r->size = size;
+  r->ops = ops;
+  // The csp's reference to the shared array becomes the base reference.
+  r->base = *refs;
+  r->owned = owned;
+  r->ownedSize = 0;
+  *refs = r;
+  *items = copy;
+  return CJ_ERROR_OK;
+}
 
-  if (x0 < y0) {
-    return -1;
+/** Give the csp its own copy of item i of (*items), copying its tables only. */
+static CjError cjSharedArrayUnshareItem(CjRefCount** refs, void** items, int size, int i, const CjItemOps* ops) {
+  CjError err = cjSharedArrayUnshareShallow(refs, items, size, ops);
+  if (err != CJ_ERROR_OK || !*refs) { return err; }
+  CjRefCount* r = *refs;
+  if (r->owned && !r->owned[i]) {
+    err = ops->own((char*) *items + ops->size * i);
+    if (err != CJ_ERROR_OK) { return err; }
+    r->owned[i] = 1;
+    ++r->ownedSize;
   }
-  else if (x0 > y0) {
-    return 1;
+  // Once every item is owned, the base is no longer needed.
+  if (!r->owned || r->ownedSize == size) {
+    cjRefCountReleaseItems(r->base);
+    cjRefCountFreeOwner(refs);
   }
-  return x1 - y1;
+  return CJ_ERROR_OK;
 }
 
-CjError cjCspNormalize(const CjCsp* csp) {
-  if (!csp) { return CJ_ERROR_ARG; }
-
-  for (int iDom = 0; iDom < csp->domainsSize; ++iDom) {
-    if (csp->domains[iDom].type != CJ_DOMAIN_VALUES) {
-      return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
+/** Give the csp its own copy of every item of (*items), with their tables. */
+static CjError cjSharedArrayUnshare(CjRefCount** refs, void** items, int size, const CjItemOps* ops) {
+  if (!*refs) { return CJ_ERROR_OK; }
+  CjRefCount* r = *refs;
+  if (atomic_load(&r->refs) == 1) {
+    // Only copy what is still borrowed.
+    for (int i = 0; r->owned && i < size; ++i) {
+      CjError err = cjSharedArrayUnshareItem(refs, items, size, i, ops);
+      if (err != CJ_ERROR_OK || !*refs) { return err; }
     }
-    qsort(csp->domains[iDom].values.data, csp->domains[iDom].values.size, sizeof(int), compareInts);
+    if (*refs) { cjRefCountFreeOwner(refs); }
+    return CJ_ERROR_OK;
   }
 
-  for (int iCDef = 0; iCDef < csp->constraintDefsSize; ++iCDef) {
-    if (csp->constraintDefs[iCDef].type != CJ_CONSTRAINT_DEF_NO_GOODS) {
-      return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
-    }
-    if (csp->constraintDefs[iCDef].noGoods.arity != 2) {
-      return CJ_ERROR_NOGOODS_ARRAY_DIFFERENT_ARITIES;
+  char* copy = size > 0 ? (char*) cjMalloc(ops->size * size) : NULL;
+  if (size > 0 && !copy) { return CJ_ERROR_NOMEM; }
+  if (size > 0) { memcpy(copy, *items, ops->size * size); }
+  for (int i = 0; i < size; ++i) {
+    CjError err = ops->own(copy + ops->size * i);
+    if (err != CJ_ERROR_OK) {
+      cjItemsFree(copy, i, NULL, ops);
+      return err;
     }
-    qsort(
-      csp->constraintDefs[iCDef].noGoods.data,
-      csp->constraintDefs[iCDef].noGoods.size,
-      sizeof(int) * csp->constraintDefs[iCDef].noGoods.arity,
-      compareIntTuples2);
   }
+  // The other holders may have dropped theirs while copying.
+  cjSharedArrayRelease(refs, items, size, ops);
+  *items = copy;
+  return CJ_ERROR_OK;
+}
 
+static CjError cjStrCopy(const char* str, char** out) {
+  *out = NULL;
+  if (!str) { return CJ_ERROR_OK; }
+  const size_t len = strlen(str);
+  *out = (char*) cjMalloc(len + 1);
+  if (!*out) { return CJ_ERROR_NOMEM; }
+  memcpy(*out, str, len + 1);
   return CJ_ERROR_OK;
 }
 
-CjError cjCspIsSolved(const CjCsp* csp, const CjIntTuples* solution, int* solved) {
-  if (!csp || !solution) { return CJ_ERROR_ARG; }
+/** Copy ts, keeping its width. */
+static CjError cjIntTuplesCopy(const CjIntTuples* ts, CjIntTuples* out) {
+  *out = *ts;
+  out->data = NULL;
+  const size_t bytes = (size_t) ts->width * ts->size * abs(ts->arity);
+  if (bytes > 0) {
+    out->data = (int*) cjMalloc(bytes);
+    if (!out->data) { *out = cjIntTuplesInit(); return CJ_ERROR_NOMEM; }
+    memcpy(out->data, ts->data, bytes);
+  }
+  return CJ_ERROR_OK;
+}
 
-  CjError err = cjCspValidate(csp);
-  if (err != CJ_ERROR_OK) { return err; }
+static CjError cjDomainCopy(const CjDomain* domain, CjDomain* out) {
+  *out = *domain;
+  if (domain->type != CJ_DOMAIN_VALUES) { return CJ_ERROR_OK; }
+  CjError err = cjIntTuplesCopy(&domain->values, &out->values);
+  if (err != CJ_ERROR_OK) { *out = cjDomainInit(); }
+  return err;
+}
+
+static CjError cjConstraintDefCopy(const CjConstraintDef* def, CjConstraintDef* out) {
+  *out = *def;
+  CjError err = CJ_ERROR_OK;
+  const CjIntTuples* table = cjConstraintDefTable(def);
+  if (table) {
+    err = cjIntTuplesCopy(table, cjConstraintDefTable(out));
+  }
+  else if (def->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    out->noGoodsMdd.edges = cjIntTuplesInit();
+    err = cjIntTuplesCopy(&def->noGoodsMdd.nodes, &out->noGoodsMdd.nodes);
+    if (err == CJ_ERROR_OK) { err = cjIntTuplesCopy(&def->noGoodsMdd.edges, &out->noGoodsMdd.edges); }
+    if (err != CJ_ERROR_OK) { cjIntTuplesFree(&out->noGoodsMdd.nodes); }
+  }
+  if (err != CJ_ERROR_OK) { *out = cjConstraintDefInit(); }
+  return err;
+}
+
+static CjError cjConstraintCopy(const CjConstraint* c, CjConstraint* out) {
+  out->id = c->id;
+  return cjIntTuplesCopy(&c->vars, &out->vars);
+}
+
+static void cjConstraintDefFreeItem(void* item) { cjConstraintDefFree((CjConstraintDef*) item); }
+static void cjConstraintFreeItem(void* item) { cjConstraintFree((CjConstraint*) item); }
+
+static CjError cjConstraintDefOwn(void* item) {
+  CjConstraintDef copy;
+  CjError err = cjConstraintDefCopy((const CjConstraintDef*) item, &copy);
+  if (err == CJ_ERROR_OK) { *(CjConstraintDef*) item = copy; }
+  return err;
+}
+
+static CjError cjConstraintOwn(void* item) {
+  CjConstraint copy;
+  CjError err = cjConstraintCopy((const CjConstraint*) item, &copy);
+  if (err == CJ_ERROR_OK) { *(CjConstraint*) item = copy; }
+  return err;
+}
+
+static const CjItemOps cjConstraintDefOps = {sizeof(CjConstraintDef), cjConstraintDefFreeItem, cjConstraintDefOwn};
+static const CjItemOps cjConstraintOps = {sizeof(CjConstraint), cjConstraintFreeItem, cjConstraintOwn};
+
+/** Free or drop the shared parts of csp: vars, constraintDefs and constraints. */
+static void cjCspReleaseShared(CjCsp* csp) {
+  if (cjRefCountRelease(&csp->varsRefs)) {
+    cjIntTuplesFree(&csp->vars);
+    cjIntTuplesFree(&csp->varRuns);
+  }
+  cjSharedArrayRelease(&csp->constraintDefsRefs, (void**) &csp->constraintDefs, csp->constraintDefsSize,
+                       &cjConstraintDefOps);
+  cjSharedArrayRelease(&csp->constraintsRefs, (void**) &csp->constraints, csp->constraintsSize,
+                       &cjConstraintOps);
+}
+
+CjError cjCspClone(CjCsp* csp, CjCsp* out) {
+  if (!csp || !out || csp == out) { return CJ_ERROR_ARG; }
+  *out = cjCspInit();
+
+  CjError err = cjStrCopy(csp->meta.id, &out->meta.id);
+  if (err == CJ_ERROR_OK) { err = cjStrCopy(csp->meta.algo, &out->meta.algo); }
+  if (err == CJ_ERROR_OK) { err = cjStrCopy(csp->meta.paramsJSON, &out->meta.paramsJSON); }
+  if (err == CJ_ERROR_OK && csp->domainsSize > 0) {
+    out->domains = cjDomainArray(csp->domainsSize);
+    if (!out->domains) { err = CJ_ERROR_NOMEM; }
+    for (int iDom = 0; err == CJ_ERROR_OK && iDom < csp->domainsSize; ++iDom) {
+      err = cjDomainCopy(&csp->domains[iDom], &out->domains[iDom]);
+      out->domainsSize = iDom + 1;
+    }
+  }
+  if (err == CJ_ERROR_OK) { err = cjRefCountAcquire(&csp->varsRefs, NULL, 0, NULL); }
+  if (err == CJ_ERROR_OK) {
+    out->vars = csp->vars;
+    out->varRuns = csp->varRuns;
+    out->varsRefs = csp->varsRefs;
+    err = cjRefCountAcquire(&csp->constraintDefsRefs, csp->constraintDefs, csp->constraintDefsSize,
+                            &cjConstraintDefOps);
+  }
+  if (err == CJ_ERROR_OK) {
+    out->constraintDefsSize = csp->constraintDefsSize;
+    out->constraintDefs = csp->constraintDefs;
+    out->constraintDefsRefs = csp->constraintDefsRefs;
+    err = cjRefCountAcquire(&csp->constraintsRefs, csp->constraints, csp->constraintsSize, &cjConstraintOps);
+  }
+  if (err == CJ_ERROR_OK) {
+    out->constraintsSize = csp->constraintsSize;
+    out->constraints = csp->constraints;
+    out->constraintsRefs = csp->constraintsRefs;
+  }
+  if (err != CJ_ERROR_OK) {
+    cjCspFree(out);
+    return err;
+  }
+  out->validated = csp->validated;
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspUnshareVars(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  if (!csp->varsRefs) { return CJ_ERROR_OK; }
+  if (atomic_load(&csp->varsRefs->refs) > 1) {
+    CjIntTuples vars = cjIntTuplesInit();
+    CjIntTuples varRuns = cjIntTuplesInit();
+    CjError err = cjIntTuplesCopy(&csp->vars, &vars);
+    if (err == CJ_ERROR_OK) { err = cjIntTuplesCopy(&csp->varRuns, &varRuns); }
+    if (err != CJ_ERROR_OK) {
+      cjIntTuplesFree(&vars);
+      return err;
+    }
+    // The other holders may have dropped theirs while copying.
+    if (cjRefCountRelease(&csp->varsRefs)) {
+      cjIntTuplesFree(&csp->vars);
+      cjIntTuplesFree(&csp->varRuns);
+    }
+    csp->vars = vars;
+    csp->varRuns = varRuns;
+    return CJ_ERROR_OK;
+  }
+  cjRefCountRelease(&csp->varsRefs);
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspUnshareConstraintDefs(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  return cjSharedArrayUnshare(&csp->constraintDefsRefs, (void**) &csp->constraintDefs, csp->constraintDefsSize,
+                              &cjConstraintDefOps);
+}
+
+CjError cjCspUnshareConstraints(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  return cjSharedArrayUnshare(&csp->constraintsRefs, (void**) &csp->constraints, csp->constraintsSize,
+                              &cjConstraintOps);
+}
+
+CjError cjCspUnshareConstraintDef(CjCsp* csp, int iDef) {
+  if (!csp || iDef < 0 || iDef >= csp->constraintDefsSize) { return CJ_ERROR_ARG; }
+  return cjSharedArrayUnshareItem(&csp->constraintDefsRefs, (void**) &csp->constraintDefs,
+                                  csp->constraintDefsSize, iDef, &cjConstraintDefOps);
+}
+
+CjError cjCspUnshareConstraint(CjCsp* csp, int iC) {
+  if (!csp || iC < 0 || iC >= csp->constraintsSize) { return CJ_ERROR_ARG; }
+  return cjSharedArrayUnshareItem(&csp->constraintsRefs, (void**) &csp->constraints,
+                                  csp->constraintsSize, iC, &cjConstraintOps);
+}
+
+/** cjCspUnshareVars(), cjCspUnshareConstraintDefs() and cjCspUnshareConstraints(). */
+static CjError cjCspUnshare(CjCsp* csp) {
+  CjError err = cjCspUnshareVars(csp);
+  if (err == CJ_ERROR_OK) { err = cjCspUnshareConstraintDefs(csp); }
+  if (err != CJ_ERROR_OK) { return err; }
+  return cjCspUnshareConstraints(csp);
+}
+
+int cjCspVarsSize(const CjCsp* csp) {
+  if (csp->varRuns.size > 0) {
+    return cjIntTuplesGet(&csp->varRuns, 2 * (size_t) csp->varRuns.size - 1);
+  }
+  return csp->vars.size;
+}
+
+int cjCspVarDomain(const CjCsp* csp, int iVar) {
+  if (csp->varRuns.size == 0) {
+    return cjIntTuplesGet(&csp->vars, iVar);
+  }
+  // Find the first run that ends after iVar.
+  int lo = 0;
+  int hi = csp->varRuns.size - 1;
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    if (cjIntTuplesGet(&csp->varRuns, 2 * (size_t) mid + 1) <= iVar) { lo = mid + 1; }
+    else                                                             { hi = mid; }
+  }
+  return cjIntTuplesGet(&csp->varRuns, 2 * (size_t) lo);
+}
+
+CjError cjCspVarsCompress(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  if (csp->vars.size == 0) { return CJ_ERROR_OK; }
+  if (csp->varRuns.size > 0) { return CJ_ERROR_VALIDATION_VAR_RUNS; }
+  CjError err = cjCspUnshareVars(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  int runsSize = 1;
+  for (int iVar = 1; iVar < csp->vars.size; ++iVar) {
+    if (cjIntTuplesGet(&csp->vars, iVar) != cjIntTuplesGet(&csp->vars, iVar - 1)) { ++runsSize; }
+  }
+  CjIntTuples runs = cjIntTuplesInit();
+  err = cjIntTuplesAlloc(runsSize, 2, &runs);
+  if (err != CJ_ERROR_OK) { return err; }
+  int iRun = 0;
+  for (int iVar = 0; iVar < csp->vars.size; ++iVar) {
+    const int domain = cjIntTuplesGet(&csp->vars, iVar);
+    if (iVar > 0 && domain == runs.data[2*(iRun-1)]) {
+      runs.data[2*(iRun-1) + 1] = iVar + 1;
+    }
+    else {
+      runs.data[2*iRun] = domain;
+      runs.data[2*iRun + 1] = iVar + 1;
+      ++iRun;
+    }
+  }
+
+  cjIntTuplesFree(&csp->vars);
+  csp->vars.arity = -1;
+  csp->varRuns = runs;
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspVarsExpand(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  if (csp->varRuns.size == 0) { return CJ_ERROR_OK; }
+  if (csp->vars.size > 0) { return CJ_ERROR_VALIDATION_VAR_RUNS; }
+  CjError err = cjCspUnshareVars(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  CjIntTuples vars = cjIntTuplesInit();
+  err = cjIntTuplesAlloc(cjCspVarsSize(csp), -1, &vars);
+  if (err != CJ_ERROR_OK) { return err; }
+  int start = 0;
+  for (int iRun = 0; iRun < csp->varRuns.size; ++iRun) {
+    const int domain = cjIntTuplesGet(&csp->varRuns, 2 * (size_t) iRun);
+    const int end = cjIntTuplesGet(&csp->varRuns, 2 * (size_t) iRun + 1);
+    for (int iVar = start; iVar < end; ++iVar) { vars.data[iVar] = domain; }
+    start = end;
+  }
+
+  cjIntTuplesFree(&csp->varRuns);
+  csp->vars = vars;
+  return CJ_ERROR_OK;
+}
+
+/** Apply fn to every table of csp. */
+static CjError cjCspRewidth(CjCsp* csp, CjError (*fn)(CjIntTuples*)) {
+  CjError err = cjCspUnshare(csp);
+  if (err == CJ_ERROR_OK) { err = fn(&csp->vars); }
+  if (err == CJ_ERROR_OK) { err = fn(&csp->varRuns); }
+  for (int iDom = 0; err == CJ_ERROR_OK && iDom < csp->domainsSize; ++iDom) {
+    if (csp->domains[iDom].type == CJ_DOMAIN_VALUES) {
+      err = fn(&csp->domains[iDom].values);
+    }
+  }
+  for (int iCDef = 0; err == CJ_ERROR_OK && iCDef < csp->constraintDefsSize; ++iCDef) {
+    CjConstraintDef* def = &csp->constraintDefs[iCDef];
+    CjIntTuples* table = cjConstraintDefTable(def);
+    if (table) { err = fn(table); }
+    if (def->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+      err = fn(&def->noGoodsMdd.nodes);
+      if (err == CJ_ERROR_OK) { err = fn(&def->noGoodsMdd.edges); }
+    }
+  }
+  for (int iC = 0; err == CJ_ERROR_OK && iC < csp->constraintsSize; ++iC) {
+    err = fn(&csp->constraints[iC].vars);
+  }
+  return err;
+}
+
+CjError cjCspNarrow(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  return cjCspRewidth(csp, cjIntTuplesNarrow);
+}
+
+CjError cjCspWiden(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  return cjCspRewidth(csp, cjIntTuplesWiden);
+}
+
+CjError cjCspValidateDomains(const CjCsp* csp) {
+  if (csp->domainsSize < 0) { return CJ_ERROR_VALIDATION_DOMAINS_SIZE; }
+  for (int iDom = 0; iDom < csp->domainsSize; ++iDom) {
+    if (csp->domains[iDom].type <= CJ_DOMAIN_UNDEF) { return CJ_ERROR_VALIDATION_DOMAINS_TYPE; }
+    if (csp->domains[iDom].type >= CJ_DOMAIN_SIZE) { return CJ_ERROR_VALIDATION_DOMAINS_TYPE; }
+    if (csp->domains[iDom].type == CJ_DOMAIN_RANGE
+        && !cjDomainRangeIsValid(csp->domains[iDom].range.lo, csp->domains[iDom].range.hi))
+    {
+      return CJ_ERROR_VALIDATION_DOMAIN_RANGE;
+    }
+  }
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspValidateVars(const CjCsp* csp) {
+  if (csp->vars.arity != -1) { return CJ_ERROR_VALIDATION_VARS_ARITY; }
+  if (csp->vars.size < 0) { return CJ_ERROR_VALIDATION_VARS_SIZE; }
+  if (csp->vars.size > 0) {
+    int min, max;
+    cjIntTuplesRange(&csp->vars, &min, &max);
+    if (min < 0) { return CJ_ERROR_VALIDATION_VAR_RANGE; }
+    if (csp->domainsSize <= max) { return CJ_ERROR_VALIDATION_VAR_RANGE; }
+  }
+  if (csp->varRuns.size > 0) {
+    if (csp->vars.size > 0) { return CJ_ERROR_VALIDATION_VAR_RUNS; }
+    if (csp->varRuns.arity != 2) { return CJ_ERROR_VALIDATION_VAR_RUNS; }
+    int end = 0;
+    for (int iRun = 0; iRun < csp->varRuns.size; ++iRun) {
+      const int domain = cjIntTuplesGet(&csp->varRuns, 2 * (size_t) iRun);
+      const int runEnd = cjIntTuplesGet(&csp->varRuns, 2 * (size_t) iRun + 1);
+      if (runEnd <= end) { return CJ_ERROR_VALIDATION_VAR_RUNS; }
+      if (domain < 0 || csp->domainsSize <= domain) { return CJ_ERROR_VALIDATION_VAR_RANGE; }
+      end = runEnd;
+    }
+  }
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspValidateConstraintDefs(const CjCsp* csp) {
+  if (csp->constraintDefsSize < 0) { return CJ_ERROR_VALIDATION_CONSTRAINTDEFS_SIZE; }
+  for (int iCDef = 0; iCDef < csp->constraintDefsSize; ++iCDef) {
+    if (csp->constraintDefs[iCDef].type <= CJ_CONSTRAINT_DEF_UNDEF) { return CJ_ERROR_VALIDATION_CONSTRAINTDEF_TYPE; }
+    if (csp->constraintDefs[iCDef].type >= CJ_CONSTRAINT_DEF_SIZE) { return CJ_ERROR_VALIDATION_CONSTRAINTDEF_TYPE; }
+    if (csp->constraintDefs[iCDef].type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+      CjError err = cjMddValidate(&csp->constraintDefs[iCDef].noGoodsMdd);
+      if (err != CJ_ERROR_OK) { return err; }
+    }
+  }
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspValidateConstraint(const CjCsp* csp, const CjConstraint* c) {
+  if (c->id < 0) { return CJ_ERROR_VALIDATION_CONSTRAINT_ID_RANGE; }
+  if (c->id >= csp->constraintDefsSize) { return CJ_ERROR_VALIDATION_CONSTRAINT_ID_RANGE; }
+  if (c->vars.arity != -1) { return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_ARITY; }
+  if (c->vars.size < 0) { return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE; }
+  if (c->vars.size > 0) {
+    int min, max;
+    cjIntTuplesRange(&c->vars, &min, &max);
+    if (min < 0) { return CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE; }
+    if (max >= cjCspVarsSize(csp)) { return CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE; }
+  }
+  const CjConstraintDef* def = &csp->constraintDefs[c->id];
+  const CjIntTuples* table = cjConstraintDefTable(def);
+  if (table) {
+    if (c->vars.size != table->arity) {
+      return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE;
+    }
+  }
+  else if (def->type == CJ_CONSTRAINT_DEF_ALL_DIFFERENT) {
+    // Any number of vars.
+  }
+  else if (def->type == CJ_CONSTRAINT_DEF_PREDICATE) {
+    if (c->vars.size != 2) { return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE; }
+  }
+  else if (def->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    if (c->vars.size != def->noGoodsMdd.arity) {
+      return CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE;
+    }
+  }
+  else {
+    return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
+  }
+  return CJ_ERROR_OK;
+}
+
+/** cjCspValidate() of a non-null csp. */
+static CjError cjCspValidateAll(const CjCsp* csp) {
+  CjError err = cjCspValidateDomains(csp);
+  if (err == CJ_ERROR_OK) { err = cjCspValidateVars(csp); }
+  if (err == CJ_ERROR_OK) { err = cjCspValidateConstraintDefs(csp); }
+  if (err != CJ_ERROR_OK) { return err; }
+  if (csp->constraintsSize < 0) { return CJ_ERROR_VALIDATION_CONSTRAINTS_SIZE; }
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    err = cjCspValidateConstraint(csp, &csp->constraints[iC]);
+    if (err != CJ_ERROR_OK) { return err; }
+  }
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspValidate(const CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  CJ_PROBE(validate_entry, 0, csp);
+  CJ_STATS_BEGIN(start);
+  CjError err = cjCspValidateAll(csp);
+  CJ_STATS_END(start, CJ_PHASE_VALIDATE);
+  CJ_PROBE(validate_return, err, csp);
+  return err;
+}
+
+/** cjCspValidate() unless csp->validated says it passes already. */
+static CjError cjCspValidateOnce(const CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  return csp->validated ? CJ_ERROR_OK : cjCspValidate(csp);
+}
+
+int cjErrorIsValidation(CjError err) {
+  switch (err) {
+    case CJ_ERROR_VALIDATION_DOMAINS_SIZE:
+    case CJ_ERROR_VALIDATION_DOMAINS_TYPE:
+    case CJ_ERROR_VALIDATION_VARS_ARITY:
+    case CJ_ERROR_VALIDATION_VARS_SIZE:
+    case CJ_ERROR_VALIDATION_VAR_RANGE:
+    case CJ_ERROR_VALIDATION_CONSTRAINTDEFS_SIZE:
+    case CJ_ERROR_VALIDATION_CONSTRAINTDEF_TYPE:
+    case CJ_ERROR_VALIDATION_CONSTRAINTS_SIZE:
+    case CJ_ERROR_VALIDATION_CONSTRAINT_ID_RANGE:
+    case CJ_ERROR_VALIDATION_CONSTRAINT_VARS_ARITY:
+    case CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE:
+    case CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE:
+    case CJ_ERROR_VALIDATION_VAR_RUNS:
+    case CJ_ERROR_VALIDATION_DOMAIN_RANGE:
+    case CJ_ERROR_VALIDATION_MDD:
+    case CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory usage
+//
+
+/** Add a buffer of bytes (or none if 0) to section. */
+static void cjMemoryAdd(CjMemorySection* section, size_t bytes) {
+  if (bytes == 0) { return; }
+  section->bytes += bytes;
+  section->allocations += 1;
+}
+
+static void cjMemoryAddIntTuples(CjMemorySection* section, const CjIntTuples* ts) {
+  const size_t n = (size_t) ts->size * abs(ts->arity);
+  if (!ts->data || n == 0) { return; }
+  cjMemoryAdd(section, n * ts->width);
+  int width = 1;
+  int min, max;
+  cjIntTuplesRange(ts, &min, &max);
+  if (min < INT8_MIN || max > INT8_MAX) { width = 2; }
+  if (min < INT16_MIN || max > INT16_MAX) { width = sizeof(int); }
+  if (width < ts->width) { section->wasted += n * (ts->width - width); }
+}
+
+static void cjMemoryAddString(CjMemorySection* section, const char* str) {
+  if (str) { cjMemoryAdd(section, strlen(str) + 1); }
+}
+
+static void cjMemorySum(CjMemorySection* total, const CjMemorySection* section) {
+  total->bytes += section->bytes;
+  total->allocations += section->allocations;
+  total->wasted += section->wasted;
+}
+
+static void cjMemoryAddMeta(CjMemorySection* section, const CjMeta* meta) {
+  cjMemoryAddString(section, meta->id);
+  cjMemoryAddString(section, meta->algo);
+  cjMemoryAddString(section, meta->paramsJSON);
+}
+
+static void cjMemoryAddDomain(CjMemorySection* section, const CjDomain* domain) {
+  if (domain->type == CJ_DOMAIN_VALUES) { cjMemoryAddIntTuples(section, &domain->values); }
+}
+
+static void cjMemoryAddConstraintDef(CjMemorySection* section, const CjConstraintDef* def) {
+  const CjIntTuples* table = cjConstraintDefTable(def);
+  if (table) { cjMemoryAddIntTuples(section, table); }
+  if (def->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    cjMemoryAddIntTuples(section, &def->noGoodsMdd.nodes);
+    cjMemoryAddIntTuples(section, &def->noGoodsMdd.edges);
+  }
+}
+
+static void cjMemoryAddTotal(CjMemoryUsage* usage) {
+  cjMemorySum(&usage->total, &usage->meta);
+  cjMemorySum(&usage->total, &usage->domains);
+  cjMemorySum(&usage->total, &usage->vars);
+  cjMemorySum(&usage->total, &usage->constraintDefs);
+  cjMemorySum(&usage->total, &usage->constraints);
+}
+
+CjError cjCspMemoryUsage(const CjCsp* csp, CjMemoryUsage* out) {
+  if (!csp || !out) { return CJ_ERROR_ARG; }
+  memset(out, 0, sizeof(CjMemoryUsage));
+
+  cjMemoryAddMeta(&out->meta, &csp->meta);
+
+  if (csp->domains) { cjMemoryAdd(&out->domains, sizeof(CjDomain) * csp->domainsSize); }
+  for (int iDom = 0; iDom < csp->domainsSize; ++iDom) { cjMemoryAddDomain(&out->domains, &csp->domains[iDom]); }
+
+  cjMemoryAddIntTuples(&out->vars, &csp->vars);
+  cjMemoryAddIntTuples(&out->vars, &csp->varRuns);
+  if (csp->varsRefs) { cjMemoryAdd(&out->vars, sizeof(CjRefCount)); }
+
+  if (csp->constraintDefs) { cjMemoryAdd(&out->constraintDefs, sizeof(CjConstraintDef) * csp->constraintDefsSize); }
+  if (csp->constraintDefsRefs) { cjMemoryAdd(&out->constraintDefs, sizeof(CjRefCount)); }
+  if (csp->constraintDefsRefs && csp->constraintDefsRefs->owned) {
+    cjMemoryAdd(&out->constraintDefs, csp->constraintDefsSize);
+  }
+  for (int iDef = 0; iDef < csp->constraintDefsSize; ++iDef) {
+    cjMemoryAddConstraintDef(&out->constraintDefs, &csp->constraintDefs[iDef]);
+  }
+
+  if (csp->constraints) { cjMemoryAdd(&out->constraints, sizeof(CjConstraint) * csp->constraintsSize); }
+  if (csp->constraintsRefs) { cjMemoryAdd(&out->constraints, sizeof(CjRefCount)); }
+  if (csp->constraintsRefs && csp->constraintsRefs->owned) { cjMemoryAdd(&out->constraints, csp->constraintsSize); }
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    cjMemoryAddIntTuples(&out->constraints, &csp->constraints[iC].vars);
+  }
+
+  cjMemoryAddTotal(out);
+  return CJ_ERROR_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parallel for
+//
+
+/** A task run by cjParallelFor(). */
+typedef CjError (*CjTaskFn)(void* ctx, int iTask);
+
+typedef struct CjParallelFor {
+  CjTaskFn fn;
+  void* ctx;
+  /** The allocator of the calling thread, used by the workers too. */
+  CjAllocator allocator;
+  int tasksSize;
+  atomic_int next;
+  atomic_int err;
+} CjParallelFor;
+
+static void* cjParallelForWorker(void* arg) {
+  CjParallelFor* p = (CjParallelFor*) arg;
+  for (;;) {
+    const int iTask = atomic_fetch_add(&p->next, 1);
+    if (iTask >= p->tasksSize || atomic_load(&p->err) != CJ_ERROR_OK) { break; }
+    CjError err = p->fn(p->ctx, iTask);
+    if (err != CJ_ERROR_OK) {
+      int ok = CJ_ERROR_OK;
+      atomic_compare_exchange_strong(&p->err, &ok, err);
+    }
+  }
+  return NULL;
+}
+
+#ifdef CJ_THREADS
+/** cjParallelForWorker() of a started thread. */
+static void* cjParallelForThread(void* arg) {
+  cjSetThreadAllocator(&((CjParallelFor*) arg)->allocator);
+  return cjParallelForWorker(arg);
+}
+#endif
+
+/** @return the number of threads to use when the caller asks for numThreads. */
+static int cjThreadCount(int numThreads) {
+#ifdef CJ_THREADS
+  if (numThreads > 0) { return numThreads; }
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 0 ? (int) cpus : 1;
+#else
+  (void) numThreads;
+  return 1;
+#endif
+}
+
+/**
+ * Run fn(ctx, i) for i in [0, tasksSize) on numThreads threads (including the
+ * calling thread). Tasks are handed out in order so put the largest first.
+ * @return the first error returned by a task.
+ */
+static CjError cjParallelFor(int numThreads, int tasksSize, CjTaskFn fn, void* ctx) {
+  CjParallelFor p;
+  p.fn = fn;
+  p.ctx = ctx;
+  p.allocator = cjGetAllocator();
+  p.tasksSize = tasksSize;
+  atomic_init(&p.next, 0);
+  atomic_init(&p.err, CJ_ERROR_OK);
+
+#ifdef CJ_THREADS
+  if (numThreads > tasksSize) { numThreads = tasksSize; }
+  pthread_t* threads = NULL;
+  int threadsSize = 0;
+  if (numThreads > 1) {
+    threads = (pthread_t*) cjMalloc(sizeof(pthread_t) * (numThreads - 1));
+    if (!threads) { return CJ_ERROR_NOMEM; }
+    for (; threadsSize < numThreads - 1; ++threadsSize) {
+      if (pthread_create(&threads[threadsSize], NULL, cjParallelForThread, &p) != 0) { break; }
+    }
+  }
+  cjParallelForWorker(&p);
+  for (int i = 0; i < threadsSize; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  cjFree(threads);
+#else
+  (void) numThreads;
+  cjParallelForWorker(&p);
+#endif
+  return (CjError) atomic_load(&p.err);
+}
+
+/** A range of a table sorted, or two sorted runs merged, by cjCspNormalizeParallel(). */
+typedef struct CjSortTask {
+  /** Points to the first value of the range. */
+  char* data;
+  /** Bytes per value (see CjIntTuples.width). */
+  int width;
+  int arity;
+  /** Merge tasks merge runs [0, mid) and [mid, size). Sort tasks have mid = 0. */
+  int mid;
+  int size;
+} CjSortTask;
+
+static int compareSortTasksBySizeDesc(const void* xPtr, const void* yPtr) {
+  const CjSortTask* x = (const CjSortTask*) xPtr;
+  const CjSortTask* y = (const CjSortTask*) yPtr;
+  const size_t xWork = (size_t) x->size * x->arity * x->width;
+  const size_t yWork = (size_t) y->size * y->arity * y->width;
+  return xWork < yWork ? 1 : (xWork > yWork ? -1 : 0);
+}
+
+static CjError cjSortTaskRun(void* ctx, int iTask) {
+  CjSortTask* task = &((CjSortTask*) ctx)[iTask];
+  if (task->mid == 0) {
+    return cjSortTuples(task->data, task->width, task->size, task->arity);
+  }
+  return cjMergeTuples(task->data, task->width, task->mid, task->size, task->arity);
+}
+
+/** Tables are not split into chunks of less work (in ints) than this. */
+#define CJ_NORMALIZE_MIN_CHUNK (1 << 16)
+
+CjError cjCspNormalize(CjCsp* csp) {
+  return cjCspNormalizeParallel(csp, 1);
+}
+
+/** @return 1 if the tuples of a 2D table are in lexicographic order. */
+static int cjIntTuplesIsSorted(const CjIntTuples* ts) {
+  const size_t arity = (size_t) ts->arity;
+  for (size_t iTuple = 1; iTuple < (size_t) ts->size; ++iTuple) {
+    for (size_t iVal = 0; iVal < arity; ++iVal) {
+      const int prev = cjIntTuplesGet(ts, (iTuple - 1) * arity + iVal);
+      const int cur = cjIntTuplesGet(ts, iTuple * arity + iVal);
+      if (prev < cur) { break; }
+      if (prev > cur) { return 0; }
+    }
+  }
+  return 1;
+}
+
+/** cjCspNormalizeParallel() of a non-null csp. */
+static CjError cjCspNormalizeTables(CjCsp* csp, int numThreads) {
+  numThreads = cjThreadCount(numThreads);
+
+  // Collect every table as (data, size, arity) before sorting anything.
+  const int tablesSize = csp->domainsSize + csp->constraintDefsSize;
+  if (tablesSize == 0) { return CJ_ERROR_OK; }
+  CjSortTask* tables = (CjSortTask*) cjMalloc(sizeof(CjSortTask) * tablesSize);
+  if (!tables) { return CJ_ERROR_NOMEM; }
+  size_t totalWork = 0;
+  for (int iDom = 0; iDom < csp->domainsSize; ++iDom) {
+    if (csp->domains[iDom].type == CJ_DOMAIN_RANGE) {
+      // Ranges are already in normal form: sort nothing.
+      CjSortTask table = {NULL, sizeof(int), 1, 0, 0};
+      tables[iDom] = table;
+      continue;
+    }
+    if (csp->domains[iDom].type != CJ_DOMAIN_VALUES) {
+      cjFree(tables);
+      return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
+    }
+    const CjIntTuples* values = &csp->domains[iDom].values;
+    CjSortTask table = {(char*) values->data, values->width, 1, 0, values->size};
+    tables[iDom] = table;
+    totalWork += values->size;
+  }
+  for (int iCDef = 0; iCDef < csp->constraintDefsSize; ++iCDef) {
+    // MDDs are built sorted.
+    if (csp->constraintDefs[iCDef].type == CJ_CONSTRAINT_DEF_ALL_DIFFERENT
+        || csp->constraintDefs[iCDef].type == CJ_CONSTRAINT_DEF_PREDICATE
+        || csp->constraintDefs[iCDef].type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD)
+    {
+      CjSortTask table = {NULL, sizeof(int), 1, 0, 0};
+      tables[csp->domainsSize + iCDef] = table;
+      continue;
+    }
+    const CjIntTuples* tuples = cjConstraintDefTable(&csp->constraintDefs[iCDef]);
+    if (!tuples) {
+      cjFree(tables);
+      return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
+    }
+    if (tuples->arity < 0) {
+      cjFree(tables);
+      return CJ_ERROR_NOGOODS_ARRAY_DIFFERENT_ARITIES;
+    }
+    // Sorted tables are left alone, and so stay shared with clones. The
+    // others are unshared before they are written.
+    if (cjIntTuplesIsSorted(tuples)) {
+      CjSortTask table = {NULL, sizeof(int), 1, 0, 0};
+      tables[csp->domainsSize + iCDef] = table;
+      continue;
+    }
+    CjError err = cjCspUnshareConstraintDef(csp, iCDef);
+    if (err != CJ_ERROR_OK) {
+      cjFree(tables);
+      return err;
+    }
+    tuples = cjConstraintDefTable(&csp->constraintDefs[iCDef]);
+    CjSortTask table = {(char*) tuples->data, tuples->width, tuples->arity, 0, tuples->size};
+    tables[csp->domainsSize + iCDef] = table;
+    totalWork += (size_t) tuples->size * tuples->arity;
+  }
+
+  // Split tables bigger than a thread's fair share into chunks that are
+  // sorted independently and then merged pairwise, so that one huge table
+  // does not leave the other threads idle.
+  size_t chunkWork = totalWork / (2 * (size_t) numThreads);
+  if (chunkWork < CJ_NORMALIZE_MIN_CHUNK) { chunkWork = CJ_NORMALIZE_MIN_CHUNK; }
+  int* chunkSizes = (int*) cjMalloc(sizeof(int) * tablesSize);
+  if (!chunkSizes) { cjFree(tables); return CJ_ERROR_NOMEM; }
+  int tasksSize = 0;
+  int maxChunks = 1;
+  for (int iTable = 0; iTable < tablesSize; ++iTable) {
+    const CjSortTask* table = &tables[iTable];
+    chunkSizes[iTable] = table->size;
+    if (numThreads > 1 && table->arity > 0 && (size_t) table->size * table->arity > chunkWork) {
+      chunkSizes[iTable] = (int) (chunkWork / table->arity);
+      if (chunkSizes[iTable] < 1) { chunkSizes[iTable] = 1; }
+    }
+    const int chunks = chunkSizes[iTable] > 0
+      ? (table->size + chunkSizes[iTable] - 1) / chunkSizes[iTable] : 1;
+    if (chunks > maxChunks) { maxChunks = chunks; }
+    tasksSize += chunks;
+  }
+
+  CjSortTask* tasks = (CjSortTask*) cjMalloc(sizeof(CjSortTask) * tasksSize);
+  if (!tasks) { cjFree(chunkSizes); cjFree(tables); return CJ_ERROR_NOMEM; }
+  tasksSize = 0;
+  for (int iTable = 0; iTable < tablesSize; ++iTable) {
+    const CjSortTask* table = &tables[iTable];
+    int start = 0;
+    do {
+      const int size = table->size - start < chunkSizes[iTable] ? table->size - start : chunkSizes[iTable];
+      CjSortTask task = {
+        table->data + (size_t) start * table->arity * table->width,
+        table->width, table->arity, 0, size};
+      tasks[tasksSize++] = task;
+      start += size;
+    } while (start < table->size);
+  }
+  qsort(tasks, tasksSize, sizeof(CjSortTask), compareSortTasksBySizeDesc);
+  CjError err = cjParallelFor(numThreads, tasksSize, cjSortTaskRun, tasks);
+
+  // Merge sorted chunks in rounds of doubling run length.
+  for (int runChunks = 1; err == CJ_ERROR_OK && runChunks < maxChunks; runChunks *= 2) {
+    tasksSize = 0;
+    for (int iTable = 0; iTable < tablesSize; ++iTable) {
+      const CjSortTask* table = &tables[iTable];
+      const size_t run = (size_t) chunkSizes[iTable] * runChunks;
+      for (size_t start = 0; start + run < (size_t) table->size; start += 2 * run) {
+        const size_t end = start + 2 * run < (size_t) table->size ? start + 2 * run : (size_t) table->size;
+        CjSortTask task = {
+          table->data + start * table->arity * table->width,
+          table->width, table->arity, (int) run, (int) (end - start)};
+        tasks[tasksSize++] = task;
+      }
+    }
+    qsort(tasks, tasksSize, sizeof(CjSortTask), compareSortTasksBySizeDesc);
+    err = cjParallelFor(numThreads, tasksSize, cjSortTaskRun, tasks);
+  }
+
+  cjFree(tasks);
+  cjFree(chunkSizes);
+  cjFree(tables);
+  return err;
+}
+
+CjError cjCspNormalizeParallel(CjCsp* csp, int numThreads) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  CJ_PROBE(normalize_entry, numThreads, csp);
+  CJ_STATS_BEGIN(start);
+  CjError err = cjCspNormalizeTables(csp, numThreads);
+  CJ_STATS_END(start, CJ_PHASE_NORMALIZE);
+  CJ_PROBE(normalize_return, err, csp);
+  return err;
+}
+
+/** Return a hash of the type and table of a constraintDef. */
+static uint64_t cjConstraintDefHash(const CjConstraintDef* def) {
+  uint64_t h = 14695981039346656037ULL;
+  h = (h ^ (uint64_t) def->type) * 1099511628211ULL;
+  const CjIntTuples* ts = cjConstraintDefTable(def);
+  if (ts) {
+    h = (h ^ (uint64_t) ts->arity) * 1099511628211ULL;
+    h = (h ^ (uint64_t) ts->size) * 1099511628211ULL;
+    for (int i = 0; i < ts->size * abs(ts->arity); ++i) {
+      h = (h ^ (uint32_t) cjIntTuplesGet(ts, i)) * 1099511628211ULL;
+    }
+  }
+  else if (def->type == CJ_CONSTRAINT_DEF_PREDICATE) {
+    h = (h ^ (uint64_t) def->predicate.op) * 1099511628211ULL;
+    h = (h ^ (uint32_t) def->predicate.k) * 1099511628211ULL;
+  }
+  else if (def->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    const CjMdd* mdd = &def->noGoodsMdd;
+    h = (h ^ (uint64_t) mdd->arity) * 1099511628211ULL;
+    h = (h ^ (uint64_t) mdd->nodes.size) * 1099511628211ULL;
+    for (size_t i = 0; i < 2 * (size_t) mdd->edges.size; ++i) {
+      h = (h ^ (uint32_t) cjIntTuplesGet(&mdd->edges, i)) * 1099511628211ULL;
+    }
+  }
+  return h;
+}
+
+/** Return -1, 0 or 1 ordering constraintDefs by type, then table. */
+static int cjConstraintDefCompare(const CjConstraintDef* x, const CjConstraintDef* y) {
+  if (x->type != y->type) { return x->type < y->type ? -1 : 1; }
+  const CjIntTuples* xs = cjConstraintDefTable(x);
+  const CjIntTuples* ys = cjConstraintDefTable(y);
+  if (xs) {
+    if (xs->arity != ys->arity) { return xs->arity < ys->arity ? -1 : 1; }
+    if (xs->size != ys->size) { return xs->size < ys->size ? -1 : 1; }
+    return cjIntTuplesCompare(xs, ys, (size_t) xs->size * abs(xs->arity));
+  }
+  if (x->type == CJ_CONSTRAINT_DEF_PREDICATE) {
+    if (x->predicate.op != y->predicate.op) { return x->predicate.op < y->predicate.op ? -1 : 1; }
+    if (x->predicate.k != y->predicate.k) { return x->predicate.k < y->predicate.k ? -1 : 1; }
+  }
+  if (x->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    const CjMdd* xm = &x->noGoodsMdd;
+    const CjMdd* ym = &y->noGoodsMdd;
+    if (xm->arity != ym->arity) { return xm->arity < ym->arity ? -1 : 1; }
+    if (xm->nodes.size != ym->nodes.size) { return xm->nodes.size < ym->nodes.size ? -1 : 1; }
+    if (xm->edges.size != ym->edges.size) { return xm->edges.size < ym->edges.size ? -1 : 1; }
+    const int cmp = cjIntTuplesCompare(&xm->nodes, &ym->nodes, xm->nodes.size);
+    if (cmp != 0) { return cmp; }
+    return cjIntTuplesCompare(&xm->edges, &ym->edges, 2 * (size_t) xm->edges.size);
+  }
+  return 0;
+}
+
+/** Return true if both constraintDefs have the same type and table. */
+static bool cjConstraintDefEqual(const CjConstraintDef* x, const CjConstraintDef* y) {
+  return cjConstraintDefCompare(x, y) == 0;
+}
+
+/**
+ * Init & allocate out as the transpose of the binary no-goods, goods, MDD or
+ * predicate def in, sorted like cjCspNormalize() would. Free out with
+ * cjConstraintDefFree().
+ */
+static CjError cjConstraintDefTranspose(const CjConstraintDef* in, CjConstraintDef* out) {
+  if (in->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    // Transpose the tuples and compress them again.
+    if (in->noGoodsMdd.arity != 2) { return CJ_ERROR_ARG; }
+    CjConstraintDef expanded = cjConstraintDefInit();
+    expanded.type = CJ_CONSTRAINT_DEF_NO_GOODS;
+    CjError err = cjMddExpand(&in->noGoodsMdd, &expanded.noGoods);
+    if (err != CJ_ERROR_OK) { return err; }
+    err = cjConstraintDefTranspose(&expanded, out);
+    cjConstraintDefFree(&expanded);
+    if (err == CJ_ERROR_OK) {
+      err = cjConstraintDefCompressMdd(out);
+      if (err != CJ_ERROR_OK) { cjConstraintDefFree(out); }
+    }
+    return err;
+  }
+  if (in->type == CJ_CONSTRAINT_DEF_PREDICATE) {
+    CjPredicateOp op = in->predicate.op;
+    switch (op) {
+      case CJ_PREDICATE_LT: op = CJ_PREDICATE_GT; break;
+      case CJ_PREDICATE_LE: op = CJ_PREDICATE_GE; break;
+      case CJ_PREDICATE_GT: op = CJ_PREDICATE_LT; break;
+      case CJ_PREDICATE_GE: op = CJ_PREDICATE_LE; break;
+      default: break;
+    }
+    return cjConstraintDefPredicateInit(op, in->predicate.k, out);
+  }
+  const CjIntTuples* inTable = cjConstraintDefTable(in);
+  if (!inTable || inTable->arity != 2) {
+    return CJ_ERROR_ARG;
+  }
+  CjError err = in->type == CJ_CONSTRAINT_DEF_GOODS
+    ? cjConstraintDefGoodAlloc(inTable->size, 2, out)
+    : cjConstraintDefNoGoodAlloc(inTable->size, 2, out);
+  if (err != CJ_ERROR_OK) { return err; }
+  CjIntTuples* outTable = cjConstraintDefTable(out);
+  for (int i = 0; i < inTable->size; ++i) {
+    outTable->data[2*i + 0] = cjIntTuplesGet(inTable, 2*i + 1);
+    outTable->data[2*i + 1] = cjIntTuplesGet(inTable, 2*i + 0);
+  }
+  err = cjSortTuples(outTable->data, outTable->width, outTable->size, 2);
+  if (err == CJ_ERROR_OK && inTable->width != outTable->width) {
+    err = cjIntTuplesNarrow(outTable);
+  }
+  if (err != CJ_ERROR_OK) { cjConstraintDefFree(out); }
+  return err;
+}
+
+/**
+ * Find a def equal to def among the defs already inserted in table.
+ * @return the index into defs or -1 if not found.
+ */
+static int cjDefTableFind(
+  const int* table, int tableSize, const uint64_t* hashes,
+  const CjConstraintDef* defs, uint64_t h, const CjConstraintDef* def)
+{
+  for (int slot = h & (tableSize - 1); table[slot] >= 0; slot = (slot + 1) & (tableSize - 1)) {
+    if (hashes[table[slot]] == h && cjConstraintDefEqual(&defs[table[slot]], def)) {
+      return table[slot];
+    }
+  }
+  return -1;
+}
+
+/** Values of the merged array in cjCspDedupConstraintDefs(). */
+enum { CJ_DEDUP_KEPT = 0, CJ_DEDUP_MERGED = 1, CJ_DEDUP_MERGED_TRANSPOSED = 2 };
+
+CjError cjCspDedupConstraintDefs(CjCsp* csp, int matchTransposed) {
+  if (!csp) { return CJ_ERROR_ARG; }
+
+  CjError err = cjCspUnshare(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+  err = cjCspNormalize(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  const int n = csp->constraintDefsSize;
+  if (n == 0) { return CJ_ERROR_OK; }
+
+  int tableSize = 1;
+  while (tableSize < 2 * n) { tableSize *= 2; }
+
+  int* remap = (int*) cjMalloc(sizeof(int) * n);
+  char* merged = (char*) cjMalloc(n);
+  uint64_t* hashes = (uint64_t*) cjMalloc(sizeof(uint64_t) * n);
+  int* table = (int*) cjMalloc(sizeof(int) * tableSize);
+  if (!remap || !merged || !hashes || !table) {
+    err = CJ_ERROR_NOMEM;
+    goto cleanup;
+  }
+  for (int slot = 0; slot < tableSize; ++slot) { table[slot] = -1; }
+
+  // Decide which defs survive without modifying the csp yet.
+  int kept = 0;
+  for (int iDef = 0; iDef < n; ++iDef) {
+    const CjConstraintDef* def = &csp->constraintDefs[iDef];
+    hashes[iDef] = cjConstraintDefHash(def);
+    int rep = cjDefTableFind(table, tableSize, hashes, csp->constraintDefs, hashes[iDef], def);
+    merged[iDef] = CJ_DEDUP_MERGED;
+
+    if (rep < 0 && matchTransposed
+        && ((cjConstraintDefTable(def) && cjConstraintDefTable(def)->arity == 2)
+            || (def->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD && def->noGoodsMdd.arity == 2)
+            || def->type == CJ_CONSTRAINT_DEF_PREDICATE))
+    {
+      CjConstraintDef transposed = cjConstraintDefInit();
+      err = cjConstraintDefTranspose(def, &transposed);
+      if (err != CJ_ERROR_OK) { goto cleanup; }
+      rep = cjDefTableFind(
+        table, tableSize, hashes, csp->constraintDefs,
+        cjConstraintDefHash(&transposed), &transposed);
+      cjConstraintDefFree(&transposed);
+      merged[iDef] = CJ_DEDUP_MERGED_TRANSPOSED;
+    }
+
+    if (rep >= 0) {
+      remap[iDef] = remap[rep];
+    }
+    else {
+      merged[iDef] = CJ_DEDUP_KEPT;
+      remap[iDef] = kept++;
+      int slot = hashes[iDef] & (tableSize - 1);
+      while (table[slot] >= 0) { slot = (slot + 1) & (tableSize - 1); }
+      table[slot] = iDef;
+    }
+  }
+
+  // Check the constraints can be remapped before modifying anything.
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    const CjConstraint* c = &csp->constraints[iC];
+    if (c->id < 0 || c->id >= n) {
+      err = CJ_ERROR_VALIDATION_CONSTRAINT_ID_RANGE;
+      goto cleanup;
+    }
+    if (merged[c->id] == CJ_DEDUP_MERGED_TRANSPOSED && c->vars.size != 2) {
+      err = CJ_ERROR_VALIDATION_CONSTRAINT_VARS_SIZE;
+      goto cleanup;
+    }
+  }
+
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    CjConstraint* c = &csp->constraints[iC];
+    if (merged[c->id] == CJ_DEDUP_MERGED_TRANSPOSED) {
+      cjIntTuplesSwap(&c->vars, 0, 1);
+    }
+    c->id = remap[c->id];
+  }
+
+  // Compact the kept defs to the front. remap is increasing over kept defs
+  // so each destination slot has already been moved out or freed.
+  for (int iDef = 0; iDef < n; ++iDef) {
+    if (merged[iDef] == CJ_DEDUP_KEPT) {
+      csp->constraintDefs[remap[iDef]] = csp->constraintDefs[iDef];
+    }
+    else {
+      cjConstraintDefFree(&csp->constraintDefs[iDef]);
+    }
+  }
+  csp->constraintDefsSize = kept;
+  CjConstraintDef* shrunk = (CjConstraintDef*) cjRealloc(
+    csp->constraintDefs, sizeof(CjConstraintDef) * kept);
+  if (shrunk) { csp->constraintDefs = shrunk; }
+
+cleanup:
+  cjFree(remap);
+  cjFree(merged);
+  cjFree(hashes);
+  cjFree(table);
+  return err;
+}
+
+/** A constraint and the rank of its def used to sort constraints in cjCspCanonicalize(). */
+typedef struct CjCanonicalConstraint {
+  CjConstraint constraint;
+  int defRank;
+} CjCanonicalConstraint;
+
+static int compareCanonicalConstraints(const void* xPtr, const void* yPtr) {
+  const CjCanonicalConstraint* x = (const CjCanonicalConstraint*) xPtr;
+  const CjCanonicalConstraint* y = (const CjCanonicalConstraint*) yPtr;
+  if (x->constraint.vars.size != y->constraint.vars.size) {
+    return x->constraint.vars.size < y->constraint.vars.size ? -1 : 1;
+  }
+  int cmp = cjIntTuplesCompare(&x->constraint.vars, &y->constraint.vars, x->constraint.vars.size);
+  if (cmp != 0) { return cmp; }
+  return x->defRank < y->defRank ? -1 : (x->defRank > y->defRank ? 1 : 0);
+}
+
+/** A def pointer and its index used to rank defs by content. */
+typedef struct CjDefRef {
+  const CjConstraintDef* def;
+  int index;
+} CjDefRef;
+
+static int compareDefRefs(const void* xPtr, const void* yPtr) {
+  return cjConstraintDefCompare(((const CjDefRef*) xPtr)->def, ((const CjDefRef*) yPtr)->def);
+}
+
+/**
+ * Orient each binary no-goods constraint so that vars[0] <= vars[1],
+ * appending a transposed def for every def used in the flipped direction.
+ * The vars of all-different constraints are sorted since order does not matter.
+ */
+static CjError cjCspOrientBinaryConstraints(CjCsp* csp) {
+  const int n = csp->constraintDefsSize;
+  int flippedSize = 0;
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    CjConstraint* c = &csp->constraints[iC];
+    if (csp->constraintDefs[c->id].type == CJ_CONSTRAINT_DEF_ALL_DIFFERENT) {
+      CjError err = cjSortTuples(c->vars.data, c->vars.width, c->vars.size, 1);
+      if (err != CJ_ERROR_OK) { return err; }
+      continue;
+    }
+    if (c->vars.size == 2 && cjIntTuplesGet(&c->vars, 0) > cjIntTuplesGet(&c->vars, 1)) { ++flippedSize; }
+  }
+  if (flippedSize == 0) { return CJ_ERROR_OK; }
+
+  int* flippedDef = (int*) cjMalloc(sizeof(int) * n);
+  CjConstraintDef* defs = (CjConstraintDef*) cjRealloc(
+    csp->constraintDefs, sizeof(CjConstraintDef) * (n + flippedSize));
+  if (!flippedDef || !defs) {
+    cjFree(flippedDef);
+    if (defs) { csp->constraintDefs = defs; }
+    return CJ_ERROR_NOMEM;
+  }
+  csp->constraintDefs = defs;
+  for (int iDef = 0; iDef < n; ++iDef) { flippedDef[iDef] = -1; }
+
+  CjError err = CJ_ERROR_OK;
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    CjConstraint* c = &csp->constraints[iC];
+    if (csp->constraintDefs[c->id].type == CJ_CONSTRAINT_DEF_ALL_DIFFERENT) { continue; }
+    if (c->vars.size != 2 || cjIntTuplesGet(&c->vars, 0) <= cjIntTuplesGet(&c->vars, 1)) { continue; }
+    if (flippedDef[c->id] < 0) {
+      CjConstraintDef* transposed = &csp->constraintDefs[csp->constraintDefsSize];
+      *transposed = cjConstraintDefInit();
+      err = cjConstraintDefTranspose(&csp->constraintDefs[c->id], transposed);
+      if (err != CJ_ERROR_OK) { break; }
+      flippedDef[c->id] = csp->constraintDefsSize++;
+    }
+    cjIntTuplesSwap(&c->vars, 0, 1);
+    c->id = flippedDef[c->id];
+  }
+
+  cjFree(flippedDef);
+  return err;
+}
+
+CjError cjCspCanonicalize(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+
+  CjError err = cjCspValidateOnce(csp);
+  if (err == CJ_ERROR_OK) { err = cjCspUnshare(csp); }
+  if (err != CJ_ERROR_OK) { return err; }
+  err = cjCspOrientBinaryConstraints(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+  err = cjCspDedupConstraintDefs(csp, 0);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  const int n = csp->constraintDefsSize;
+  const int m = csp->constraintsSize;
+  CjDefRef* refs = (CjDefRef*) cjMalloc(sizeof(CjDefRef) * (n + 1));
+  int* rank = (int*) cjMalloc(sizeof(int) * (n + 1));
+  int* renumber = (int*) cjMalloc(sizeof(int) * (n + 1));
+  CjConstraintDef* defs = (CjConstraintDef*) cjMalloc(sizeof(CjConstraintDef) * (n + 1));
+  CjCanonicalConstraint* sorted = (CjCanonicalConstraint*) cjMalloc(sizeof(CjCanonicalConstraint) * (m + 1));
+  if (!refs || !rank || !renumber || !defs || !sorted) {
+    err = CJ_ERROR_NOMEM;
+    goto cleanup;
+  }
+
+  // Rank defs by content so that constraints on the same vars sort the same
+  // way whatever the input def numbering was.
+  for (int iDef = 0; iDef < n; ++iDef) {
+    refs[iDef].def = &csp->constraintDefs[iDef];
+    refs[iDef].index = iDef;
+  }
+  qsort(refs, n, sizeof(CjDefRef), compareDefRefs);
+  for (int iRank = 0; iRank < n; ++iRank) {
+    rank[refs[iRank].index] = iRank;
+  }
+
+  for (int iC = 0; iC < m; ++iC) {
+    sorted[iC].constraint = csp->constraints[iC];
+    sorted[iC].defRank = rank[csp->constraints[iC].id];
+  }
+  qsort(sorted, m, sizeof(CjCanonicalConstraint), compareCanonicalConstraints);
+
+  // Renumber defs in first-use order and drop the unused ones.
+  int used = 0;
+  for (int iDef = 0; iDef < n; ++iDef) { renumber[iDef] = -1; }
+  for (int iC = 0; iC < m; ++iC) {
+    CjConstraint* c = &sorted[iC].constraint;
+    if (renumber[c->id] < 0) {
+      renumber[c->id] = used;
+      defs[used++] = csp->constraintDefs[c->id];
+    }
+    c->id = renumber[c->id];
+    csp->constraints[iC] = *c;
+  }
+  for (int iDef = 0; iDef < n; ++iDef) {
+    if (renumber[iDef] < 0) { cjConstraintDefFree(&csp->constraintDefs[iDef]); }
+  }
+  cjFree(csp->constraintDefs);
+  csp->constraintDefs = defs;
+  csp->constraintDefsSize = used;
+  defs = NULL;
+
+cleanup:
+  cjFree(refs);
+  cjFree(rank);
+  cjFree(renumber);
+  cjFree(defs);
+  cjFree(sorted);
+  return err;
+}
+
+/** @return the i-th value of a values or range domain. */
+static int cjDomainValueAt(const CjDomain* domain, int i) {
+  if (domain->type == CJ_DOMAIN_RANGE) { return domain->range.lo + i; }
+  return cjIntTuplesGet(&domain->values, i);
+}
+
+/** @return true if value is in the sorted int values. O(log size). */
+static bool cjSortedValuesHas(const CjIntTuples* values, int value) {
+  int lo = 0;
+  int hi = values->size;
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    if (values->data[mid] < value) { lo = mid + 1; }
+    else                           { hi = mid; }
+  }
+  return lo < values->size && values->data[lo] == value;
+}
+
+/**
+ * Replace the table of def by its complement relative to the product of
+ * domains (one per column, each value listed once in increasing order) if
+ * the complement has fewer tuples. def must be normalized.
+ */
+static CjError cjConstraintDefCompactTable(CjConstraintDef* def, const CjIntTuples* domains) {
+  const CjIntTuples* table = cjConstraintDefTable(def);
+  const int arity = table->arity;
+
+  // The complement can only be smaller if the product is less than twice
+  // the table, which also bounds the enumeration below.
+  size_t productSize = 1;
+  for (int iCol = 0; iCol < arity; ++iCol) {
+    productSize *= domains[iCol].size;
+    if (productSize >= 2 * (size_t) table->size) { return CJ_ERROR_OK; }
+  }
+
+  // Count the distinct tuples whose values are all in the domains.
+  size_t inDomainSize = 0;
+  for (int iTuple = 0; iTuple < table->size; ++iTuple) {
+    bool inDomain = true;
+    bool duplicate = iTuple > 0;
+    for (int iCol = 0; iCol < arity; ++iCol) {
+      const size_t i = (size_t) iTuple * arity + iCol;
+      const int value = cjIntTuplesGet(table, i);
+      inDomain = inDomain && cjSortedValuesHas(&domains[iCol], value);
+      duplicate = duplicate && value == cjIntTuplesGet(table, i - arity);
+    }
+    if (inDomain && !duplicate) { ++inDomainSize; }
+  }
+  const size_t complementSize = productSize - inDomainSize;
+  // An empty table has no arity in json, so keep one listing every tuple.
+  if (complementSize == 0 || complementSize >= (size_t) table->size) { return CJ_ERROR_OK; }
+
+  CjConstraintDef complement = cjConstraintDefInit();
+  CjError err = def->type == CJ_CONSTRAINT_DEF_NO_GOODS
+    ? cjConstraintDefGoodAlloc((int) complementSize, arity, &complement)
+    : cjConstraintDefNoGoodAlloc((int) complementSize, arity, &complement);
+  int* digits = (int*) cjCalloc(arity + 1, sizeof(int));
+  if (err != CJ_ERROR_OK || !digits) {
+    cjConstraintDefFree(&complement);
+    cjFree(digits);
+    return err != CJ_ERROR_OK ? err : CJ_ERROR_NOMEM;
+  }
+  CjIntTuples* out = cjConstraintDefTable(&complement);
+
+  // Enumerate the product in lexicographic order next to the sorted table.
+  int iTuple = 0;
+  int iOut = 0;
+  for (size_t iProduct = 0; iProduct < productSize; ++iProduct) {
+    int cmp = -1;
+    while (iTuple < table->size) {
+      cmp = 0;
+      for (int iCol = 0; iCol < arity && cmp == 0; ++iCol) {
+        const int x = cjIntTuplesGet(table, (size_t) iTuple * arity + iCol);
+        const int y = cjIntTuplesGet(&domains[iCol], digits[iCol]);
+        cmp = x < y ? -1 : (x > y ? 1 : 0);
+      }
+      if (cmp >= 0) { break; }
+      ++iTuple;
+    }
+    if (iTuple >= table->size || cmp != 0) {
+      for (int iCol = 0; iCol < arity; ++iCol) {
+        out->data[(size_t) iOut * arity + iCol] = cjIntTuplesGet(&domains[iCol], digits[iCol]);
+      }
+      ++iOut;
+    }
+    for (int iCol = arity - 1; iCol >= 0; --iCol) {
+      if (++digits[iCol] < domains[iCol].size) { break; }
+      digits[iCol] = 0;
+    }
+  }
+  cjFree(digits);
+
+  if (table->width != out->width) { err = cjIntTuplesNarrow(out); }
+  if (err != CJ_ERROR_OK) {
+    cjConstraintDefFree(&complement);
+    return err;
+  }
+  cjConstraintDefFree(def);
+  *def = complement;
+  return CJ_ERROR_OK;
+}
+
+/** Init & allocate out as the sorted distinct values of domain. */
+static CjError cjDomainSortedValues(const CjDomain* domain, CjIntTuples* out) {
+  CjError err = cjIntTuplesAlloc(cjDomainSize(domain), -1, out);
+  if (err != CJ_ERROR_OK) { return err; }
+  for (int i = 0; i < out->size; ++i) { out->data[i] = cjDomainValueAt(domain, i); }
+  err = cjSortTuples(out->data, out->width, out->size, 1);
+  if (err != CJ_ERROR_OK) { cjIntTuplesFree(out); return err; }
+  int size = out->size > 0 ? 1 : 0;
+  for (int i = 1; i < out->size; ++i) {
+    if (out->data[i] != out->data[size - 1]) { out->data[size++] = out->data[i]; }
+  }
+  out->size = size;
+  return CJ_ERROR_OK;
+}
+
+/**
+ * Allocate out with, for each def, the index of the first constraint using
+ * it, -1 if none does, or -2 if constraints use it over different domains.
+ * csp must validate.
+ */
+static CjError cjCspDefFirstUses(const CjCsp* csp, int** out) {
+  const int n = csp->constraintDefsSize;
+  int* firstUse = (int*) cjMalloc(sizeof(int) * (n + 1));
+  if (!firstUse) { return CJ_ERROR_NOMEM; }
+  for (int iDef = 0; iDef < n; ++iDef) { firstUse[iDef] = -1; }
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    const CjConstraint* c = &csp->constraints[iC];
+    if (firstUse[c->id] == -1) { firstUse[c->id] = iC; continue; }
+    if (firstUse[c->id] < 0) { continue; }
+    const CjConstraint* first = &csp->constraints[firstUse[c->id]];
+    if (c->vars.size != first->vars.size) { firstUse[c->id] = -2; continue; }
+    for (int iVar = 0; iVar < c->vars.size; ++iVar) {
+      if (cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, iVar))
+          != cjCspVarDomain(csp, cjIntTuplesGet(&first->vars, iVar))) {
+        firstUse[c->id] = -2;
+        break;
+      }
+    }
+  }
+  *out = firstUse;
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspCompactTables(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  CjError err = cjCspValidateOnce(csp);
+  if (err == CJ_ERROR_OK) { err = cjCspNormalize(csp); }
+  if (err != CJ_ERROR_OK) { return err; }
+
+  const int n = csp->constraintDefsSize;
+  int* firstUse = NULL;
+  err = cjCspDefFirstUses(csp, &firstUse);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  CjIntTuples* domains = NULL;
+  int domainsSize = 0;
+  for (int iDef = 0; iDef < n && err == CJ_ERROR_OK; ++iDef) {
+    if (firstUse[iDef] < 0 || !cjConstraintDefTable(&csp->constraintDefs[iDef])) { continue; }
+    const CjConstraint* c = &csp->constraints[firstUse[iDef]];
+    // Skip before listing the domain values: see cjConstraintDefCompactTable().
+    const size_t maxProductSize = 2 * (size_t) cjConstraintDefTable(&csp->constraintDefs[iDef])->size;
+    size_t productSize = 1;
+    for (int iVar = 0; iVar < c->vars.size && productSize < maxProductSize; ++iVar) {
+      productSize *= cjDomainSize(&csp->domains[cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, iVar))]);
+    }
+    if (productSize >= maxProductSize) { continue; }
+    if (c->vars.size > domainsSize) {
+      cjIntTuplesArrayFree(&domains, domainsSize);
+      domainsSize = c->vars.size;
+      domains = cjIntTuplesArray(domainsSize);
+      if (!domains) { err = CJ_ERROR_NOMEM; break; }
+    }
+    for (int iVar = 0; iVar < c->vars.size && err == CJ_ERROR_OK; ++iVar) {
+      cjIntTuplesFree(&domains[iVar]);
+      err = cjDomainSortedValues(&csp->domains[cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, iVar))], &domains[iVar]);
+    }
+    if (err == CJ_ERROR_OK) { err = cjCspUnshareConstraintDef(csp, iDef); }
+    if (err == CJ_ERROR_OK) { err = cjConstraintDefCompactTable(&csp->constraintDefs[iDef], domains); }
+  }
+
+  cjIntTuplesArrayFree(&domains, domainsSize);
+  cjFree(firstUse);
+  return err;
+}
+
+CjError cjCspCompressMdd(CjCsp* csp, int minSize) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  for (int iDef = 0; iDef < csp->constraintDefsSize; ++iDef) {
+    const CjConstraintDef* def = &csp->constraintDefs[iDef];
+    if (def->type == CJ_CONSTRAINT_DEF_NO_GOODS && def->noGoods.arity >= 1 && def->noGoods.size >= minSize) {
+      CjError err = cjCspUnshareConstraintDef(csp, iDef);
+      if (err == CJ_ERROR_OK) { err = cjConstraintDefCompressMdd(&csp->constraintDefs[iDef]); }
+      if (err != CJ_ERROR_OK) { return err; }
+    }
+  }
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspExpandMdd(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  for (int iDef = 0; iDef < csp->constraintDefsSize; ++iDef) {
+    if (csp->constraintDefs[iDef].type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+      CjError err = cjCspUnshareConstraintDef(csp, iDef);
+      if (err == CJ_ERROR_OK) { err = cjConstraintDefExpandMdd(&csp->constraintDefs[iDef]); }
+      if (err != CJ_ERROR_OK) { return err; }
+    }
+  }
+  return CJ_ERROR_OK;
+}
+
+/** The most no-goods an expanded predicate may have: 2 ints each must fit an int index. */
+#define CJ_EXPAND_PREDICATE_MAX_SIZE (INT_MAX / 2)
+
+/**
+ * Init & allocate out as the no-goods of predicate def between a var of
+ * domain d0 and a var of domain d1.
+ * @return CJ_ERROR_NOMEM if there are more than CJ_EXPAND_PREDICATE_MAX_SIZE.
+ */
+static CjError cjConstraintDefExpandPredicate(
+  const CjConstraintDef* def, const CjDomain* d0, const CjDomain* d1, CjConstraintDef* out)
+{
+  const int size0 = cjDomainSize(d0);
+  const int size1 = cjDomainSize(d1);
+  int64_t size = 0;
+  for (int i = 0; i < size0; ++i) {
+    for (int j = 0; j < size1; ++j) {
+      if (!cjPredicateHolds(def->predicate.op, def->predicate.k,
+                            cjDomainValueAt(d0, i), cjDomainValueAt(d1, j))) { ++size; }
+    }
+    if (size > CJ_EXPAND_PREDICATE_MAX_SIZE) { return CJ_ERROR_NOMEM; }
+  }
+  CjError err = cjConstraintDefNoGoodAlloc((int) size, 2, out);
+  if (err != CJ_ERROR_OK) { return err; }
+  int iTuple = 0;
+  for (int i = 0; i < size0; ++i) {
+    for (int j = 0; j < size1; ++j) {
+      const int x = cjDomainValueAt(d0, i);
+      const int y = cjDomainValueAt(d1, j);
+      if (!cjPredicateHolds(def->predicate.op, def->predicate.k, x, y)) {
+        out->noGoods.data[2*iTuple + 0] = x;
+        out->noGoods.data[2*iTuple + 1] = y;
+        ++iTuple;
+      }
+    }
+  }
+  err = cjSortTuples(out->noGoods.data, out->noGoods.width, (int) size, 2);
+  if (err != CJ_ERROR_OK) { cjConstraintDefFree(out); }
+  return err;
+}
+
+/** A no-goods def generated by cjCspExpandPredicates(). */
+typedef struct CjExpansion {
+  int id;
+  int domain0;
+  int domain1;
+  int expandedId;
+} CjExpansion;
+
+CjError cjCspExpandPredicates(CjCsp* csp) {
+  if (!csp) { return CJ_ERROR_ARG; }
+  CjError err = cjCspValidateOnce(csp);
+  if (err == CJ_ERROR_OK) { err = cjCspUnshare(csp); }
+  if (err != CJ_ERROR_OK) { return err; }
+
+  int predicatesSize = 0;
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    if (csp->constraintDefs[csp->constraints[iC].id].type == CJ_CONSTRAINT_DEF_PREDICATE) { ++predicatesSize; }
+  }
+  if (predicatesSize == 0) { return CJ_ERROR_OK; }
+
+  const int n = csp->constraintDefsSize;
+  CjExpansion* expansions = (CjExpansion*) cjMalloc(sizeof(CjExpansion) * predicatesSize);
+  int* remap = (int*) cjMalloc(sizeof(int) * (n + predicatesSize));
+  CjConstraintDef* defs = (CjConstraintDef*) cjRealloc(
+    csp->constraintDefs, sizeof(CjConstraintDef) * (n + predicatesSize));
+  if (defs) { csp->constraintDefs = defs; }
+  if (!expansions || !remap || !defs) {
+    err = CJ_ERROR_NOMEM;
+    goto cleanup;
+  }
+
+  // Expand each (def, domain0, domain1) combination once. The distinct
+  // domains of a csp are few so a linear search is enough.
+  int expansionsSize = 0;
+  for (int iC = 0; iC < csp->constraintsSize && err == CJ_ERROR_OK; ++iC) {
+    CjConstraint* c = &csp->constraints[iC];
+    if (csp->constraintDefs[c->id].type != CJ_CONSTRAINT_DEF_PREDICATE) { continue; }
+    const int domain0 = cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, 0));
+    const int domain1 = cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, 1));
+    int iExp = 0;
+    while (iExp < expansionsSize
+           && (expansions[iExp].id != c->id || expansions[iExp].domain0 != domain0
+               || expansions[iExp].domain1 != domain1)) { ++iExp; }
+    if (iExp == expansionsSize) {
+      CjConstraintDef* expanded = &csp->constraintDefs[csp->constraintDefsSize];
+      *expanded = cjConstraintDefInit();
+      err = cjConstraintDefExpandPredicate(
+        &csp->constraintDefs[c->id], &csp->domains[domain0], &csp->domains[domain1], expanded);
+      if (err != CJ_ERROR_OK) { break; }
+      // A predicate that always holds has no no-goods, and an empty table
+      // has no arity once printed: drop its constraints instead.
+      CjExpansion expansion = {c->id, domain0, domain1, -1};
+      if (expanded->noGoods.size == 0) { cjConstraintDefFree(expanded); }
+      else { expansion.expandedId = csp->constraintDefsSize++; }
+      expansions[expansionsSize++] = expansion;
+    }
+    c->id = expansions[iExp].expandedId;
+  }
+  if (err != CJ_ERROR_OK) { goto cleanup; }
+
+  int keptConstraints = 0;
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    if (csp->constraints[iC].id < 0) { cjConstraintFree(&csp->constraints[iC]); }
+    else { csp->constraints[keptConstraints++] = csp->constraints[iC]; }
+  }
+  csp->constraintsSize = keptConstraints;
+
+  // Drop the predicate defs: no constraint references them anymore.
+  int kept = 0;
+  for (int iDef = 0; iDef < csp->constraintDefsSize; ++iDef) {
+    if (csp->constraintDefs[iDef].type == CJ_CONSTRAINT_DEF_PREDICATE) {
+      cjConstraintDefFree(&csp->constraintDefs[iDef]);
+      remap[iDef] = -1;
+    }
+    else {
+      remap[iDef] = kept;
+      csp->constraintDefs[kept++] = csp->constraintDefs[iDef];
+    }
+  }
+  csp->constraintDefsSize = kept;
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    csp->constraints[iC].id = remap[csp->constraints[iC].id];
+  }
+
+cleanup:
+  cjFree(expansions);
+  cjFree(remap);
+  return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Table index
+//
+
+/** Tables with fewer tuples than this are scanned by cjCspIsSolved(). */
+#define CJ_TABLE_INDEX_MIN_SIZE 64
+
+/** Finish a 64 bit FNV-1a hash with the murmur3 finalizer. */
+static uint64_t cjHashMix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t cjTupleHash(const int* tuple, int arity) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < arity; ++i) {
+    h = (h ^ (uint32_t) tuple[i]) * 0x100000001b3ULL;
+  }
+  return cjHashMix(h);
+}
+
+/** cjTupleHash() of the iTuple-th tuple of table, whatever its width. */
+static uint64_t cjTableTupleHash(const CjIntTuples* table, int iTuple, int arity) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < arity; ++i) {
+    h = (h ^ (uint32_t) cjIntTuplesGet(table, (size_t) iTuple * arity + i)) * 0x100000001b3ULL;
+  }
+  return cjHashMix(h);
+}
+
+static bool cjTableTupleEquals(const CjIntTuples* table, int iTuple, int arity, const int* tuple) {
+  for (int i = 0; i < arity; ++i) {
+    if (cjIntTuplesGet(table, (size_t) iTuple * arity + i) != tuple[i]) { return false; }
+  }
+  return true;
+}
+
+/** The two Bloom filter bits of hash h: one from its high half, one remixed. */
+static void cjBloomBits(const CjTableIndex* index, uint64_t h, size_t* bit0, size_t* bit1) {
+  const size_t mask = (size_t) index->bloomWords * 64 - 1;
+  *bit0 = (size_t) (h >> 32) & mask;
+  *bit1 = (size_t) ((h * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+}
+
+CjTableIndex cjTableIndexInit() {
+  CjTableIndex x;
+  x.capacity = 0;
+  x.slots = NULL;
+  x.bloomWords = 0;
+  x.bloom = NULL;
+  return x;
+}
+
+CjError cjTableIndexAlloc(const CjIntTuples* table, CjTableIndex* out) {
+  if (!table || !out) { return CJ_ERROR_ARG; }
+  *out = cjTableIndexInit();
+  // At most half the slots are used so that probing stays short.
+  if (table->size > (1 << 29)) { return CJ_ERROR_NOMEM; }
+  int capacity = 16;
+  while (capacity < 2 * table->size) { capacity *= 2; }
+  // 4 bits per slot, 8 to 16 per tuple: a few percent false positives.
+  const int bloomWords = capacity / 16;
+  out->slots = (int*) cjCalloc(capacity, sizeof(int));
+  out->bloom = (uint64_t*) cjCalloc(bloomWords, sizeof(uint64_t));
+  if (!out->slots || !out->bloom) {
+    cjTableIndexFree(out);
+    return CJ_ERROR_NOMEM;
+  }
+  out->capacity = capacity;
+  out->bloomWords = bloomWords;
+
+  const int arity = abs(table->arity);
+  const size_t mask = (size_t) capacity - 1;
+  for (int iTuple = 0; iTuple < table->size; ++iTuple) {
+    const uint64_t h = cjTableTupleHash(table, iTuple, arity);
+    size_t bit0, bit1;
+    cjBloomBits(out, h, &bit0, &bit1);
+    out->bloom[bit0 / 64] |= 1ULL << (bit0 % 64);
+    out->bloom[bit1 / 64] |= 1ULL << (bit1 % 64);
+    size_t iSlot = (size_t) h & mask;
+    while (out->slots[iSlot]) { iSlot = (iSlot + 1) & mask; }
+    out->slots[iSlot] = iTuple + 1;
+  }
+  return CJ_ERROR_OK;
+}
+
+int cjTableIndexFind(const CjTableIndex* index, const CjIntTuples* table, const int* tuple) {
+  if (!index || index->capacity == 0) { return cjTableFind(table, tuple); }
+
+  const int arity = abs(table->arity);
+  const uint64_t h = cjTupleHash(tuple, arity);
+  size_t bit0, bit1;
+  cjBloomBits(index, h, &bit0, &bit1);
+  if (!(index->bloom[bit0 / 64] & (1ULL << (bit0 % 64))) ||
+      !(index->bloom[bit1 / 64] & (1ULL << (bit1 % 64)))) {
+    return -1;
+  }
+  const size_t mask = (size_t) index->capacity - 1;
+  for (size_t iSlot = (size_t) h & mask; index->slots[iSlot]; iSlot = (iSlot + 1) & mask) {
+    const int iTuple = index->slots[iSlot] - 1;
+    if (cjTableTupleEquals(table, iTuple, arity, tuple)) { return iTuple; }
+  }
+  return -1;
+}
+
+void cjTableIndexFree(CjTableIndex* inout) {
+  if (!inout) { return; }
+  cjFree(inout->slots);
+  cjFree(inout->bloom);
+  *inout = cjTableIndexInit();
+}
+
+void cjTableIndexArrayFree(CjTableIndex** inout, int size) {
+  if (!inout) { return; }
+  if (!(*inout)) { return; }
+  for (int i = 0; i < size; ++i) {
+    cjTableIndexFree(&((*inout)[i]));
+  }
+  cjFree(*inout);
+  *inout = NULL;
+}
+
+/**
+ * cjCspTableIndexArrayAlloc() only indexing the tables referenced by at least
+ * minUses constraints. csp must validate.
+ */
+static CjError cjCspTableIndexArrayAllocUsed(const CjCsp* csp, int minSize, int minUses, CjTableIndex** out) {
+  *out = NULL;
+  int* uses = (int*) cjCalloc(csp->constraintDefsSize + 1, sizeof(int));
+  if (!uses) { return CJ_ERROR_NOMEM; }
+  for (int iConstraint = 0; iConstraint < csp->constraintsSize; ++iConstraint) {
+    uses[csp->constraints[iConstraint].id]++;
+  }
+
+  CjError err = CJ_ERROR_OK;
+  CjTableIndex* indexes = (CjTableIndex*) cjMalloc(sizeof(CjTableIndex) * (csp->constraintDefsSize + 1));
+  if (!indexes) {
+    cjFree(uses);
+    return CJ_ERROR_NOMEM;
+  }
+  for (int iDef = 0; iDef < csp->constraintDefsSize; ++iDef) {
+    indexes[iDef] = cjTableIndexInit();
+  }
+  for (int iDef = 0; iDef < csp->constraintDefsSize && err == CJ_ERROR_OK; ++iDef) {
+    const CjIntTuples* table = cjConstraintDefTable(&csp->constraintDefs[iDef]);
+    if (table && table->size >= minSize && uses[iDef] >= minUses) {
+      err = cjTableIndexAlloc(table, &indexes[iDef]);
+    }
+  }
+  cjFree(uses);
+  if (err != CJ_ERROR_OK) {
+    cjTableIndexArrayFree(&indexes, csp->constraintDefsSize);
+    return err;
+  }
+  *out = indexes;
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspTableIndexArrayAlloc(const CjCsp* csp, int minSize, CjTableIndex** out) {
+  if (!csp || !out) { return CJ_ERROR_ARG; }
+  CjError err = cjCspValidateOnce(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+  return cjCspTableIndexArrayAllocUsed(csp, minSize, 0, out);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Value index
+//
+
+/** Domains whose values span at most this many ints per value are dense. */
+#define CJ_VALUE_INDEX_DENSE_SPAN 4
+
+/** Give up building a perfect hash after this many displacements of a bucket. */
+#define CJ_VALUE_INDEX_MAX_DISPLACEMENT (1 << 20)
+
+/** Hash value with seed: seed 0 picks the bucket, others the slot. */
+static uint64_t cjValueHash(int value, int seed) {
+  uint64_t h = (uint32_t) value ^ ((uint64_t) seed * 0x9e3779b97f4a7c15ULL);
+  h = cjHashMix(h) * 0xc4ceb9fe1a85ec53ULL;
+  return h ^ (h >> 33);
+}
+
+CjValueIndex cjValueIndexInit() {
+  CjValueIndex x;
+  x.type = CJ_VALUE_INDEX_RANGE;
+  x.size = 0;
+  x.lo = 0;
+  x.values = cjIntTuplesInit();
+  x.slotsSize = 0;
+  x.slots = NULL;
+  x.bucketsSize = 0;
+  x.displacements = NULL;
+  return x;
+}
+
+/** A bucket of values by their first index in the sorted order. */
+typedef struct CjValueBucket {
+  int bucket;
+  int size;
+} CjValueBucket;
+
+static int compareValueBucketsBySizeDesc(const void* xPtr, const void* yPtr) {
+  const CjValueBucket* x = (const CjValueBucket*) xPtr;
+  const CjValueBucket* y = (const CjValueBucket*) yPtr;
+  if (x->size != y->size) { return x->size > y->size ? -1 : 1; }
+  return x->bucket - y->bucket;
+}
+
+/** Build the hash and displace tables of index, whose values are set. */
+static CjError cjValueIndexHash(CjValueIndex* index) {
+  const int size = index->size;
+  int slotsSize = 2;
+  while (slotsSize < 2 * size) { slotsSize *= 2; }
+  int bucketsSize = 1;
+  while (bucketsSize < size / 2) { bucketsSize *= 2; }
+
+  // Values grouped by bucket: counting sort into byBucket.
+  int* starts = (int*) cjCalloc(bucketsSize + 1, sizeof(int));
+  int* byBucket = (int*) cjMalloc(sizeof(int) * (size + 1));
+  int* tried = (int*) cjMalloc(sizeof(int) * (size + 1));
+  CjValueBucket* order = (CjValueBucket*) cjMalloc(sizeof(CjValueBucket) * bucketsSize);
+  index->slots = (int*) cjCalloc(slotsSize, sizeof(int));
+  index->displacements = (int*) cjCalloc(bucketsSize, sizeof(int));
+  CjError err = CJ_ERROR_OK;
+  if (!starts || !byBucket || !tried || !order || !index->slots || !index->displacements) {
+    err = CJ_ERROR_NOMEM;
+    goto cleanup;
+  }
+  index->slotsSize = slotsSize;
+  index->bucketsSize = bucketsSize;
+  for (int i = 0; i < size; ++i) {
+    starts[(cjValueHash(cjIntTuplesGet(&index->values, i), 0) & (bucketsSize - 1)) + 1]++;
+  }
+  for (int b = 0; b < bucketsSize; ++b) {
+    order[b].bucket = b;
+    order[b].size = starts[b + 1];
+    starts[b + 1] += starts[b];
+  }
+  for (int i = 0; i < size; ++i) {
+    const int b = cjValueHash(cjIntTuplesGet(&index->values, i), 0) & (bucketsSize - 1);
+    byBucket[starts[b] + --order[b].size] = i;
+  }
+  for (int b = 0; b < bucketsSize; ++b) { order[b].size = starts[b + 1] - starts[b]; }
+
+  // Place the biggest buckets first while the table is emptiest.
+  qsort(order, bucketsSize, sizeof(CjValueBucket), compareValueBucketsBySizeDesc);
+  for (int iOrder = 0; iOrder < bucketsSize && order[iOrder].size > 0 && err == CJ_ERROR_OK; ++iOrder) {
+    const int b = order[iOrder].bucket;
+    const int* values = byBucket + starts[b];
+    const int bucketSize = order[iOrder].size;
+    int d = 1;
+    for (; d <= CJ_VALUE_INDEX_MAX_DISPLACEMENT; ++d) {
+      int placed = 0;
+      for (; placed < bucketSize; ++placed) {
+        const size_t slot = cjValueHash(cjIntTuplesGet(&index->values, values[placed]), d) & (slotsSize - 1);
+        if (index->slots[slot]) { break; }
+        // Claim the slot so that values of the bucket do not collide.
+        index->slots[slot] = values[placed] + 1;
+        tried[placed] = (int) slot;
+      }
+      if (placed == bucketSize) { break; }
+      while (placed-- > 0) { index->slots[tried[placed]] = 0; }
+    }
+    if (d > CJ_VALUE_INDEX_MAX_DISPLACEMENT) { err = CJ_ERROR; }
+    index->displacements[b] = d;
+  }
+
+cleanup:
+  cjFree(starts);
+  cjFree(byBucket);
+  cjFree(tried);
+  cjFree(order);
+  return err;
+}
+
+CjError cjValueIndexAlloc(const CjDomain* domain, CjValueIndex* out) {
+  if (!domain || !out) { return CJ_ERROR_ARG; }
+  *out = cjValueIndexInit();
+  if (domain->type == CJ_DOMAIN_RANGE) {
+    if (!cjDomainRangeIsValid(domain->range.lo, domain->range.hi)) { return CJ_ERROR_VALIDATION_DOMAIN_RANGE; }
+    out->lo = domain->range.lo;
+    out->size = cjDomainSize(domain);
+    return CJ_ERROR_OK;
+  }
+  if (domain->type != CJ_DOMAIN_VALUES) { return CJ_ERROR_DOMAIN_UNKNOWN_TYPE; }
+
+  CjError err = cjDomainSortedValues(domain, &out->values);
+  if (err != CJ_ERROR_OK) { return err; }
+  out->size = out->values.size;
+  if (out->size == 0) {
+    out->type = CJ_VALUE_INDEX_DENSE;
+    return CJ_ERROR_OK;
+  }
+  out->lo = out->values.data[0];
+  const int64_t span = (int64_t) out->values.data[out->size - 1] - out->lo + 1;
+  if (span <= (int64_t) CJ_VALUE_INDEX_DENSE_SPAN * out->size) {
+    out->type = CJ_VALUE_INDEX_DENSE;
+    out->slotsSize = (int) span;
+    out->slots = (int*) cjCalloc(out->slotsSize, sizeof(int));
+    if (!out->slots) { cjValueIndexFree(out); return CJ_ERROR_NOMEM; }
+    for (int i = 0; i < out->size; ++i) { out->slots[out->values.data[i] - out->lo] = i + 1; }
+  }
+  else {
+    out->type = CJ_VALUE_INDEX_HASH;
+    err = cjValueIndexHash(out);
+  }
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesNarrow(&out->values); }
+  if (err != CJ_ERROR_OK) { cjValueIndexFree(out); }
+  return err;
+}
+
+int cjValueIndexOf(const CjValueIndex* index, int value) {
+  switch (index->type) {
+    case CJ_VALUE_INDEX_RANGE: {
+      const int64_t i = (int64_t) value - index->lo;
+      return i >= 0 && i < index->size ? (int) i : -1;
+    }
+    case CJ_VALUE_INDEX_DENSE: {
+      const int64_t slot = (int64_t) value - index->lo;
+      return slot >= 0 && slot < index->slotsSize ? index->slots[slot] - 1 : -1;
+    }
+    default: {
+      const int b = cjValueHash(value, 0) & (index->bucketsSize - 1);
+      const size_t slot = cjValueHash(value, index->displacements[b]) & (index->slotsSize - 1);
+      const int i = index->slots[slot] - 1;
+      return i >= 0 && cjIntTuplesGet(&index->values, i) == value ? i : -1;
+    }
+  }
+}
+
+int cjValueIndexValue(const CjValueIndex* index, int i) {
+  if (index->type == CJ_VALUE_INDEX_RANGE) { return index->lo + i; }
+  return cjIntTuplesGet(&index->values, i);
+}
+
+void cjValueIndexFree(CjValueIndex* inout) {
+  if (!inout) { return; }
+  cjIntTuplesFree(&inout->values);
+  cjFree(inout->slots);
+  cjFree(inout->displacements);
+  *inout = cjValueIndexInit();
+}
+
+void cjValueIndexArrayFree(CjValueIndex** inout, int size) {
+  if (!inout) { return; }
+  if (!(*inout)) { return; }
+  for (int i = 0; i < size; ++i) {
+    cjValueIndexFree(&((*inout)[i]));
+  }
+  cjFree(*inout);
+  *inout = NULL;
+}
+
+CjError cjCspBuildValueIndex(const CjCsp* csp, CjValueIndex** out) {
+  if (!csp || !out) { return CJ_ERROR_ARG; }
+  *out = NULL;
+  CjValueIndex* indexes = (CjValueIndex*) cjMalloc(sizeof(CjValueIndex) * (csp->domainsSize + 1));
+  if (!indexes) { return CJ_ERROR_NOMEM; }
+  for (int iDom = 0; iDom < csp->domainsSize; ++iDom) { indexes[iDom] = cjValueIndexInit(); }
+  CjError err = CJ_ERROR_OK;
+  for (int iDom = 0; iDom < csp->domainsSize && err == CJ_ERROR_OK; ++iDom) {
+    err = cjValueIndexAlloc(&csp->domains[iDom], &indexes[iDom]);
+  }
+  if (err != CJ_ERROR_OK) {
+    cjValueIndexArrayFree(&indexes, csp->domainsSize);
+    return err;
+  }
+  *out = indexes;
+  return CJ_ERROR_OK;
+}
+
+/**
+ * Allocate out with the values of table mapped with the indexes of column
+ * domains (toIndex) or back, dropping the tuples with values that have no
+ * mapping. The order of the tuples is kept: the mapping is increasing.
+ */
+static CjError cjIntTuplesReindex(
+  const CjIntTuples* table, const CjValueIndex* const* columns, bool toIndex, CjIntTuples* out)
+{
+  const int arity = abs(table->arity);
+  CjError err = cjIntTuplesAlloc(table->size, table->arity, out);
+  if (err != CJ_ERROR_OK) { return err; }
+  int size = 0;
+  for (int iTuple = 0; iTuple < table->size; ++iTuple) {
+    int iVal = 0;
+    for (; iVal < arity; ++iVal) {
+      const CjValueIndex* column = columns[iVal];
+      const int x = cjIntTuplesGet(table, (size_t) iTuple * arity + iVal);
+      int y = -1;
+      if (toIndex) { y = cjValueIndexOf(column, x); }
+      else if (x >= 0 && x < column->size) { y = cjValueIndexValue(column, x); }
+      else { break; }
+      if (toIndex && y < 0) { break; }
+      out->data[(size_t) size * arity + iVal] = y;
+    }
+    if (iVal == arity) { ++size; }
+  }
+  out->size = size;
+  err = table->width < (int) sizeof(int) ? cjIntTuplesNarrow(out) : CJ_ERROR_OK;
+  if (err != CJ_ERROR_OK) { cjIntTuplesFree(out); }
+  return err;
+}
+
+/**
+ * Init & allocate out as def, a table or MDD def, with its values reindexed
+ * by cjIntTuplesReindex(). MDDs are rewritten through tables: dropped tuples
+ * would leave dead nodes.
+ */
+static CjError cjConstraintDefReindex(
+  const CjConstraintDef* def, const CjValueIndex* const* columns, bool toIndex, CjConstraintDef* out)
+{
+  *out = cjConstraintDefInit();
+  if (def->type != CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+    out->type = def->type;
+    return cjIntTuplesReindex(cjConstraintDefTable(def), columns, toIndex, cjConstraintDefTable(out));
+  }
+  CjIntTuples tuples = cjIntTuplesInit();
+  CjIntTuples reindexed = cjIntTuplesInit();
+  CjError err = cjMddExpand(&def->noGoodsMdd, &tuples);
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesReindex(&tuples, columns, toIndex, &reindexed); }
+  if (err == CJ_ERROR_OK) {
+    out->type = CJ_CONSTRAINT_DEF_NO_GOODS_MDD;
+    err = cjMddAlloc(&reindexed, &out->noGoodsMdd);
+    if (err != CJ_ERROR_OK) { *out = cjConstraintDefInit(); }
+  }
+  cjIntTuplesFree(&reindexed);
+  cjIntTuplesFree(&tuples);
+  return err;
+}
+
+/** cjCspToIndexSpace() (toIndex) or cjCspFromIndexSpace(). */
+static CjError cjCspReindex(CjCsp* csp, const CjValueIndex* indexes, bool toIndex) {
+  if (!csp || !indexes) { return CJ_ERROR_ARG; }
+  CjError err = cjCspValidateOnce(csp);
+  if (err == CJ_ERROR_OK) { err = cjCspUnshareConstraintDefs(csp); }
+  if (err != CJ_ERROR_OK) { return err; }
+  int* firstUse = NULL;
+  err = cjCspDefFirstUses(csp, &firstUse);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  // Check everything can be rewritten before modifying csp.
+  for (int iDef = 0; iDef < csp->constraintDefsSize && err == CJ_ERROR_OK; ++iDef) {
+    const CjConstraintDef* def = &csp->constraintDefs[iDef];
+    if (firstUse[iDef] == -1) { continue; }
+    if (def->type == CJ_CONSTRAINT_DEF_PREDICATE || firstUse[iDef] == -2) { err = CJ_ERROR_ARG; }
+    if (def->type == CJ_CONSTRAINT_DEF_ALL_DIFFERENT) {
+      const CjConstraint* c = &csp->constraints[firstUse[iDef]];
+      for (int iVar = 1; iVar < c->vars.size; ++iVar) {
+        if (cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, iVar)) != cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, 0))) {
+          err = CJ_ERROR_ARG;
+        }
+      }
+    }
+  }
+
+  // Build the new defs and domains aside and only swap them in once all of
+  // them are built, so that csp is left as it was on error.
+  CjConstraintDef* defs = cjConstraintDefArray(csp->constraintDefsSize);
+  CjDomain* domains = cjDomainArray(csp->domainsSize);
+  if (err == CJ_ERROR_OK && ((!defs && csp->constraintDefsSize > 0) || (!domains && csp->domainsSize > 0))) {
+    err = CJ_ERROR_NOMEM;
+  }
+
+  const CjValueIndex** columns = NULL;
+  int columnsSize = 0;
+  for (int iDef = 0; iDef < csp->constraintDefsSize && err == CJ_ERROR_OK; ++iDef) {
+    const CjConstraintDef* def = &csp->constraintDefs[iDef];
+    if (firstUse[iDef] < 0) { continue; }
+    if (!cjConstraintDefTable(def) && def->type != CJ_CONSTRAINT_DEF_NO_GOODS_MDD) { continue; }
+    const CjConstraint* c = &csp->constraints[firstUse[iDef]];
+    if (c->vars.size > columnsSize) {
+      cjFree(columns);
+      columnsSize = c->vars.size;
+      columns = (const CjValueIndex**) cjMalloc(sizeof(CjValueIndex*) * columnsSize);
+      if (!columns) { err = CJ_ERROR_NOMEM; break; }
+    }
+    for (int iVar = 0; iVar < c->vars.size; ++iVar) {
+      columns[iVar] = &indexes[cjCspVarDomain(csp, cjIntTuplesGet(&c->vars, iVar))];
+    }
+    err = cjConstraintDefReindex(def, columns, toIndex, &defs[iDef]);
+  }
+  cjFree(columns);
+
+  for (int iDom = 0; iDom < csp->domainsSize && err == CJ_ERROR_OK; ++iDom) {
+    const CjValueIndex* index = &indexes[iDom];
+    CjDomain* domain = &domains[iDom];
+    if (index->size == 0) { continue; }
+    if (toIndex || index->type == CJ_VALUE_INDEX_RANGE) {
+      const int lo = toIndex ? 0 : index->lo;
+      err = cjDomainRangeInit(lo, lo + index->size - 1, domain);
+    }
+    else {
+      err = cjDomainValuesAlloc(index->size, domain);
+      for (int i = 0; i < index->size && err == CJ_ERROR_OK; ++i) {
+        domain->values.data[i] = cjValueIndexValue(index, i);
+      }
+      if (err == CJ_ERROR_OK && index->values.width < (int) sizeof(int)) {
+        err = cjIntTuplesNarrow(&domain->values);
+      }
+    }
+  }
+
+  // Defs and domains left CJ_*_UNDEF are kept as they are.
+  for (int iDef = 0; iDef < csp->constraintDefsSize && err == CJ_ERROR_OK; ++iDef) {
+    if (defs[iDef].type == CJ_CONSTRAINT_DEF_UNDEF) { continue; }
+    cjConstraintDefFree(&csp->constraintDefs[iDef]);
+    csp->constraintDefs[iDef] = defs[iDef];
+    defs[iDef] = cjConstraintDefInit();
+  }
+  for (int iDom = 0; iDom < csp->domainsSize && err == CJ_ERROR_OK; ++iDom) {
+    if (domains[iDom].type == CJ_DOMAIN_UNDEF) { continue; }
+    cjDomainFree(&csp->domains[iDom]);
+    csp->domains[iDom] = domains[iDom];
+    domains[iDom] = cjDomainInit();
+  }
+  cjConstraintDefArrayFree(&defs, csp->constraintDefsSize);
+  cjDomainArrayFree(&domains, csp->domainsSize);
+  cjFree(firstUse);
+  return err;
+}
+
+CjError cjCspToIndexSpace(CjCsp* csp, const CjValueIndex* indexes) {
+  return cjCspReindex(csp, indexes, true);
+}
+
+CjError cjCspFromIndexSpace(CjCsp* csp, const CjValueIndex* indexes) {
+  return cjCspReindex(csp, indexes, false);
+}
+
+/** cjCspSolutionToIndexSpace() (toIndex) or cjCspSolutionFromIndexSpace(). */
+static CjError cjCspSolutionReindex(const CjCsp* csp, const CjValueIndex* indexes, CjIntTuples* solution, bool toIndex) {
+  if (!csp || !indexes || !solution) { return CJ_ERROR_ARG; }
+  if (solution->arity != -1) { return CJ_ERROR_VALIDATION_SOLUTION_ARITY; }
+  if (cjCspVarsSize(csp) != solution->size) { return CJ_ERROR_VALIDATION_SOLUTION_VARS_SIZE_MISMATCH; }
+  // Indexes and values may need different widths.
+  const int width = solution->width;
+  CjError err = cjIntTuplesWiden(solution);
+  for (int iVar = 0; iVar < solution->size && err == CJ_ERROR_OK; ++iVar) {
+    const CjValueIndex* index = &indexes[cjCspVarDomain(csp, iVar)];
+    const int x = solution->data[iVar];
+    if (toIndex) {
+      solution->data[iVar] = cjValueIndexOf(index, x);
+      if (solution->data[iVar] < 0) { err = CJ_ERROR_ARG; }
+    }
+    else if (x >= 0 && x < index->size) {
+      solution->data[iVar] = cjValueIndexValue(index, x);
+    }
+    else {
+      err = CJ_ERROR_ARG;
+    }
+  }
+  if (err == CJ_ERROR_OK && width < (int) sizeof(int)) { err = cjIntTuplesNarrow(solution); }
+  return err;
+}
+
+CjError cjCspSolutionToIndexSpace(const CjCsp* csp, const CjValueIndex* indexes, CjIntTuples* solution) {
+  return cjCspSolutionReindex(csp, indexes, solution, true);
+}
+
+CjError cjCspSolutionFromIndexSpace(const CjCsp* csp, const CjValueIndex* indexes, CjIntTuples* solution) {
+  return cjCspSolutionReindex(csp, indexes, solution, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// IsSolved
+//
+
+/**
+ * cjCspIsSolved() of a csp that validates, indexes may be null. If view is not
+ * null, solution assigns the vars of the view and only the constraints of the
+ * view are checked.
+ */
+static CjError cjCspIsSolvedValid(
+  const CjCsp* csp, const CjCspView* view, const CjTableIndex* indexes, const CjIntTuples* solution, int* solved)
+{
+  CjError err = CJ_ERROR_OK;
 
   if (solution->arity != -1) {
     return CJ_ERROR_VALIDATION_SOLUTION_ARITY;
   }
-  if (csp->vars.size != solution->size) {
+  if ((view ? view->vars.size : cjCspVarsSize(csp)) != solution->size) {
     return CJ_ERROR_VALIDATION_SOLUTION_VARS_SIZE_MISMATCH;
   }
 
   // Check variable assignment is within the domain.
   for (int iVar = 0; iVar < solution->size; ++iVar) {
-    int value = solution->data[iVar];
-    CjDomain* domain = &csp->domains[csp->vars.data[iVar]];
-    if (domain->type != CJ_DOMAIN_VALUES) {
+    int value = cjIntTuplesGet(solution, iVar);
+    const int parentVar = view ? cjIntTuplesGet(&view->vars, iVar) : iVar;
+    CjDomain* domain = &csp->domains[cjCspVarDomain(csp, parentVar)];
+    if (domain->type != CJ_DOMAIN_VALUES && domain->type != CJ_DOMAIN_RANGE) {
       return CJ_ERROR_DOMAIN_UNKNOWN_TYPE;
     }
-    bool valueInDomain = false;
-    for (int iVal = 0; iVal < domain->values.size; ++iVal) {
-      if (value == domain->values.data[iVal]) {
-        valueInDomain = true;
-        break;
-      }
-    }
-    if (!valueInDomain) {
+    if (!cjDomainHasValue(domain, value)) {
       *solved = false;
       return CJ_ERROR_OK;
     }
   }
 
-  // Check that variable assignments satisfy constraints.
-  for (int iConstraint = 0; iConstraint < csp->constraintsSize; ++iConstraint) {
-    CjConstraint* constraint = &csp->constraints[iConstraint];
+  // Check that variable assignments satisfy constraints: the values of the
+  // constraint vars must not be one of the no-goods, must be one of the
+  // goods, or must all differ.
+  int scopeTmp[16];
+  int* scope = scopeTmp;
+  int scopeCapacity = sizeof(scopeTmp) / sizeof(int);
+  // (*solved) is only written on success.
+  bool isSolved = true;
+  const int constraintsSize = view ? view->constraints.size : csp->constraintsSize;
+  for (int iConstraint = 0; iConstraint < constraintsSize; ++iConstraint) {
+    CjConstraint* constraint = &csp->constraints[view ? cjIntTuplesGet(&view->constraints, iConstraint) : iConstraint];
     CjConstraintDef* def = &csp->constraintDefs[constraint->id];
-    if (def->type != CJ_CONSTRAINT_DEF_NO_GOODS) {
-      return CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
+    if (def->type == CJ_CONSTRAINT_DEF_PREDICATE) {
+      int xVar = cjIntTuplesGet(&constraint->vars, 0);
+      int yVar = cjIntTuplesGet(&constraint->vars, 1);
+      if (view) {
+        xVar = cjCspViewVarOf(view, xVar);
+        yVar = cjCspViewVarOf(view, yVar);
+      }
+      const int x = cjIntTuplesGet(solution, xVar);
+      const int y = cjIntTuplesGet(solution, yVar);
+      if (!cjPredicateHolds(def->predicate.op, def->predicate.k, x, y)) {
+        isSolved = false;
+        break;
+      }
+      continue;
     }
-    bool valuesAllowed = true;
-    for (int iTuple = 0; iTuple < def->noGoods.size; ++iTuple) {
-      bool tupleMatchesSolution = true;
-      for (int iVar = 0; iVar < def->noGoods.arity; ++iVar) {
-        int solutionVal = solution->data[constraint->vars.data[iVar]];
-        int tupleVal = def->noGoods.data[iTuple * def->noGoods.arity + iVar];
-        if (solutionVal != tupleVal) {
-          tupleMatchesSolution = false;
-          break;
-        }
+    const CjIntTuples* table = cjConstraintDefTable(def);
+    if (!table && def->type != CJ_CONSTRAINT_DEF_ALL_DIFFERENT && def->type != CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+      err = CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE;
+      break;
+    }
+    if (constraint->vars.size > scopeCapacity) {
+      if (scope != scopeTmp) { cjFree(scope); }
+      scopeCapacity = constraint->vars.size;
+      scope = (int*) cjMalloc(sizeof(int) * scopeCapacity);
+      if (!scope) { scope = scopeTmp; err = CJ_ERROR_NOMEM; break; }
+    }
+    for (int iVar = 0; iVar < constraint->vars.size; ++iVar) {
+      const int var = cjIntTuplesGet(&constraint->vars, iVar);
+      scope[iVar] = cjIntTuplesGet(solution, view ? cjCspViewVarOf(view, var) : var);
+    }
+
+    if (def->type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD) {
+      if (cjMddHas(&def->noGoodsMdd, scope)) {
+        isSolved = false;
+        break;
       }
-      if (tupleMatchesSolution) {
-        valuesAllowed = false;
+    }
+    else if (table) {
+      // A no-good must not be found, a good must be.
+      const CjTableIndex* index = indexes ? &indexes[constraint->id] : NULL;
+      const bool found = cjTableIndexFind(index, table, scope) >= 0;
+      if (found == (def->type == CJ_CONSTRAINT_DEF_NO_GOODS)) {
+        isSolved = false;
         break;
       }
     }
-    if (! valuesAllowed) {
-      *solved = false;
-      return CJ_ERROR_OK;
+    else {
+      // Radix sort the values, O(vars), then look for equal neighbours.
+      err = cjSortTuples(scope, sizeof(int), constraint->vars.size, 1);
+      if (err != CJ_ERROR_OK) { break; }
+      for (int iVar = 1; iVar < constraint->vars.size && isSolved; ++iVar) {
+        if (scope[iVar - 1] == scope[iVar]) { isSolved = false; }
+      }
+      if (!isSolved) { break; }
+    }
+  }
+  if (scope != scopeTmp) { cjFree(scope); }
+  if (err == CJ_ERROR_OK) { *solved = isSolved; }
+  return err;
+}
+
+/** cjCspIsSolved() of non-null args. */
+static CjError cjCspIsSolvedAll(const CjCsp* csp, const CjIntTuples* solution, int* solved) {
+  CjError err = cjCspValidateOnce(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  // Indexing costs about one scan of the table, which pays off as soon as it
+  // is shared by two constraints.
+  CjTableIndex* indexes = NULL;
+  err = cjCspTableIndexArrayAllocUsed(csp, CJ_TABLE_INDEX_MIN_SIZE, 2, &indexes);
+  if (err != CJ_ERROR_OK) { return err; }
+  err = cjCspIsSolvedValid(csp, NULL, indexes, solution, solved);
+  cjTableIndexArrayFree(&indexes, csp->constraintDefsSize);
+  return err;
+}
+
+CjError cjCspIsSolved(const CjCsp* csp, const CjIntTuples* solution, int* solved) {
+  if (!csp || !solution || !solved) { return CJ_ERROR_ARG; }
+  CJ_PROBE(is_solved_entry, solution->size, csp);
+  CjError err = cjCspIsSolvedAll(csp, solution, solved);
+  CJ_PROBE(is_solved_return, err, csp);
+  return err;
+}
+
+CjError cjCspIsSolvedIndexed(const CjCsp* csp, const CjTableIndex* indexes, const CjIntTuples* solution, int* solved) {
+  if (!csp || !solution || !solved) { return CJ_ERROR_ARG; }
+
+  CjError err = cjCspValidateOnce(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+  return cjCspIsSolvedValid(csp, NULL, indexes, solution, solved);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Builder
+//
+
+/**
+ * Make room in (*data), an array of capacity elements of elemSize bytes, for
+ * one more after size: double capacity when full.
+ */
+static CjError cjBuilderReserve(void** data, int* capacity, int size, size_t elemSize) {
+  if (size < *capacity) { return CJ_ERROR_OK; }
+  if (*capacity > INT_MAX / 2) { return CJ_ERROR_NOMEM; }
+  const int newCapacity = *capacity > 0 ? 2 * *capacity : 8;
+  void* newData = cjRealloc(*data, elemSize * (size_t) newCapacity);
+  if (!newData) { return CJ_ERROR_NOMEM; }
+  *data = newData;
+  *capacity = newCapacity;
+  return CJ_ERROR_OK;
+}
+
+/** Shrink (*data) to size elements of elemSize bytes, keeping it on failure. */
+static void cjBuilderTrim(void** data, int size, size_t elemSize) {
+  if (size == 0) {
+    cjFree(*data);
+    *data = NULL;
+    return;
+  }
+  void* newData = cjRealloc(*data, elemSize * (size_t) size);
+  if (newData) { *data = newData; }
+}
+
+CjCspBuilder cjCspBuilderInit() {
+  CjCspBuilder x;
+  x.csp = cjCspInit();
+  x.csp.vars.arity = -1;
+  x.domainsCapacity = 0;
+  x.varsCapacity = 0;
+  x.constraintDefsCapacity = 0;
+  x.constraintsCapacity = 0;
+  return x;
+}
+
+CjError cjCspBuilderAddDomain(CjCspBuilder* b, CjDomain* domain) {
+  if (!b || !domain) { return CJ_ERROR_ARG; }
+  CjError err = cjBuilderReserve((void**) &b->csp.domains, &b->domainsCapacity, b->csp.domainsSize, sizeof(CjDomain));
+  if (err != CJ_ERROR_OK) { return err; }
+  b->csp.domains[b->csp.domainsSize++] = *domain;
+  *domain = cjDomainInit();
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspBuilderAddVar(CjCspBuilder* b, int domain) {
+  if (!b) { return CJ_ERROR_ARG; }
+  CjError err = cjBuilderReserve((void**) &b->csp.vars.data, &b->varsCapacity, b->csp.vars.size, sizeof(int));
+  if (err != CJ_ERROR_OK) { return err; }
+  b->csp.vars.data[b->csp.vars.size++] = domain;
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspBuilderAddConstraintDef(CjCspBuilder* b, CjConstraintDef* def) {
+  if (!b || !def) { return CJ_ERROR_ARG; }
+  CjError err = cjBuilderReserve(
+    (void**) &b->csp.constraintDefs, &b->constraintDefsCapacity, b->csp.constraintDefsSize, sizeof(CjConstraintDef));
+  if (err != CJ_ERROR_OK) { return err; }
+  b->csp.constraintDefs[b->csp.constraintDefsSize++] = *def;
+  *def = cjConstraintDefInit();
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspBuilderAddConstraint(CjCspBuilder* b, int id, const int* vars, int varsSize) {
+  if (!b || varsSize < 0 || (varsSize > 0 && !vars)) { return CJ_ERROR_ARG; }
+  CjError err = cjBuilderReserve(
+    (void**) &b->csp.constraints, &b->constraintsCapacity, b->csp.constraintsSize, sizeof(CjConstraint));
+  if (err != CJ_ERROR_OK) { return err; }
+  CjConstraint c = cjConstraintInit();
+  err = cjConstraintAlloc(varsSize, &c);
+  if (err != CJ_ERROR_OK) { return err; }
+  c.id = id;
+  if (varsSize > 0) { memcpy(c.vars.data, vars, sizeof(int) * varsSize); }
+  b->csp.constraints[b->csp.constraintsSize++] = c;
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspBuilderFinish(CjCspBuilder* b, CjCsp* out) {
+  if (!b || !out) { return CJ_ERROR_ARG; }
+  cjBuilderTrim((void**) &b->csp.domains, b->csp.domainsSize, sizeof(CjDomain));
+  cjBuilderTrim((void**) &b->csp.vars.data, b->csp.vars.size, sizeof(int));
+  cjBuilderTrim((void**) &b->csp.constraintDefs, b->csp.constraintDefsSize, sizeof(CjConstraintDef));
+  cjBuilderTrim((void**) &b->csp.constraints, b->csp.constraintsSize, sizeof(CjConstraint));
+  *out = b->csp;
+  *b = cjCspBuilderInit();
+  return CJ_ERROR_OK;
+}
+
+void cjCspBuilderFree(CjCspBuilder* b) {
+  if (!b) { return; }
+  cjCspFree(&b->csp);
+  *b = cjCspBuilderInit();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// View
+//
+
+CjVarConstraints cjVarConstraintsInit() {
+  CjVarConstraints x;
+  x.offsets = cjIntTuplesInit();
+  x.constraints = cjIntTuplesInit();
+  return x;
+}
+
+CjError cjVarConstraintsAlloc(const CjCsp* csp, CjVarConstraints* out) {
+  if (!csp || !out) { return CJ_ERROR_ARG; }
+  *out = cjVarConstraintsInit();
+  CjError err = cjCspValidateOnce(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  // Counting sort of the (var, constraint) pairs by var.
+  const int varsSize = cjCspVarsSize(csp);
+  size_t pairsSize = 0;
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    pairsSize += csp->constraints[iC].vars.size;
+  }
+  if (pairsSize > INT_MAX) { return CJ_ERROR_NOMEM; }
+  err = cjIntTuplesAlloc(varsSize + 1, -1, &out->offsets);
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc((int) pairsSize, -1, &out->constraints); }
+  if (err != CJ_ERROR_OK) {
+    cjVarConstraintsFree(out);
+    return err;
+  }
+  int* offsets = out->offsets.data;
+  memset(offsets, 0, sizeof(int) * (varsSize + 1));
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    const CjIntTuples* vars = &csp->constraints[iC].vars;
+    for (int iVar = 0; iVar < vars->size; ++iVar) {
+      ++offsets[cjIntTuplesGet(vars, iVar) + 1];
+    }
+  }
+  for (int iVar = 0; iVar < varsSize; ++iVar) {
+    offsets[iVar + 1] += offsets[iVar];
+  }
+  // Fill each var's range from its start, then shift the starts back.
+  for (int iC = 0; iC < csp->constraintsSize; ++iC) {
+    const CjIntTuples* vars = &csp->constraints[iC].vars;
+    for (int iVar = 0; iVar < vars->size; ++iVar) {
+      out->constraints.data[offsets[cjIntTuplesGet(vars, iVar)]++] = iC;
+    }
+  }
+  for (int iVar = varsSize; iVar > 0; --iVar) {
+    offsets[iVar] = offsets[iVar - 1];
+  }
+  offsets[0] = 0;
+  return CJ_ERROR_OK;
+}
+
+void cjVarConstraintsFree(CjVarConstraints* inout) {
+  if (!inout) { return; }
+  cjIntTuplesFree(&inout->offsets);
+  cjIntTuplesFree(&inout->constraints);
+}
+
+CjCspView cjCspViewInit() {
+  CjCspView x;
+  x.csp = NULL;
+  x.vars = cjIntTuplesInit();
+  x.constraints = cjIntTuplesInit();
+  x.domains = cjIntTuplesInit();
+  x.constraintDefs = cjIntTuplesInit();
+  return x;
+}
+
+/** @return the position of value in the increasing 1D ts, -1 if absent. */
+static int cjSortedIndexOf(const CjIntTuples* ts, int value) {
+  int lo = 0;
+  int hi = ts->size;
+  while (lo < hi) {
+    const int mid = lo + (hi - lo) / 2;
+    const int x = ts->data[mid];
+    if (x == value) { return mid; }
+    if (x < value) { lo = mid + 1; } else { hi = mid; }
+  }
+  return -1;
+}
+
+/** Sort the 1D ts and drop its duplicates. */
+static CjError cjSortedUnique(CjIntTuples* ts) {
+  CjError err = cjSortTuples(ts->data, sizeof(int), ts->size, 1);
+  if (err != CJ_ERROR_OK) { return err; }
+  int size = 0;
+  for (int i = 0; i < ts->size; ++i) {
+    if (size == 0 || ts->data[size - 1] != ts->data[i]) { ts->data[size++] = ts->data[i]; }
+  }
+  ts->size = size;
+  return CJ_ERROR_OK;
+}
+
+int cjCspViewVarOf(const CjCspView* view, int var) {
+  return cjSortedIndexOf(&view->vars, var);
+}
+
+int cjCspViewDomainOf(const CjCspView* view, int iDom) {
+  return cjSortedIndexOf(&view->domains, iDom);
+}
+
+int cjCspViewConstraintDefOf(const CjCspView* view, int iDef) {
+  return cjSortedIndexOf(&view->constraintDefs, iDef);
+}
+
+static CjError cjCspViewAllocWith(
+  const CjCsp* csp, const CjVarConstraints* varConstraints, const int* vars, int varsSize, CjCspView* out)
+{
+  CjError err = cjIntTuplesAlloc(varsSize, -1, &out->vars);
+  if (err != CJ_ERROR_OK) { return err; }
+  if (varsSize > 0) { memcpy(out->vars.data, vars, sizeof(int) * varsSize); }
+  err = cjSortTuples(out->vars.data, sizeof(int), varsSize, 1);
+  if (err != CJ_ERROR_OK) { return err; }
+  for (int i = 0; i < varsSize; ++i) {
+    if (out->vars.data[i] < 0 || out->vars.data[i] >= cjCspVarsSize(csp)) { return CJ_ERROR_ARG; }
+    if (i > 0 && out->vars.data[i - 1] == out->vars.data[i]) { return CJ_ERROR_ARG; }
+  }
+
+  // Each constraint within the view is listed by each of its vars: keep it
+  // once, from its first var.
+  size_t capacity = 0;
+  for (int i = 0; i < varsSize; ++i) {
+    const int var = out->vars.data[i];
+    capacity += varConstraints->offsets.data[var + 1] - varConstraints->offsets.data[var];
+  }
+  if (capacity > INT_MAX) { return CJ_ERROR_NOMEM; }
+  err = cjIntTuplesAlloc((int) capacity, -1, &out->constraints);
+  if (err != CJ_ERROR_OK) { return err; }
+  out->constraints.size = 0;
+  for (int i = 0; i < varsSize; ++i) {
+    const int var = out->vars.data[i];
+    for (int j = varConstraints->offsets.data[var]; j < varConstraints->offsets.data[var + 1]; ++j) {
+      const int iC = varConstraints->constraints.data[j];
+      const CjIntTuples* cVars = &csp->constraints[iC].vars;
+      int first = INT_MAX;
+      int inView = 1;
+      for (int iVar = 0; iVar < cVars->size && inView; ++iVar) {
+        const int cVar = cjIntTuplesGet(cVars, iVar);
+        if (cVar < first) { first = cVar; }
+        inView = cjCspViewVarOf(out, cVar) >= 0;
+      }
+      const int size = out->constraints.size;
+      if (inView && first == var && (size == 0 || out->constraints.data[size - 1] != iC)) {
+        out->constraints.data[out->constraints.size++] = iC;
+      }
+    }
+  }
+  err = cjSortTuples(out->constraints.data, sizeof(int), out->constraints.size, 1);
+
+  // The domains and constraintDefs in use, for printing and materializing.
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc(varsSize, -1, &out->domains); }
+  for (int i = 0; err == CJ_ERROR_OK && i < varsSize; ++i) {
+    out->domains.data[i] = cjCspVarDomain(csp, out->vars.data[i]);
+  }
+  if (err == CJ_ERROR_OK) { err = cjSortedUnique(&out->domains); }
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc(out->constraints.size, -1, &out->constraintDefs); }
+  for (int i = 0; err == CJ_ERROR_OK && i < out->constraints.size; ++i) {
+    out->constraintDefs.data[i] = csp->constraints[out->constraints.data[i]].id;
+  }
+  if (err == CJ_ERROR_OK) { err = cjSortedUnique(&out->constraintDefs); }
+  return err;
+}
+
+CjError cjCspViewAlloc(
+  const CjCsp* csp, const CjVarConstraints* varConstraints, const int* vars, int varsSize, CjCspView* out)
+{
+  if (!csp || !out || varsSize < 0 || (varsSize > 0 && !vars)) { return CJ_ERROR_ARG; }
+  *out = cjCspViewInit();
+  CjError err = cjCspValidateOnce(csp);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  CjVarConstraints ownVarConstraints = cjVarConstraintsInit();
+  if (!varConstraints) {
+    err = cjVarConstraintsAlloc(csp, &ownVarConstraints);
+    if (err != CJ_ERROR_OK) { return err; }
+    varConstraints = &ownVarConstraints;
+  }
+  out->csp = csp;
+  err = cjCspViewAllocWith(csp, varConstraints, vars, varsSize, out);
+  cjVarConstraintsFree(&ownVarConstraints);
+  if (err != CJ_ERROR_OK) { cjCspViewFree(out); }
+  return err;
+}
+
+CjError cjCspViewIsSolved(const CjCspView* view, const CjIntTuples* solution, int* solved) {
+  if (!view || !view->csp || !solution || !solved) { return CJ_ERROR_ARG; }
+  return cjCspIsSolvedValid(view->csp, view, NULL, solution, solved);
+}
+
+CjError cjCspViewMaterialize(const CjCspView* view, CjCsp* out) {
+  if (!view || !view->csp || !out) { return CJ_ERROR_ARG; }
+  const CjCsp* csp = view->csp;
+  *out = cjCspInit();
+
+  CjError err = cjStrCopy(csp->meta.id, &out->meta.id);
+  if (err == CJ_ERROR_OK) { err = cjStrCopy(csp->meta.algo, &out->meta.algo); }
+  if (err == CJ_ERROR_OK) { err = cjStrCopy(csp->meta.paramsJSON, &out->meta.paramsJSON); }
+  if (err == CJ_ERROR_OK && view->domains.size > 0) {
+    out->domains = cjDomainArray(view->domains.size);
+    if (!out->domains) { err = CJ_ERROR_NOMEM; } else { out->domainsSize = view->domains.size; }
+    for (int i = 0; err == CJ_ERROR_OK && i < view->domains.size; ++i) {
+      err = cjDomainCopy(&csp->domains[view->domains.data[i]], &out->domains[i]);
+    }
+  }
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc(view->vars.size, -1, &out->vars); }
+  for (int i = 0; err == CJ_ERROR_OK && i < view->vars.size; ++i) {
+    out->vars.data[i] = cjCspViewDomainOf(view, cjCspVarDomain(csp, view->vars.data[i]));
+  }
+  if (err == CJ_ERROR_OK && view->constraintDefs.size > 0) {
+    out->constraintDefs = cjConstraintDefArray(view->constraintDefs.size);
+    if (!out->constraintDefs) { err = CJ_ERROR_NOMEM; } else { out->constraintDefsSize = view->constraintDefs.size; }
+    for (int i = 0; err == CJ_ERROR_OK && i < view->constraintDefs.size; ++i) {
+      err = cjConstraintDefCopy(&csp->constraintDefs[view->constraintDefs.data[i]], &out->constraintDefs[i]);
     }
   }
+  if (err == CJ_ERROR_OK && view->constraints.size > 0) {
+    out->constraints = cjConstraintArray(view->constraints.size);
+    if (!out->constraints) { err = CJ_ERROR_NOMEM; }
+    for (int i = 0; err == CJ_ERROR_OK && i < view->constraints.size; ++i) {
+      const CjConstraint* c = &csp->constraints[view->constraints.data[i]];
+      err = cjConstraintAlloc(c->vars.size, &out->constraints[i]);
+      out->constraintsSize = i + 1;
+      if (err != CJ_ERROR_OK) { break; }
+      out->constraints[i].id = cjCspViewConstraintDefOf(view, c->id);
+      for (int iVar = 0; iVar < c->vars.size; ++iVar) {
+        out->constraints[i].vars.data[iVar] = cjCspViewVarOf(view, cjIntTuplesGet(&c->vars, iVar));
+      }
+    }
+  }
+
+  if (err != CJ_ERROR_OK) {
+    cjCspFree(out);
+    return err;
+  }
+  out->validated = csp->validated;
+  return CJ_ERROR_OK;
+}
+
+CjError cjCspViewMemoryUsage(const CjCspView* view, CjMemoryUsage* out) {
+  if (!view || !view->csp || !out) { return CJ_ERROR_ARG; }
+  const CjCsp* csp = view->csp;
+  memset(out, 0, sizeof(CjMemoryUsage));
 
-  *solved = true;
+  cjMemoryAddMeta(&out->meta, &csp->meta);
+  cjMemoryAdd(&out->domains, sizeof(CjDomain) * view->domains.size);
+  for (int i = 0; i < view->domains.size; ++i) {
+    cjMemoryAddDomain(&out->domains, &csp->domains[view->domains.data[i]]);
+  }
+  cjMemoryAddIntTuples(&out->vars, &view->vars);
+  cjMemoryAdd(&out->constraintDefs, sizeof(CjConstraintDef) * view->constraintDefs.size);
+  for (int i = 0; i < view->constraintDefs.size; ++i) {
+    cjMemoryAddConstraintDef(&out->constraintDefs, &csp->constraintDefs[view->constraintDefs.data[i]]);
+  }
+  cjMemoryAdd(&out->constraints, sizeof(CjConstraint) * view->constraints.size);
+  for (int i = 0; i < view->constraints.size; ++i) {
+    cjMemoryAddIntTuples(&out->constraints, &csp->constraints[view->constraints.data[i]].vars);
+  }
+
+  cjMemoryAddTotal(out);
   return CJ_ERROR_OK;
 }
+
+void cjCspViewFree(CjCspView* inout) {
+  if (!inout) { return; }
+  cjIntTuplesFree(&inout->vars);
+  cjIntTuplesFree(&inout->constraints);
+  cjIntTuplesFree(&inout->domains);
+  cjIntTuplesFree(&inout->constraintDefs);
+  inout->csp = NULL;
+}
@@ -1,6 +1,9 @@
 #ifndef __CJ_CSP_H__
 #define __CJ_CSP_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,7 +60,7 @@ typedef enum CjError {
   CJ_ERROR_CONSTRAINTDEF_IS_NOT_OBJECT = -21,
   /** csp-json.constraintDefs[i] is an unknown type (eg. noGoods is known). */
   CJ_ERROR_CONSTRAINTDEF_UNKNOWN_TYPE = -22,
-  /** csp-json.constraintDefs[i].noGoods is not an array. */
+  /** csp-json.constraintDefs[i].noGoods (or goods) is not an array. */
   CJ_ERROR_NOGOODS_IS_NOT_ARRAY = -23,
   /** csp-json.constraintDefs[i].noGoods[j] is not a tuple. */
   CJ_ERROR_NOGOODS_ARRAY_HAS_NOT_A_TUPLE = -24,
@@ -102,8 +105,143 @@ typedef enum CjError {
   CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE = -49,
   CJ_ERROR_VALIDATION_SOLUTION_ARITY = -50,
   CJ_ERROR_VALIDATION_SOLUTION_VARS_SIZE_MISMATCH = -51,
+  /** csp-json.vars.runs is not an array of [domain, count] pairs with count > 0. */
+  CJ_ERROR_VARS_RUNS_IS_NOT_PAIRS = -52,
+  /** CjCsp.varRuns does not have arity 2 and increasing ends, or vars is also set. */
+  CJ_ERROR_VALIDATION_VAR_RUNS = -53,
+  /** csp-json.domains[i].range is not an array of two integers lo <= hi spanning at most INT_MAX values. */
+  CJ_ERROR_DOMAIN_RANGE_IS_NOT_PAIR = -54,
+  /** CjDomain.range has lo > hi or more than INT_MAX values. */
+  CJ_ERROR_VALIDATION_DOMAIN_RANGE = -55,
+  /** csp-json.constraintDefs[i].allDifferent is not an empty object. */
+  CJ_ERROR_ALLDIFFERENT_IS_NOT_EMPTY_OBJECT = -56,
+  /** csp-json.constraintDefs[i].predicate has an unknown op or a bad k. */
+  CJ_ERROR_PREDICATE_INVALID = -57,
+  /** csp-json.constraintDefs[i].noGoodsMdd is not an object of arity, nodes and edges. */
+  CJ_ERROR_MDD_INVALID = -58,
+  /** CjMdd has bad offsets, unsorted edges, unreachable nodes or paths not of its arity. */
+  CJ_ERROR_VALIDATION_MDD = -59,
 } CjError;
 
+////////////////////////////////////////////////////////////////////////////////
+// Allocator
+//
+// Every allocation of the library goes through a CjAllocator: the global one
+// (malloc, realloc and free by default), or the one set for the calling
+// thread. Memory must be freed by the allocator that allocated it, so set
+// allocators before building any csp and keep them while it lives.
+//
+
+typedef struct CjAllocator {
+  /** Like malloc(size). */
+  void* (*allocate)(void* user, size_t size);
+  /** Like realloc(ptr, size). */
+  void* (*reallocate)(void* user, void* ptr, size_t size);
+  /** Like free(ptr), ptr may be null. */
+  void (*deallocate)(void* user, void* ptr);
+  /** Passed to each function, eg. an arena. */
+  void* user;
+} CjAllocator;
+
+/** Set the allocator of every thread without one of its own, null for the default. Not thread safe. */
+void cjSetAllocator(const CjAllocator* allocator);
+
+/**
+ * Set the allocator of the calling thread, null to use the global one again.
+ * Threads the library starts for the call (eg. cjCspNormalizeParallel())
+ * use the allocator of the calling thread.
+ */
+void cjSetThreadAllocator(const CjAllocator* allocator);
+
+/** @return the allocator used by the calling thread. */
+CjAllocator cjGetAllocator();
+
+/** Allocate with cjGetAllocator(), eg. the meta strings of a CjCsp. */
+void* cjMalloc(size_t size);
+void* cjCalloc(size_t count, size_t size);
+void* cjRealloc(void* ptr, size_t size);
+void cjFree(void* ptr);
+
+////////////////////////////////////////////////////////////////////////////////
+// CjStats
+//
+// Optional instrumentation: with CJ_STATS defined at build time, library calls
+// on a thread with a CjStats set (cjSetThreadStats()) add their phase timings
+// and counters to it. Without CJ_STATS the stats stay zero and cost nothing.
+//
+
+/** The timed phases of CjStats. */
+typedef enum CjPhase {
+  /** Splitting json into tokens. */
+  CJ_PHASE_TOKENIZE,
+  /** Decoding tokens into a csp. */
+  CJ_PHASE_PARSE,
+  /** cjCspValidate() and the checks of CJ_PARSE_VALIDATE. */
+  CJ_PHASE_VALIDATE,
+  /** cjCspNormalize() and cjCspNormalizeParallel(). */
+  CJ_PHASE_NORMALIZE,
+  /** cjCspJsonPrint() and cjCspViewJsonPrint(). */
+  CJ_PHASE_PRINT,
+  CJ_PHASE_SIZE
+} CjPhase;
+
+typedef struct CjStats {
+  /** Wall clock nanoseconds spent in each CjPhase. */
+  uint64_t ns[CJ_PHASE_SIZE];
+  /** Json tokens produced by the tokenizer. */
+  uint64_t tokens;
+  /** Integers decoded from json. */
+  uint64_t integers;
+  /** Json bytes parsed. */
+  uint64_t bytesRead;
+  /** Json bytes printed. */
+  uint64_t bytesWritten;
+  /** cjMalloc(), cjCalloc() and cjRealloc() calls of the thread. */
+  uint64_t allocations;
+  /** cjFree() calls of non-null pointers of the thread. */
+  uint64_t frees;
+} CjStats;
+
+/** Zero init a CjStats. */
+CjStats cjStatsInit();
+
+/** @return 1 if the library is built with CJ_STATS, so that CjStats get filled. */
+int cjStatsEnabled();
+
+/**
+ * Add the stats of the calling thread's library calls to (*stats) from now
+ * on, null to stop. Threads the library starts for a call are not counted.
+ */
+void cjSetThreadStats(CjStats* stats);
+
+/** @return the CjStats set for the calling thread, or null. */
+CjStats* cjThreadStats();
+
+/** @return the nanoseconds of a monotonic clock. */
+uint64_t cjStatsNowNs();
+
+/** @return the name of phase, eg. "parse". */
+const char* cjPhaseName(CjPhase phase);
+
+#ifdef CJ_STATS
+/** Add n to the field of the thread stats. */
+#define CJ_STATS_ADD(field, n) do { \
+  CjStats* cjStats_ = cjThreadStats(); \
+  if (cjStats_) { cjStats_->field += (n); } \
+} while (0)
+/** Start timing a phase: declares the start time var. */
+#define CJ_STATS_BEGIN(var) const uint64_t var = cjThreadStats() ? cjStatsNowNs() : 0
+/** Add the time since CJ_STATS_BEGIN(var) to phase. */
+#define CJ_STATS_END(var, phase) do { \
+  CjStats* cjStats_ = cjThreadStats(); \
+  if (cjStats_ && var) { cjStats_->ns[phase] += cjStatsNowNs() - var; } \
+} while (0)
+#else
+#define CJ_STATS_ADD(field, n) do {} while (0)
+#define CJ_STATS_BEGIN(var) do {} while (0)
+#define CJ_STATS_END(var, phase) do {} while (0)
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // CjIntTuples
 //
@@ -117,18 +255,34 @@ typedef enum CjError {
  * 1) 2D: [[1,2], [3,4], [5,6]] has arity =  2, size = 2.
  * 2) 2D:                  [[]] has arity =  0, size = 1.
  * 3) 1D:               [1,2,3] has arity = -1, size = 3.
+ *
+ * API break: width was added before data, so positional initializers such
+ * as {size, arity, data} no longer compile. Start from cjIntTuplesInit() or
+ * cjIntTuplesAlloc(), or use designated initializers that also set width.
  */
 typedef struct CjIntTuples {
   /** The number of tuples */
   int size;
   /** The arity of each tuple */
   int arity;
+  /**
+   * The bytes per value: sizeof(int) (the default), 2 or 1.
+   * See cjIntTuplesNarrow(). Use cjIntTuplesGet() and cjIntTuplesSet() to
+   * access the values whatever the width.
+   */
+  int width;
   /**
    * Holds `size * abs(arity)` entries.
    * If 2D use `data[i*arity + j]` where i in [0, size) and j in [0, arity).
    * If 1D use `data[i]` where i in [0, size).
+   * data is valid if width == sizeof(int), data16 if width == 2 and data8 if
+   * width == 1.
    */
-  int* data;
+  union {
+    int* data;
+    int16_t* data16;
+    int8_t* data8;
+  };
 } CjIntTuples;
 
 /** Zero/null init a CjIntTuples. */
@@ -136,11 +290,39 @@ CjIntTuples cjIntTuplesInit();
 
 /**
  * Initialize and allocate a CjIntTuples and return CJ_ERROR_OK on success.
+ * Values are stored as int.
  * Free the created object with cjIntTuplesFree.
  * @arg arity is -1 for a 1D array, arity is >= 0 for 2D array.
  */
 CjError cjIntTuplesAlloc(int size, int arity, CjIntTuples* out);
 
+/** @return the i-th value of ts, counting values not tuples. */
+static inline int cjIntTuplesGet(const CjIntTuples* ts, size_t i) {
+  switch (ts->width) {
+    case 1:  return ts->data8[i];
+    case 2:  return ts->data16[i];
+    default: return ts->data[i];
+  }
+}
+
+/** Set the i-th value of ts. value must fit in ts->width. */
+static inline void cjIntTuplesSet(CjIntTuples* ts, size_t i, int value) {
+  switch (ts->width) {
+    case 1:  ts->data8[i] = (int8_t) value; break;
+    case 2:  ts->data16[i] = (int16_t) value; break;
+    default: ts->data[i] = value; break;
+  }
+}
+
+/**
+ * Store the values of ts in the narrowest width (1, 2 or sizeof(int)) that
+ * holds all of them. Values are unchanged.
+ */
+CjError cjIntTuplesNarrow(CjIntTuples* ts);
+
+/** Store the values of ts as int again, so that ts->data is valid. */
+CjError cjIntTuplesWiden(CjIntTuples* ts);
+
 /** Free a CjIntTuples. */
 void cjIntTuplesFree(CjIntTuples* inout);
 
@@ -153,6 +335,50 @@ CjIntTuples* cjIntTuplesArray(int size);
 /** (1) free each item (2) free the array (3) set pointer to null. */
 void cjIntTuplesArrayFree(CjIntTuples** inout, int size);
 
+////////////////////////////////////////////////////////////////////////////////
+// CjTableIndex
+//
+// An optional hash index over the tuples of a CjIntTuples table.
+//
+
+/**
+ * An open-addressing hash set of the tuples of a table, with a Bloom filter
+ * in front of it, for expected O(arity) lookups instead of a linear scan.
+ * The index does not copy the tuples: it refers to the table by position and
+ * is only valid as long as the table is not modified.
+ */
+typedef struct CjTableIndex {
+  /** The number of slots, a power of 2, or 0 if the table is not indexed. */
+  int capacity;
+  /** 1 + the index of the tuple in each slot, 0 for an empty slot. */
+  int* slots;
+  /** The number of 64 bit words in bloom, a power of 2. */
+  int bloomWords;
+  /** A Bloom filter with 2 bits set per tuple. */
+  uint64_t* bloom;
+} CjTableIndex;
+
+/** Zero/null init a CjTableIndex. */
+CjTableIndex cjTableIndexInit();
+
+/**
+ * Index the tuples of a 2D table.
+ * Free the created object with cjTableIndexFree.
+ */
+CjError cjTableIndexAlloc(const CjIntTuples* table, CjTableIndex* out);
+
+/**
+ * @return the index of tuple in table or -1 if it is not in table. table must
+ * be the one index was allocated for. Scans the table if it is not indexed.
+ */
+int cjTableIndexFind(const CjTableIndex* index, const CjIntTuples* table, const int* tuple);
+
+/** Free a CjTableIndex. */
+void cjTableIndexFree(CjTableIndex* inout);
+
+/** (1) free each item (2) free the array (3) set pointer to null. */
+void cjTableIndexArrayFree(CjTableIndex** inout, int size);
+
 ////////////////////////////////////////////////////////////////////////////////
 // CjMeta
 //
@@ -178,13 +404,21 @@ void cjMetaFree(CjMeta* inout);
 
 /** The Domain of a CSP variable. */
 typedef struct CjDomain {
-  enum {CJ_DOMAIN_UNDEF, CJ_DOMAIN_VALUES, CJ_DOMAIN_SIZE} type;
+  enum {CJ_DOMAIN_UNDEF, CJ_DOMAIN_VALUES, CJ_DOMAIN_RANGE, CJ_DOMAIN_SIZE} type;
   union {
     /**
      * Explicitly list the values of the domain, one by one.
      * This union field is only used if type == CJ_DOMAIN_VALUES.
      **/
     CjIntTuples values;
+    /**
+     * All the values from lo to hi inclusive, without listing them.
+     * This union field is only used if type == CJ_DOMAIN_RANGE.
+     */
+    struct {
+      int lo;
+      int hi;
+    } range;
   };
 } CjDomain;
 
@@ -197,8 +431,24 @@ CjDomain cjDomainInit();
  * Free the resulting struct with cjDomainFree().
  */
 CjError cjDomainValuesAlloc(int size, CjDomain* out);
+
+/**
+ * Init a domain of the values lo to hi inclusive. Nothing is allocated.
+ * Return 0 on success, CJ_ERROR_ARG if lo > hi or the range has more than
+ * INT_MAX values.
+ */
+CjError cjDomainRangeInit(int lo, int hi, CjDomain* out);
 void cjDomainFree(CjDomain* inout);
 
+/**
+ * @return the number of values of domain. Validated domains have at most
+ * INT_MAX values; larger ranges are clamped to INT_MAX.
+ */
+int cjDomainSize(const CjDomain* domain);
+
+/** @return 1 if value is in domain, 0 otherwise. O(1) for ranges. */
+int cjDomainHasValue(const CjDomain* domain, int value);
+
 /**
  * Allocate an array of CjDomain and cjDomainInit() each item.
  * @return null on memory allocation error.
@@ -208,14 +458,149 @@ CjDomain* cjDomainArray(int size);
 /** (1) free each item (2) free the array (3) set pointer to null. */
 void cjDomainArrayFree(CjDomain** inout, int size);
 
+////////////////////////////////////////////////////////////////////////////////
+// CjValueIndex
+//
+// A bijection between the values of a domain and the dense indexes 0..d-1.
+//
+
+/**
+ * Maps the d values of a domain to 0..d-1 in increasing value order and
+ * back, so that values can index arrays and bitsets.
+ */
+typedef struct CjValueIndex {
+  enum {
+    /** A range domain: index = value - lo. Nothing is allocated. */
+    CJ_VALUE_INDEX_RANGE,
+    /** Values spanning at most 4 * d ints: slots[value - lo]. */
+    CJ_VALUE_INDEX_DENSE,
+    /**
+     * Sparse values: a collision-free (perfect) hash into slots, by hash and
+     * displace: the values are hashed into buckets, then each bucket gets
+     * the displacement that sends its values to free slots. It is not
+     * minimal: slotsSize is at least 2 * size.
+     */
+    CJ_VALUE_INDEX_HASH
+  } type;
+  /** The number of values d. */
+  int size;
+  /** The smallest value. */
+  int lo;
+  /** 1D: the values by increasing index. Empty for CJ_VALUE_INDEX_RANGE. */
+  CjIntTuples values;
+  /** 1 + the index of the value of each slot, 0 for empty slots. */
+  int slotsSize;
+  int* slots;
+  /** CJ_VALUE_INDEX_HASH: the number of buckets, a power of 2, and their displacements. */
+  int bucketsSize;
+  int* displacements;
+} CjValueIndex;
+
+/** Zero/null init a CjValueIndex. */
+CjValueIndex cjValueIndexInit();
+
+/**
+ * Index the values of domain.
+ * Free the created object with cjValueIndexFree.
+ */
+CjError cjValueIndexAlloc(const CjDomain* domain, CjValueIndex* out);
+
+/** @return the index of value, or -1 if value is not in the domain. O(1). */
+int cjValueIndexOf(const CjValueIndex* index, int value);
+
+/** @return the value of index i in [0, index->size). */
+int cjValueIndexValue(const CjValueIndex* index, int i);
+
+/** Free a CjValueIndex. */
+void cjValueIndexFree(CjValueIndex* inout);
+
+/** (1) free each item (2) free the array (3) set pointer to null. */
+void cjValueIndexArrayFree(CjValueIndex** inout, int size);
+
 ////////////////////////////////////////////////////////////////////////////////
 // CjConstraintDef
 
+/** The operators of predicate constraintDefs. */
+typedef enum CjPredicateOp {
+  /** x == y */
+  CJ_PREDICATE_EQ,
+  /** x != y */
+  CJ_PREDICATE_NEQ,
+  /** x < y */
+  CJ_PREDICATE_LT,
+  /** x <= y */
+  CJ_PREDICATE_LE,
+  /** x > y */
+  CJ_PREDICATE_GT,
+  /** x >= y */
+  CJ_PREDICATE_GE,
+  /** |x - y| == k */
+  CJ_PREDICATE_ABS_DIFF_EQ,
+  /** |x - y| != k */
+  CJ_PREDICATE_ABS_DIFF_NEQ,
+  CJ_PREDICATE_SIZE
+} CjPredicateOp;
+
+/** @return 1 if `x op y` holds (k is the constant of CJ_PREDICATE_ABS_DIFF_*). */
+int cjPredicateHolds(CjPredicateOp op, int k, int x, int y);
+
+/**
+ * A reduced multi-valued decision diagram (MDD) of a set of tuples, stored as
+ * flat arrays. Node i has the edges [nodes[i], nodes[i+1]) of edges, each a
+ * [value, child] pair, in increasing value order. A tuple is in the set if
+ * following its values from the root, the last node, takes arity edges: the
+ * edges of the last level have child -1. Children are stored before their
+ * parents and no two nodes have the same edges, so that equal sets have
+ * equal MDDs.
+ */
+typedef struct CjMdd {
+  /** The arity of the tuples, >= 1. */
+  int arity;
+  /** 1D: the number of nodes + 1 offsets into edges. */
+  CjIntTuples nodes;
+  /** 2D of arity 2: the [value, child] edges. */
+  CjIntTuples edges;
+} CjMdd;
+
+/** Zero/null init a CjMdd. */
+CjMdd cjMddInit();
+
+/**
+ * Build the MDD of the tuples of a 2D table of arity >= 1, in any order and
+ * possibly with duplicates.
+ * Free the created object with cjMddFree.
+ */
+CjError cjMddAlloc(const CjIntTuples* tuples, CjMdd* out);
+
+/** @return CJ_ERROR_OK if mdd is well formed, see CjMdd, else CJ_ERROR_VALIDATION_MDD. */
+CjError cjMddValidate(const CjMdd* mdd);
+
+/**
+ * @return 1 if tuple, of mdd->arity values, is in mdd, 0 otherwise.
+ * O(arity log(values)). mdd must validate, see cjCspValidate().
+ */
+int cjMddHas(const CjMdd* mdd, const int* tuple);
+
+/**
+ * Allocate out with the tuples of mdd in lexicographic order.
+ * Free the created object with cjIntTuplesFree.
+ * @return CJ_ERROR_VALIDATION_MDD if mdd is not well formed.
+ */
+CjError cjMddExpand(const CjMdd* mdd, CjIntTuples* out);
+
+/** Free a CjMdd. */
+void cjMddFree(CjMdd* inout);
+
 /** A constraint definition. */
 typedef struct CjConstraintDef {
   enum {
     CJ_CONSTRAINT_DEF_UNDEF,
     CJ_CONSTRAINT_DEF_NO_GOODS,
+    /** The values of the constraint vars must be pairwise different. No fields. */
+    CJ_CONSTRAINT_DEF_ALL_DIFFERENT,
+    CJ_CONSTRAINT_DEF_PREDICATE,
+    CJ_CONSTRAINT_DEF_GOODS,
+    CJ_CONSTRAINT_DEF_NO_GOODS_MDD,
     CJ_CONSTRAINT_DEF_SIZE
   } type;
 
@@ -225,6 +610,27 @@ typedef struct CjConstraintDef {
      * This union field is used only if type == CJ_CONSTRAINT_DEF_NO_GOODS.
      */
     CjIntTuples noGoods;
+    /**
+     * List the combination of values that are valid: every other
+     * combination of values of the domains is invalid.
+     * This union field is used only if type == CJ_CONSTRAINT_DEF_GOODS.
+     */
+    CjIntTuples goods;
+    /**
+     * A binary constraint allowing the values (x, y) of vars [0, 1] for
+     * which `x op y` holds, eg. x != y. See cjPredicateHolds().
+     * This union field is used only if type == CJ_CONSTRAINT_DEF_PREDICATE.
+     */
+    struct {
+      CjPredicateOp op;
+      /** The constant of CJ_PREDICATE_ABS_DIFF_*, 0 otherwise. */
+      int k;
+    } predicate;
+    /**
+     * The invalid combinations of values like noGoods, compressed as an MDD.
+     * This union field is used only if type == CJ_CONSTRAINT_DEF_NO_GOODS_MDD.
+     */
+    CjMdd noGoodsMdd;
   };
 } CjConstraintDef;
 
@@ -238,6 +644,38 @@ CjConstraintDef cjConstraintDefInit();
  * Free the resulting struct with cjConstraintDefFree().
  */
 CjError cjConstraintDefNoGoodAlloc(int size, int arity, CjConstraintDef* out);
+
+/**
+ * Init & allocate a constraint def based on a goods definition.
+ * Return 0 on success.
+ * Free the resulting struct with cjConstraintDefFree().
+ */
+CjError cjConstraintDefGoodAlloc(int size, int arity, CjConstraintDef* out);
+
+/**
+ * Init an all-different constraint def. It applies to constraints of any
+ * number of vars. Nothing is allocated.
+ */
+void cjConstraintDefAllDifferentInit(CjConstraintDef* out);
+
+/**
+ * Init a binary predicate constraint def `x op y`. Nothing is allocated.
+ * @arg k is the constant of CJ_PREDICATE_ABS_DIFF_* and must be 0 otherwise.
+ */
+CjError cjConstraintDefPredicateInit(CjPredicateOp op, int k, CjConstraintDef* out);
+
+/**
+ * Replace the table of a no-goods def of arity >= 1 by its MDD, making it a
+ * CJ_CONSTRAINT_DEF_NO_GOODS_MDD def. def is unchanged on error.
+ */
+CjError cjConstraintDefCompressMdd(CjConstraintDef* def);
+
+/**
+ * Turn a CJ_CONSTRAINT_DEF_NO_GOODS_MDD def back into a no-goods def whose
+ * tuples are sorted and unique. def is unchanged on error.
+ */
+CjError cjConstraintDefExpandMdd(CjConstraintDef* def);
+
 void cjConstraintDefFree(CjConstraintDef* inout);
 
 /**
@@ -285,20 +723,53 @@ void cjConstraintArrayFree(CjConstraint** inout, int size);
 // The CSP-JSON instance object itself.
 //
 
+/** The reference count of the parts of a csp shared between clones, see cjCspClone(). */
+typedef struct CjRefCount CjRefCount;
+
 typedef struct CjCsp {
   CjMeta meta;
 
   int domainsSize;
   CjDomain* domains;
 
-  /** Each variable references a domain above. Arity is 0. */
+  /**
+   * Each variable references a domain above. Arity is -1.
+   * Empty when the vars are run-length encoded in varRuns instead.
+   */
   CjIntTuples vars;
 
+  /**
+   * Run-length encoded vars, used instead of vars when varRuns.size > 0.
+   * Tuples are [domain, end] (arity 2) with increasing ends: variables from
+   * the previous end (or 0) up to end - 1 reference domain.
+   * Use cjCspVarsSize() and cjCspVarDomain() to read vars in either form.
+   */
+  CjIntTuples varRuns;
+
   int constraintDefsSize;
   CjConstraintDef* constraintDefs;
 
   int constraintsSize;
   CjConstraint* constraints;
+
+  /**
+   * Non-null when vars and varRuns (resp. constraintDefs, constraints) may be
+   * shared with a clone and must not be modified in place: call
+   * cjCspUnshareVars() (resp. cjCspUnshareConstraintDef(),
+   * cjCspUnshareConstraint() or their whole array versions) before modifying
+   * them directly.
+   */
+  CjRefCount* varsRefs;
+  CjRefCount* constraintDefsRefs;
+  CjRefCount* constraintsRefs;
+
+  /**
+   * Non-zero if the csp is known to pass cjCspValidate(), eg. it was parsed
+   * with CJ_PARSE_VALIDATE. Library functions then skip validating it again
+   * and keep the flag as they preserve validity. Reset it to 0 after
+   * modifying the fields of a validated csp directly.
+   */
+  int validated;
 } CjCsp;
 
 /**
@@ -308,25 +779,346 @@ typedef struct CjCsp {
 CjCsp cjCspInit();
 void cjCspFree(CjCsp* inout);
 
+/**
+ * Init (*out) to a copy of csp that shares the vars, constraintDefs and
+ * constraints of csp (and their tables) instead of copying them, in
+ * O(domains). Library functions copy what they modify first, so csp and
+ * (*out) never see each other's changes. Cloning the same csp from several
+ * threads needs a lock; freeing or modifying the clones does not.
+ * Free (*out) with cjCspFree().
+ */
+CjError cjCspClone(CjCsp* csp, CjCsp* out);
+
+/** Give csp its own copy of vars and varRuns if they are shared with a clone. */
+CjError cjCspUnshareVars(CjCsp* csp);
+
+/** Give csp its own copy of every constraintDef that is shared with a clone. */
+CjError cjCspUnshareConstraintDefs(CjCsp* csp);
+
+/** Give csp its own copy of every constraint that is shared with a clone. */
+CjError cjCspUnshareConstraints(CjCsp* csp);
+
+/**
+ * Give csp its own copy of constraintDefs[iDef] if it is shared with a
+ * clone. Only the tables of that def are copied: the array itself is copied
+ * shallowly, in O(constraintDefsSize), the first time.
+ */
+CjError cjCspUnshareConstraintDef(CjCsp* csp, int iDef);
+
+/** cjCspUnshareConstraintDef() for constraints[iC]. */
+CjError cjCspUnshareConstraint(CjCsp* csp, int iC);
+
+/** The memory of one part of a csp, see CjMemoryUsage. */
+typedef struct CjMemorySection {
+  /** Bytes of the buffers the csp points to, excluding allocator overhead. */
+  size_t bytes;
+  /** Number of non-null buffers. */
+  size_t allocations;
+  /** Bytes cjCspNarrow() would save: values stored wider than needed. */
+  size_t wasted;
+} CjMemorySection;
+
+/** The memory footprint of a csp, by section. */
+typedef struct CjMemoryUsage {
+  CjMemorySection meta;
+  CjMemorySection domains;
+  /** vars and varRuns. */
+  CjMemorySection vars;
+  CjMemorySection constraintDefs;
+  CjMemorySection constraints;
+  /** The sum of the sections above. */
+  CjMemorySection total;
+} CjMemoryUsage;
+
+/**
+ * Measure the memory csp points to. Arrays shared with clones (see
+ * cjCspClone()) are counted in full by each clone. O(csp) as measuring
+ * wasted bytes scans the tables.
+ */
+CjError cjCspMemoryUsage(const CjCsp* csp, CjMemoryUsage* out);
+
+/** @return the number of variables of csp, whichever form vars are in. */
+int cjCspVarsSize(const CjCsp* csp);
+
+/**
+ * @return the domain referenced by variable iVar in [0, cjCspVarsSize()).
+ * O(log runs) when the vars are run-length encoded.
+ */
+int cjCspVarDomain(const CjCsp* csp, int iVar);
+
+/** Move vars to the run-length encoded varRuns. Memory is O(runs). */
+CjError cjCspVarsCompress(CjCsp* csp);
+
+/** Move varRuns back to the one int per variable vars. */
+CjError cjCspVarsExpand(CjCsp* csp);
+
+/**
+ * cjIntTuplesNarrow() every table of the csp: domain values, vars, varRuns,
+ * no-goods and constraint vars. Functions of this library accept any width.
+ */
+CjError cjCspNarrow(CjCsp* csp);
+
+/** cjIntTuplesWiden() every table of the csp. */
+CjError cjCspWiden(CjCsp* csp);
+
 /**
  * @return CJ_ERROR_OK only if the CSP instance is valid.
  * Eg. check that the indexes in vars are valid in domains.
  */
 CjError cjCspValidate(const CjCsp* csp);
 
+/**
+ * The parts of cjCspValidate(), for validating a csp while it is built:
+ * domains, then vars (once domains are set), then constraintDefs, then each
+ * constraint (once vars and constraintDefs are set).
+ */
+CjError cjCspValidateDomains(const CjCsp* csp);
+CjError cjCspValidateVars(const CjCsp* csp);
+CjError cjCspValidateConstraintDefs(const CjCsp* csp);
+CjError cjCspValidateConstraint(const CjCsp* csp, const CjConstraint* c);
+
+/** @return 1 if err is one of the errors of a csp failing cjCspValidate(). */
+int cjErrorIsValidation(CjError err);
+
 /**
  * Transforms the CSP in-place to a normal form (eg. sort domain and no-good
- * values).
+ * values). No-goods of any arity are sorted lexicographically by tuple.
+ */
+CjError cjCspNormalize(CjCsp* csp);
+
+/**
+ * cjCspNormalize() with the domains and constraintDefs sorted on numThreads
+ * threads. Tables much bigger than the rest are split across threads too.
+ * @arg numThreads <= 0 uses one thread per online CPU.
+ * Built without CJ_THREADS, the sort runs on the calling thread.
+ */
+CjError cjCspNormalizeParallel(CjCsp* csp, int numThreads);
+
+/**
+ * Merge constraintDefs that have identical tables and remap CjConstraint.id
+ * to the surviving (first) def. The csp is normalized first so that tables
+ * listing the same tuples in a different order are merged.
+ * @arg matchTransposed if non-zero, a binary def whose transpose is identical
+ *      to an earlier def is merged as well and the vars of the constraints
+ *      that referenced it are swapped.
+ */
+CjError cjCspDedupConstraintDefs(CjCsp* csp, int matchTransposed);
+
+/**
+ * Transforms the CSP in-place to a canonical form so that equivalent
+ * instances print identically:
+ * (1) binary constraints are oriented so that vars[0] <= vars[1], using a
+ *     transposed copy of the def where needed, and the vars of
+ *     all-different constraints are sorted,
+ * (2) the csp is normalized and identical defs are merged,
+ * (3) constraints are sorted by vars then by def content,
+ * (4) defs are renumbered in first-use order and unused defs are dropped.
+ * Domains and vars are left as they are.
+ */
+CjError cjCspCanonicalize(CjCsp* csp);
+
+/**
+ * Store each noGoods or goods def as whichever of the two lists fewer
+ * tuples, relative to the product of the domains of the vars it constrains.
+ * Tuples with values outside those domains are dropped. Defs shared by
+ * constraints over different domains are left as they are.
+ * The csp is normalized first.
+ */
+CjError cjCspCompactTables(CjCsp* csp);
+
+/**
+ * cjConstraintDefCompressMdd() every no-goods def of at least minSize tuples.
+ */
+CjError cjCspCompressMdd(CjCsp* csp, int minSize);
+
+/** cjConstraintDefExpandMdd() every MDD def. */
+CjError cjCspExpandMdd(CjCsp* csp);
+
+/**
+ * Allocate one CjValueIndex per domain of csp.
+ * Free the created array with cjValueIndexArrayFree(out, csp->domainsSize).
+ */
+CjError cjCspBuildValueIndex(const CjCsp* csp, CjValueIndex** out);
+
+/**
+ * Rewrite the values of csp into index space using indexes from
+ * cjCspBuildValueIndex(): each domain becomes the range [0, d-1] and the
+ * values of the noGoods, goods and MDD defs become the indexes of the
+ * domains of the vars they constrain. Tuples with values outside those
+ * domains are dropped.
+ * @return CJ_ERROR_ARG if csp has predicates, an allDifferent or table
+ *         def over different domains, which index space cannot express.
+ */
+CjError cjCspToIndexSpace(CjCsp* csp, const CjValueIndex* indexes);
+
+/** Undo cjCspToIndexSpace() with the same indexes. */
+CjError cjCspFromIndexSpace(CjCsp* csp, const CjValueIndex* indexes);
+
+/**
+ * Rewrite the values of a solution of csp into the indexes of the domains
+ * of their vars, in place.
+ * @return CJ_ERROR_ARG if a value is not in the domain of its var.
+ */
+CjError cjCspSolutionToIndexSpace(const CjCsp* csp, const CjValueIndex* indexes, CjIntTuples* solution);
+
+/** Undo cjCspSolutionToIndexSpace(). */
+CjError cjCspSolutionFromIndexSpace(const CjCsp* csp, const CjValueIndex* indexes, CjIntTuples* solution);
+
+/**
+ * Replace every predicate constraint by an equivalent no-goods constraint
+ * for consumers that only understand tables. One no-goods def is added per
+ * (predicate def, domain of vars[0], domain of vars[1]) combination used and
+ * predicate defs that end up unused are removed. Constraints whose predicate
+ * holds for every pair of values are removed too, as they forbid nothing.
+ * @return CJ_ERROR_NOMEM if an expansion has more than INT_MAX / 2 no-goods.
  */
-CjError cjCspNormalize(const CjCsp* csp);
+CjError cjCspExpandPredicates(CjCsp* csp);
 
 /**
  * @return CJ_ERROR_OK if solution solves csp,
  *         CJ_ERROR_NOT_SOLUTION if solution validates but does not solve csp,
  *         other error if the solution or csp does not validate.
+ * (*solved) is only written when CJ_ERROR_OK is returned.
  */
 CjError cjCspIsSolved(const CjCsp* csp, const CjIntTuples* solution, int* solved);
 
+/**
+ * Allocate one CjTableIndex per constraintDef, indexing the noGoods and goods
+ * tables of at least minSize tuples. The other items are left unindexed.
+ * Free the created array with cjTableIndexArrayFree(out, csp->constraintDefsSize).
+ */
+CjError cjCspTableIndexArrayAlloc(const CjCsp* csp, int minSize, CjTableIndex** out);
+
+/**
+ * cjCspIsSolved() looking tuples up in indexes, as allocated by
+ * cjCspTableIndexArrayAlloc(), for checking many solutions of the same csp.
+ */
+CjError cjCspIsSolvedIndexed(const CjCsp* csp, const CjTableIndex* indexes, const CjIntTuples* solution, int* solved);
+
+////////////////////////////////////////////////////////////////////////////////
+// CjCspBuilder
+//
+// Builds a CjCsp of unknown size one element at a time. The arrays of the csp
+// grow geometrically, so each append is amortized O(1).
+//
+
+typedef struct CjCspBuilder {
+  /**
+   * The csp built so far: sizes count the added elements. Set csp.meta
+   * directly (cjMalloc()'d strings, owned by the builder).
+   */
+  CjCsp csp;
+  /** Allocated entries of csp.domains, csp.vars, csp.constraintDefs and csp.constraints. */
+  int domainsCapacity;
+  int varsCapacity;
+  int constraintDefsCapacity;
+  int constraintsCapacity;
+} CjCspBuilder;
+
+/** Zero/null init a CjCspBuilder. Free it with cjCspBuilderFree(). */
+CjCspBuilder cjCspBuilderInit();
+
+/**
+ * Append a domain, moved into the builder: (*domain) is reset to
+ * cjDomainInit() on success and left untouched on error.
+ */
+CjError cjCspBuilderAddDomain(CjCspBuilder* b, CjDomain* domain);
+
+/** Append a variable referencing the domain at index domain. */
+CjError cjCspBuilderAddVar(CjCspBuilder* b, int domain);
+
+/** Append a constraintDef, moved into the builder like cjCspBuilderAddDomain(). */
+CjError cjCspBuilderAddConstraintDef(CjCspBuilder* b, CjConstraintDef* def);
+
+/** Append a constraint of constraintDef id over vars[0..varsSize). */
+CjError cjCspBuilderAddConstraint(CjCspBuilder* b, int id, const int* vars, int varsSize);
+
+/**
+ * Move the built csp into (*out), trimming the spare capacity, and reset the
+ * builder. Free (*out) with cjCspFree().
+ */
+CjError cjCspBuilderFinish(CjCspBuilder* b, CjCsp* out);
+
+/** Free the csp built so far. */
+void cjCspBuilderFree(CjCspBuilder* b);
+
+////////////////////////////////////////////////////////////////////////////////
+// CjCspView
+//
+// The sub-csp induced by a subset of the variables of a csp: the selected
+// vars and the constraints over them only. A view references its parent csp
+// instead of copying it.
+//
+
+/** A var-to-constraint index of a csp, in compressed sparse row form. */
+typedef struct CjVarConstraints {
+  /** 1D, vars + 1 entries: the constraints of var i are at [offsets[i], offsets[i + 1]). */
+  CjIntTuples offsets;
+  /** 1D: the constraints of each var in increasing order, once per occurrence. */
+  CjIntTuples constraints;
+} CjVarConstraints;
+
+/** Zero/null init a CjVarConstraints. */
+CjVarConstraints cjVarConstraintsInit();
+
+/** Index the constraints of csp by var in O(constraint vars). */
+CjError cjVarConstraintsAlloc(const CjCsp* csp, CjVarConstraints* out);
+
+void cjVarConstraintsFree(CjVarConstraints* inout);
+
+typedef struct CjCspView {
+  /** The parent csp, which must outlive the view and not change meanwhile. */
+  const CjCsp* csp;
+  /** 1D, increasing: var i of the view is var vars.data[i] of csp. */
+  CjIntTuples vars;
+  /** 1D, increasing: the constraints of csp whose vars are all in the view. */
+  CjIntTuples constraints;
+  /** 1D, increasing: the domains of csp the vars of the view use. */
+  CjIntTuples domains;
+  /** 1D, increasing: the constraintDefs of csp the constraints of the view use. */
+  CjIntTuples constraintDefs;
+} CjCspView;
+
+/** Zero/null init a CjCspView. */
+CjCspView cjCspViewInit();
+
+/**
+ * Init (*out) to the view of csp over vars[0..varsSize), which must be distinct
+ * vars of csp. Pass the cjVarConstraintsAlloc() of csp to build views in time
+ * linear in the selected vars and their constraints; with a null
+ * varConstraints one is built for the call. Free with cjCspViewFree().
+ */
+CjError cjCspViewAlloc(
+  const CjCsp* csp, const CjVarConstraints* varConstraints, const int* vars, int varsSize, CjCspView* out);
+
+/** @return the var of the view for var of the parent csp, -1 if not in the view. */
+int cjCspViewVarOf(const CjCspView* view, int var);
+
+/** @return the domain of the view for domain iDom of the parent csp, -1 if unused. */
+int cjCspViewDomainOf(const CjCspView* view, int iDom);
+
+/** @return the constraintDef of the view for constraintDef iDef of the parent csp, -1 if unused. */
+int cjCspViewConstraintDefOf(const CjCspView* view, int iDef);
+
+/** cjCspIsSolved() of the view: solution assigns the vars of the view. */
+CjError cjCspViewIsSolved(const CjCspView* view, const CjIntTuples* solution, int* solved);
+
+/**
+ * Copy the view into a standalone csp with the domains and constraintDefs the
+ * view uses. Free (*out) with cjCspFree().
+ */
+CjError cjCspViewMaterialize(const CjCspView* view, CjCsp* out);
+
+/**
+ * cjCspMemoryUsage() of the parts of the parent csp the view selects, ie. what
+ * cjCspViewMaterialize() would copy, without copying them. The view itself
+ * only holds the vars section and the small domains, constraintDefs and
+ * constraints index arrays.
+ */
+CjError cjCspViewMemoryUsage(const CjCspView* view, CjMemoryUsage* out);
+
+void cjCspViewFree(CjCspView* inout);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
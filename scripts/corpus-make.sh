@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+#
+# Generate the benchmark corpus listed in data/corpus/corpus.tsv into OUT_DIR
+# and write OUT_DIR/manifest.sha256. The instances are too large for git, but
+# cj-gen-urbcsp is deterministic so the same inputs come back on any machine:
+# -c checks them against the hashes in data/corpus/manifest.sha256.
+#
+# Usage: corpus-make.sh [-e CJ_GEN_URBCSP] [-o OUT_DIR] [-t TIERS] [-c]
+#   -e the cj-gen-urbcsp binary (default: build/tools/cj-gen-urbcsp/cj-gen-urbcsp)
+#   -o the output directory (default: build/corpus)
+#   -t comma separated tiers among xs,s,m,l,xl (default: xs,s,m)
+#   -c fail unless every instance matches its reference hash
+#
+# Instances that already match their reference hash are not generated again.
+# The xl tier takes ~8GB of disk and up to ~3GB of memory per instance.
+
+set -e
+
+CJ_DIR=$(cd "$(dirname "$0")/.." && pwd)
+CORPUS="${CJ_DIR}/data/corpus/corpus.tsv"
+REFERENCE="${CJ_DIR}/data/corpus/manifest.sha256"
+
+EXE="${CJ_DIR}/build/tools/cj-gen-urbcsp/cj-gen-urbcsp"
+OUT_DIR="${CJ_DIR}/build/corpus"
+TIERS="xs,s,m"
+CHECK=0
+while getopts "e:o:t:c" opt; do
+  case "${opt}" in
+    e) EXE="${OPTARG}" ;;
+    o) OUT_DIR="${OPTARG}" ;;
+    t) TIERS="${OPTARG}" ;;
+    c) CHECK=1 ;;
+    *) sed -n '8,12p' "$0" >&2; exit 1 ;;
+  esac
+done
+
+if command -v sha256sum >/dev/null; then
+  SHA256="sha256sum"
+else
+  SHA256="shasum -a 256"
+fi
+
+mkdir -p "${OUT_DIR}"
+MANIFEST="${OUT_DIR}/manifest.sha256"
+: > "${MANIFEST}"
+FAILED=0
+while IFS=$'\t' read -r NAME TIER N D C T S I K; do
+  case "${NAME}" in ''|'#'*) continue ;; esac
+  case ",${TIERS}," in *",${TIER},"*) ;; *) continue ;; esac
+
+  FILE="${NAME}.json"
+  EXPECTED=$(awk -v f="${FILE}" '$2 == f { print $1 }' "${REFERENCE}")
+  HASH=""
+  if [ -f "${OUT_DIR}/${FILE}" ] && [ -n "${EXPECTED}" ]; then
+    HASH=$(${SHA256} "${OUT_DIR}/${FILE}" | cut -d ' ' -f 1)
+  fi
+  if [ -z "${HASH}" ] || [ "${HASH}" != "${EXPECTED}" ]; then
+    echo "generating ${FILE}: cj-gen-urbcsp ${N} ${D} ${C} ${T} ${S} ${I} ${K}" >&2
+    "${EXE}" "${N}" "${D}" "${C}" "${T}" "${S}" "${I}" "${K}" > "${OUT_DIR}/${FILE}"
+    HASH=$(${SHA256} "${OUT_DIR}/${FILE}" | cut -d ' ' -f 1)
+  fi
+  echo "${HASH}  ${FILE}" >> "${MANIFEST}"
+
+  if [ "${CHECK}" -eq 1 ] && [ "${HASH}" != "${EXPECTED}" ]; then
+    echo "MISMATCH ${FILE}: ${HASH} != ${EXPECTED:-no reference hash}" >&2
+    FAILED=1
+  fi
+done < "${CORPUS}"
+
+exit "${FAILED}"
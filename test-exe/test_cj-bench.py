@@ -0,0 +1,47 @@
+import json
+import pytest
+import shlex
+import subprocess
+
+@pytest.fixture(scope="session")
+def exe(pytestconfig):
+    return pytestconfig.getoption("exe")
+
+def test_cj_bench(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--warmup', '0', '--reps', '3', '--scale', '20,4,30,5', '--scale', '10,3,5,2'], capture_output=True)
+    assert r.returncode == 0, r.stderr
+    bench = json.loads(r.stdout.decode('utf-8'))
+    assert bench['reps'] == 3
+    assert [s['n'] for s in bench['scales']] == [20, 10]
+    for scale in bench['scales']:
+        assert scale['jsonBytes'] > 0
+        assert scale['maxRssKb'] > 0
+        assert scale['memory']['usageBytes'] > 0
+        assert scale['memory']['usageBytes'] == scale['memory']['heapBytes']
+        assert scale['memory']['usageBytes'] <= scale['maxRssKb'] * 1024
+        assert [r['op'] for r in scale['results']] == ['parse', 'print', 'validate', 'normalize', 'isSolved']
+        for result in scale['results']:
+            ns = result['ns']
+            assert ns['min'] <= ns['p50'] <= ns['p90'] <= ns['p99'] <= ns['max']
+        assert scale['results'][0]['peakBytes'] > 0
+
+def test_cj_bench_invalid_scale(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--scale', 'huge'], capture_output=True)
+    assert r.returncode == 1
+    r = subprocess.run(shlex.split(str(exe)) + ['--scale', '1,4,30,5'], capture_output=True)
+    assert r.returncode == 1
+    r = subprocess.run(shlex.split(str(exe)) + ['--scale', '10,3,5,9'], capture_output=True)
+    assert r.returncode == 1
+    r = subprocess.run(shlex.split(str(exe)) + ['--scale', '10,1,5,0'], capture_output=True)
+    assert r.returncode == 1
+    r = subprocess.run(shlex.split(str(exe)) + ['--scale', '10,3,5,0'], capture_output=True)
+    assert r.returncode == 1
+
+@pytest.mark.parametrize('flag,value', [
+    ('--warmup', 'x'), ('--warmup', '-1'), ('--reps', '0'), ('--reps', '3x'),
+    ('--threads', ''), ('--threads', '-2'), ('--seed', '1.5'), ('--seed', '4294967296'),
+])
+def test_cj_bench_invalid_flag(exe, flag, value):
+    r = subprocess.run(shlex.split(str(exe)) + [flag, value, '--scale', '10,3,5,2'], capture_output=True)
+    assert r.returncode == 1
+    assert r.stdout == b''
@@ -1,3 +1,4 @@
+import json
 import pytest
 import shlex
 import subprocess
@@ -23,3 +24,120 @@ def test_cj_echo(filepath, exe):
         r = run_cj_echo(exe, str(filepath))
         assert r.returncode == 0
         assert csp == r.stdout.decode('utf-8')
+
+def test_cj_echo_dedup(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--dedup', '--csp', str(base/'test/data/duplicate-defs.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''  "constraintDefs": [
+    {"noGoods": [[0, 1], [1, 2]]},
+    {"noGoods": [[1, 0], [2, 1]]}
+  ],
+  "constraints": [
+    {"id": 0, "vars": [0, 1]},
+    {"id": 0, "vars": [1, 2]},
+    {"id": 1, "vars": [0, 2]}
+  ]
+''' in r.stdout.decode('utf-8')
+
+def test_cj_echo_dedup_transposed(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--dedup-transposed', '--csp', str(base/'test/data/duplicate-defs.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''  "constraintDefs": [
+    {"noGoods": [[0, 1], [1, 2]]}
+  ],
+  "constraints": [
+    {"id": 0, "vars": [0, 1]},
+    {"id": 0, "vars": [1, 2]},
+    {"id": 0, "vars": [2, 0]}
+  ]
+''' in r.stdout.decode('utf-8')
+
+def test_cj_echo_normalize_threads(exe):
+    filepath = str(base/'data/urbcsp/n100d10c10t10s100i99k10.json')
+    r1 = subprocess.run(shlex.split(str(exe)) + ['--normalize', '--csp', filepath], capture_output=True)
+    r4 = subprocess.run(shlex.split(str(exe)) + ['--normalize', '--threads', '4', '--csp', filepath], capture_output=True)
+    assert r1.returncode == 0
+    assert r4.returncode == 0
+    assert r1.stdout == r4.stdout
+
+def test_cj_echo_canonical(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--canonical', '--csp', str(base/'test/data/duplicate-defs.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''  "constraintDefs": [
+    {"noGoods": [[0, 1], [1, 2]]},
+    {"noGoods": [[1, 0], [2, 1]]}
+  ],
+  "constraints": [
+    {"id": 0, "vars": [0, 1]},
+    {"id": 1, "vars": [0, 2]},
+    {"id": 0, "vars": [1, 2]}
+  ]
+''' in r.stdout.decode('utf-8')
+
+def test_cj_echo_vars_runs(exe):
+    filepath = str(base/'data/urbcsp/n100d10c10t10s100i99k10.json')
+    r = subprocess.run(shlex.split(str(exe)) + ['--vars-runs', '--csp', filepath], capture_output=True)
+    assert r.returncode == 0
+    assert '  "vars": {"runs": [[0, 100]]},\n' in r.stdout.decode('utf-8')
+
+def test_cj_echo_expand_predicates(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--expand-predicates', '--csp', str(base/'data/test/predicates.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''  "constraintDefs": [
+    {"noGoods": [[0, 0], [1, 0], [1, 1], [2, 0], [2, 1], [2, 2], [3, 0], [3, 1], [3, 2], [3, 3]]},
+    {"noGoods": [[0, 1], [1, 0], [1, 2], [2, 1], [2, 3], [3, 2]]}
+  ],
+''' in r.stdout.decode('utf-8')
+
+def test_cj_echo_compact_tables(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--compact-tables', '--csp', str(base/'data/test/goods.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''  "constraintDefs": [
+    {"goods": [[0, 1], [1, 2], [2, 0]]},
+    {"noGoods": [[0, 0]]}
+  ],
+''' in r.stdout.decode('utf-8')
+
+def test_cj_echo_expand_mdd(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--expand-mdd', '--csp', str(base/'data/test/no-goods-mdd.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''    {"noGoods": [[0, 1, 2], [0, 2, 1], [1, 0, 2], [1, 1, 1], [1, 2, 0], [2, 0, 1], [2, 1, 0]]}
+''' in r.stdout.decode('utf-8')
+
+def test_cj_echo_index_space(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--index-space', '--csp', str(base/'data/test/range.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''  "domains": [
+    {"range": [0, 65535]},
+    {"range": [0, 1]}
+  ],
+''' in r.stdout.decode('utf-8')
+
+def test_cj_echo_view(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--view', '2,1', '--csp', str(base/'data/test/predicates.json')], capture_output=True)
+    assert r.returncode == 0
+    assert '''  "vars": [0, 0],
+  "constraintDefs": [
+    {"predicate": {"op": "absDiffNeq", "k": 1}}
+  ],
+  "constraints": [
+    {"id": 0, "vars": [0, 1]}
+  ]
+''' in r.stdout.decode('utf-8')
+
+@pytest.mark.parametrize('view', ['x', '', '1,,2', '1,', '-1', '+1', '1x', '2147483648'])
+def test_cj_echo_view_neg(exe, view):
+    r = subprocess.run(shlex.split(str(exe)) + ['--view', view, '--csp', str(base/'data/test/predicates.json')], capture_output=True)
+    assert r.returncode == 1
+    assert r.stdout == b''
+
+def test_cj_echo_stats(exe):
+    csp = str(base/'data/test/predicates.json')
+    r = subprocess.run(shlex.split(str(exe)) + ['--stats', '--csp', csp], capture_output=True)
+    assert r.returncode == 0
+    stats = json.loads(r.stderr.decode('utf-8'))
+    assert set(stats['ns']) == {'tokenize', 'parse', 'validate', 'normalize', 'print'}
+    if stats['enabled']:
+        assert stats['bytesRead'] == Path(csp).stat().st_size
+        assert stats['bytesWritten'] == len(r.stdout)
+        assert stats['tokens'] > 0
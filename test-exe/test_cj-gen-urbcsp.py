@@ -1,3 +1,4 @@
+import hashlib
 import pytest
 import shlex
 import subprocess
@@ -61,3 +62,42 @@ def test_urbcsp_num_constraint_defs(exe):
     r = run_cj_gen_urbcsp(exe, '100 10 10 10 100 99 10'.split(' '))
     assert r.returncode == 0
     assert r.stdout.decode('utf-8') == expected
+
+def test_urbcsp_threads(exe):
+    r = run_cj_gen_urbcsp(exe, '--threads 4 100 10 10 10 100 99'.split(' '))
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == expected
+
+def test_urbcsp_skip_instances(exe):
+    # Hashes of the output from before instances were skipped rather than built.
+    for args, sha256 in [
+        ('30 6 40 12 7 250 10', 'd195381486a03d496cbf37708556fc88e3ebe5f141787bda64b322fd6d0915ea'),
+        ('20 5 30 5 -3 17', '0f5c6058c0d3767e0618460c19cab6d5d3e680f25449b77a96b6f7f025d7da42'),
+    ]:
+        r = run_cj_gen_urbcsp(exe, args.split(' '))
+        assert r.returncode == 0
+        assert hashlib.sha256(r.stdout).hexdigest() == sha256
+
+def test_urbcsp_all(exe, tmp_path):
+    r = run_cj_gen_urbcsp(exe, ['--all', '--out-dir', str(tmp_path), '--threads', '3'] + '100 10 10 10 100 99'.split(' '))
+    assert r.returncode == 0
+    assert len(list(tmp_path.iterdir())) == 100
+    assert (tmp_path/'n100d10c10t10s100i99k10.json').read_text() == expected
+    for i in [0, 42]:
+        r = run_cj_gen_urbcsp(exe, f'100 10 10 10 100 {i}'.split(' '))
+        assert (tmp_path/f'n100d10c10t10s100i{i}k10.json').read_bytes() == r.stdout
+
+def test_urbcsp_all_path_too_long(exe, tmp_path):
+    r = run_cj_gen_urbcsp(exe, ['--all', '--out-dir', str(tmp_path/('x' * 4096))] + '100 10 10 10 100 1'.split(' '))
+    assert r.returncode == 2
+    assert 'Path too long' in r.stderr.decode('utf-8')
+
+def test_urbcsp_all_needs_out_dir(exe):
+    r = run_cj_gen_urbcsp(exe, '--all 100 10 10 10 100 99'.split(' '))
+    assert r.returncode == 1
+
+def test_urbcsp_threads_invalid(exe):
+    for threads in ['x', '4x', '', '-1']:
+        r = run_cj_gen_urbcsp(exe, ['--threads', threads] + '100 10 10 10 100 99'.split(' '))
+        assert r.returncode == 1
+        assert 'Usage' in r.stderr.decode('utf-8')
@@ -39,3 +39,53 @@ def test_australia_no_file(exe):
     r = run_cj_is_solved(exe, base/'this-file-does-not-exist.json', '[0,0,0,0,0,0,0]')
     assert r.returncode != 0
     assert r.stdout.decode('utf-8') == ""
+
+def test_range_true(exe):
+    r = run_cj_is_solved(exe, base/'data/test/range.json', '[0,65534,1]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "true\n"
+
+def test_range_out_of_range(exe):
+    r = run_cj_is_solved(exe, base/'data/test/range.json', '[0,65536,1]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "false\n"
+
+def test_all_different_true(exe):
+    r = run_cj_is_solved(exe, base/'data/test/all-different.json', '[3,0,2,1]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "true\n"
+
+def test_all_different_false(exe):
+    r = run_cj_is_solved(exe, base/'data/test/all-different.json', '[1,0,2,1]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "false\n"
+
+def test_predicates_true(exe):
+    r = run_cj_is_solved(exe, base/'data/test/predicates.json', '[0,1,3]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "true\n"
+
+def test_predicates_false(exe):
+    r = run_cj_is_solved(exe, base/'data/test/predicates.json', '[0,1,2]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "false\n"
+
+def test_goods_true(exe):
+    r = run_cj_is_solved(exe, base/'data/test/goods.json', '[0,1,2]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "true\n"
+
+def test_goods_false(exe):
+    r = run_cj_is_solved(exe, base/'data/test/goods.json', '[0,2,1]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "false\n"
+
+def test_no_goods_mdd_true(exe):
+    r = run_cj_is_solved(exe, base/'data/test/no-goods-mdd.json', '[0,0,0,2]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "true\n"
+
+def test_no_goods_mdd_false(exe):
+    r = run_cj_is_solved(exe, base/'data/test/no-goods-mdd.json', '[0,1,1,1]')
+    assert r.returncode == 0
+    assert r.stdout.decode('utf-8') == "false\n"
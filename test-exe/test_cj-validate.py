@@ -28,3 +28,18 @@ def test_cj_echo_neg(filepath, exe):
     r = run_cj_validate(exe, filepath)
     assert r.returncode != 0
     assert r.stdout.decode('utf-8') == "Invalid\n"
+
+def test_cj_validate_mem(exe):
+    r = subprocess.run(shlex.split(str(exe)) + ['--mem', '--csp', str(base/'data/test/small.json')], capture_output=True)
+    assert r.returncode == 0
+    lines = r.stdout.decode('utf-8').splitlines()
+    assert lines[0] == 'OK'
+    assert lines[1].split() == ['section', 'bytes', 'allocations', 'wasted']
+    sections = {line.split()[0]: [int(x) for x in line.split()[1:]] for line in lines[2:]}
+    assert list(sections) == ['meta', 'domains', 'vars', 'constraintDefs', 'constraints', 'total']
+    for i in range(3):
+        assert sections['total'][i] == sum(v[i] for k, v in sections.items() if k != 'total')
+    assert sections['constraintDefs'][0] > 0
+    # small.json is parsed with 4 byte ints, its values fit in 1 byte.
+    assert sections['domains'][2] == 2 * 3
+    assert sections['constraintDefs'][2] == 4 * 3
@@ -39,6 +39,66 @@ const char* cspJsonSmall= "{"
   "]"
 "}";
 
+/** 5 vars referencing domains 1, 1, 0, 0, 0 as runs. */
+const char* cspJsonVarRuns = "{"
+  "\"meta\": {"
+    "\"id\": \"test/var-runs\","
+    "\"algo\": \"test\","
+    "\"params\": null"
+  "},"
+  "\"domains\": [{\"values\": [0]}, {\"values\": [0, 1]}],"
+  "\"vars\": {\"runs\": [[1, 2], [0, 3]]},"
+  "\"constraintDefs\": [],"
+  "\"constraints\": []"
+"}";
+
+/** cspJsonSmall with renumbered defs, reordered and flipped constraints. */
+const char* cspJsonCanonicalA = "{"
+  "\"meta\": {\"id\": \"test/canonical\", \"algo\": \"test\", \"params\": null},"
+  "\"domains\": [{\"values\": [0, 1, 2]}],"
+  "\"vars\": [0, 0, 0],"
+  "\"constraintDefs\": ["
+    "{\"noGoods\": [[0, 1], [0, 2]]},"
+    "{\"noGoods\": [[1, 1], [0, 0]]}"
+  "],"
+  "\"constraints\": ["
+    "{\"id\": 1, \"vars\": [1, 2]},"
+    "{\"id\": 0, \"vars\": [0, 1]},"
+    "{\"id\": 0, \"vars\": [2, 0]}"
+  "]"
+"}";
+
+const char* cspJsonCanonicalB = "{"
+  "\"meta\": {\"id\": \"test/canonical\", \"algo\": \"test\", \"params\": null},"
+  "\"domains\": [{\"values\": [0, 1, 2]}],"
+  "\"vars\": [0, 0, 0],"
+  "\"constraintDefs\": ["
+    "{\"noGoods\": [[1, 0], [2, 0]]},"
+    "{\"noGoods\": [[0, 0], [1, 1]]},"
+    "{\"noGoods\": [[0, 2], [0, 1]]},"
+    "{\"noGoods\": [[2, 2]]}"
+  "],"
+  "\"constraints\": ["
+    "{\"id\": 0, \"vars\": [0, 2]},"
+    "{\"id\": 1, \"vars\": [2, 1]},"
+    "{\"id\": 2, \"vars\": [0, 1]}"
+  "]"
+"}";
+
+/** @return the malloc'ed buffer pointing to the null-terminated string. */
+char* cspToStr(const CjCsp* csp) {
+  const size_t size = 1024*64;
+  char* buf = malloc(size);
+  if (!buf) { return NULL; }
+  memset(buf, 0, size);
+  FILE* f = fmemopen(buf, size, "w");
+  if (!f) { free(buf); return NULL; }
+  CjError err = cjCspJsonPrint(f, csp);
+  fclose(f);
+  if (err != CJ_ERROR_OK) { free(buf); return NULL; }
+  return buf;
+}
+
 /** @return the malloc'ed buffer pointing to the null-terminated string. */
 char* intTuplesToStr(const CjIntTuples* ts) {
   const size_t size = 1024*64;
@@ -332,6 +392,83 @@ void cjConstraintDefJsonPrintTestNoGoods() {
   free(buf);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// cjMddBinaryWrite and cjMddBinaryRead
+
+void cjMddBinaryTestRoundtrip() {
+  CjIntTuples table = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(50, 3, &table), CJ_ERROR_OK);
+  for (int i = 0; i < table.size; ++i) {
+    table.data[3*i + 0] = i % 5 - 2;
+    table.data[3*i + 1] = i / 5 % 2;
+    table.data[3*i + 2] = i % 7 * 1000;
+  }
+  CjMdd mdd = cjMddInit();
+  EXPECT_RETURN(cjMddAlloc(&table, &mdd), CJ_ERROR_OK);
+
+  char* buf = NULL;
+  size_t bufSize = 0;
+  FILE* f = open_memstream(&buf, &bufSize);
+  EXPECT_PTR_NEQ(f, NULL);
+  EXPECT_RETURN(cjMddBinaryWrite(f, &mdd), CJ_ERROR_OK);
+  fclose(f);
+  EXPECT_EQ(bufSize, 16 + 4 * (mdd.nodes.size + 2 * mdd.edges.size));
+  f = fmemopen(buf, bufSize, "r");
+  CjMdd read = cjMddInit();
+  EXPECT_RETURN(cjMddBinaryRead(f, &read), CJ_ERROR_OK);
+  fclose(f);
+  EXPECT_EQ(read.arity, mdd.arity);
+  EXPECT_EQ(read.nodes.size, mdd.nodes.size);
+  EXPECT_EQ(read.edges.size, mdd.edges.size);
+  for (int i = 0; i < mdd.nodes.size; ++i) {
+    EXPECT_EQ(cjIntTuplesGet(&read.nodes, i), cjIntTuplesGet(&mdd.nodes, i));
+  }
+  for (int i = 0; i < 2 * mdd.edges.size; ++i) {
+    EXPECT_EQ(cjIntTuplesGet(&read.edges, i), cjIntTuplesGet(&mdd.edges, i));
+  }
+  for (int i = 0; i < table.size; ++i) {
+    EXPECT_EQ(cjMddHas(&read, &table.data[3*i]), 1);
+  }
+  cjMddFree(&read);
+
+  // Truncated.
+  f = fmemopen(buf, bufSize - 4, "r");
+  EXPECT_RETURN(cjMddBinaryRead(f, &read), CJ_ERROR_MDD_INVALID);
+  fclose(f);
+  // Bad magic.
+  buf[0] = 'X';
+  f = fmemopen(buf, bufSize, "r");
+  EXPECT_RETURN(cjMddBinaryRead(f, &read), CJ_ERROR_MDD_INVALID);
+  fclose(f);
+  free(buf);
+
+  // Counts far beyond the file: fails on the short read, not the allocation.
+  unsigned char huge[] = {
+    'C', 'J', 'M', 'D', 2, 0, 0, 0, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0x3f,
+    0, 0, 0, 0, 1, 0, 0, 0,
+  };
+  CjStats stats = cjStatsInit();
+  cjSetThreadStats(&stats);
+  f = fmemopen(huge, sizeof(huge), "r");
+  EXPECT_RETURN(cjMddBinaryRead(f, &read), CJ_ERROR_MDD_INVALID);
+  fclose(f);
+  cjSetThreadStats(NULL);
+  EXPECT_EQ(stats.allocations, stats.frees);
+
+  // Well formed binary, bad MDD: the root has an edge to itself.
+  unsigned char selfLoop[] = {
+    'C', 'J', 'M', 'D', 2, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0,
+    0, 0, 0, 0, 1, 0, 0, 0,
+    7, 0, 0, 0, 0, 0, 0, 0,
+  };
+  f = fmemopen(selfLoop, sizeof(selfLoop), "r");
+  EXPECT_RETURN(cjMddBinaryRead(f, &read), CJ_ERROR_VALIDATION_MDD);
+  fclose(f);
+
+  cjMddFree(&mdd);
+  cjIntTuplesFree(&table);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // cjCspJsonParse
 
@@ -404,6 +541,102 @@ void cjCspJsonParseTestSmall() {
   EXPECT_EQ(csp.constraints[0].vars.data[1], 1);
 }
 
+void cjCspJsonParseTestVarRuns() {
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(cspJsonVarRuns, strlen(cspJsonVarRuns), &csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.vars.size, 0);
+  EXPECT_EQ(csp.varRuns.size, 2);
+  EXPECT_EQ(cjCspVarsSize(&csp), 5);
+  const int domains[] = {1, 1, 0, 0, 0};
+  for (int iVar = 0; iVar < 5; ++iVar) { EXPECT_EQ(cjCspVarDomain(&csp, iVar), domains[iVar]); }
+
+  char* str = cspToStr(&csp);
+  EXPECT_PTR_NEQ(str, NULL);
+  EXPECT_PTR_NEQ(strstr(str, "\"vars\": {\"runs\": [[1, 2], [0, 3]]},"), NULL);
+  free(str);
+
+  EXPECT_RETURN(cjCspVarsExpand(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.varRuns.size, 0);
+  EXPECT_EQ(csp.vars.size, 5);
+  for (int iVar = 0; iVar < 5; ++iVar) { EXPECT_EQ(csp.vars.data[iVar], domains[iVar]); }
+  EXPECT_RETURN(cjCspVarsCompress(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.varRuns.size, 2);
+  EXPECT_EQ(cjCspVarDomain(&csp, 1), 1);
+  EXPECT_EQ(cjCspVarDomain(&csp, 2), 0);
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+  cjCspFree(&csp);
+
+  const char* zeroCount = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [], \"vars\": {\"runs\": [[0, 0]]}, \"constraintDefs\": [], \"constraints\": []}";
+  EXPECT_RETURN(cjCspJsonParse(zeroCount, strlen(zeroCount), &csp), CJ_ERROR_VARS_RUNS_IS_NOT_PAIRS);
+  cjCspFree(&csp);
+}
+
+void cjCspJsonParseTestDomainRange() {
+  const char* json = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [{\"range\": [-5, 70000]}], \"vars\": [0, 0], \"constraintDefs\": [], \"constraints\": []}";
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(json, strlen(json), &csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.domains[0].type, CJ_DOMAIN_RANGE);
+  EXPECT_EQ(csp.domains[0].range.lo, -5);
+  EXPECT_EQ(csp.domains[0].range.hi, 70000);
+  EXPECT_EQ(cjDomainSize(&csp.domains[0]), 70006);
+  EXPECT_EQ(cjDomainHasValue(&csp.domains[0], -5), 1);
+  EXPECT_EQ(cjDomainHasValue(&csp.domains[0], 70001), 0);
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspNormalize(&csp), CJ_ERROR_OK);
+  char* str = cspToStr(&csp);
+  EXPECT_PTR_NEQ(str, NULL);
+  EXPECT_PTR_NEQ(strstr(str, "{\"range\": [-5, 70000]}"), NULL);
+  free(str);
+  cjCspFree(&csp);
+
+  const char* reversed = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [{\"range\": [1, 0]}], \"vars\": [], \"constraintDefs\": [], \"constraints\": []}";
+  EXPECT_RETURN(cjCspJsonParse(reversed, strlen(reversed), &csp), CJ_ERROR_DOMAIN_RANGE_IS_NOT_PAIR);
+  cjCspFree(&csp);
+
+  // At most INT_MAX values, so that cjDomainSize() fits an int.
+  const char* widest = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [{\"range\": [1, 2147483647]}], \"vars\": [], \"constraintDefs\": [], \"constraints\": []}";
+  EXPECT_RETURN(cjCspJsonParse(widest, strlen(widest), &csp), CJ_ERROR_OK);
+  EXPECT_EQ(cjDomainSize(&csp.domains[0]), 2147483647);
+  csp.domains[0].range.lo = 0;
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_VALIDATION_DOMAIN_RANGE);
+  cjCspFree(&csp);
+
+  const char* tooWide = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [{\"range\": [-2147483648, 2147483647]}], \"vars\": [], \"constraintDefs\": [], \"constraints\": []}";
+  EXPECT_RETURN(cjCspJsonParse(tooWide, strlen(tooWide), &csp), CJ_ERROR_DOMAIN_RANGE_IS_NOT_PAIR);
+  cjCspFree(&csp);
+}
+
+void cjCspJsonParseTestValidate() {
+  // constraints come before the vars they refer to, so are checked last.
+  const char* json = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"constraints\": [{\"id\": 0, \"vars\": [0, 1]}], \"constraintDefs\": [{\"noGoods\": [[0, 0]]}],"
+    "\"domains\": [{\"values\": [0, 1]}], \"vars\": [0, 0]}";
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParseFlags(json, strlen(json), 0, &csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.validated, 0);
+  cjCspFree(&csp);
+  EXPECT_RETURN(cjCspJsonParseFlags(json, strlen(json), CJ_PARSE_VALIDATE | CJ_PARSE_VARS_RUNS, &csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.validated, 1);
+  cjCspFree(&csp);
+  EXPECT_EQ(csp.validated, 0);
+
+  const char* badVar = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [{\"values\": [0, 1]}], \"vars\": [0, 0], \"constraintDefs\": [{\"noGoods\": [[0, 0]]}],"
+    "\"constraints\": [{\"id\": 0, \"vars\": [0, 2]}]}";
+  EXPECT_RETURN(cjCspJsonParseFlags(badVar, strlen(badVar), 0, &csp), CJ_ERROR_OK);
+  cjCspFree(&csp);
+  EXPECT_RETURN(cjCspJsonParseFlags(badVar, strlen(badVar), CJ_PARSE_VALIDATE, &csp), CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE);
+  EXPECT_EQ(cjErrorIsValidation(CJ_ERROR_VALIDATION_CONSTRAINT_VAR_RANGE), 1);
+  EXPECT_EQ(cjErrorIsValidation(CJ_ERROR_NOMEM), 0);
+  cjCspFree(&csp);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // cjCspJsonPrint
 
@@ -416,6 +649,190 @@ void cjCspJsonPrintTestNull() {
   fclose(f);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// cjCspCanonicalize
+
+void cjCspCanonicalizeTestEquivalent() {
+  CjCsp a = cjCspInit();
+  CjCsp b = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(cspJsonCanonicalA, strlen(cspJsonCanonicalA), &a), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspJsonParse(cspJsonCanonicalB, strlen(cspJsonCanonicalB), &b), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspCanonicalize(&a), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspCanonicalize(&b), CJ_ERROR_OK);
+
+  char* aStr = cspToStr(&a);
+  char* bStr = cspToStr(&b);
+  EXPECT_PTR_NEQ(aStr, NULL);
+  EXPECT_PTR_NEQ(bStr, NULL);
+  EXPECT_STR_EQ(aStr, bStr);
+  EXPECT_EQ(a.constraintDefsSize, 3);
+  EXPECT_EQ(a.constraints[0].id, 0);
+  EXPECT_EQ(a.constraints[0].vars.data[0], 0);
+  EXPECT_EQ(a.constraints[0].vars.data[1], 1);
+  EXPECT_EQ(a.constraints[1].id, 1);
+  EXPECT_EQ(a.constraints[1].vars.data[0], 0);
+  EXPECT_EQ(a.constraints[1].vars.data[1], 2);
+  EXPECT_EQ(a.constraints[2].id, 2);
+  EXPECT_EQ(a.constraints[2].vars.data[0], 1);
+  EXPECT_EQ(a.constraints[2].vars.data[1], 2);
+
+  free(aStr);
+  free(bStr);
+  cjCspFree(&a);
+  cjCspFree(&b);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cjCspCompactTables
+
+/** A def listing every tuple has an empty complement, which would print without an arity. */
+void cjCspCompactTablesTestEveryTupleRoundtrip() {
+  const char* json = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [{\"values\": [0, 1]}], \"vars\": [0, 0],"
+    "\"constraintDefs\": [{\"noGoods\": [[0, 0], [0, 1], [1, 0], [1, 1]]}, {\"goods\": [[1, 0], [0, 0], [1, 1], [0, 1]]}],"
+    "\"constraints\": [{\"id\": 0, \"vars\": [0, 1]}, {\"id\": 1, \"vars\": [1, 0]}]}";
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(json, strlen(json), &csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspCompactTables(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.constraintDefs[0].type, CJ_CONSTRAINT_DEF_NO_GOODS);
+  EXPECT_EQ(csp.constraintDefs[1].type, CJ_CONSTRAINT_DEF_GOODS);
+
+  char* str = cspToStr(&csp);
+  EXPECT_PTR_NEQ(str, NULL);
+  CjCsp reparsed = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(str, strlen(str), &reparsed), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspValidate(&reparsed), CJ_ERROR_OK);
+  EXPECT_EQ(reparsed.constraintDefs[0].noGoods.arity, 2);
+  EXPECT_EQ(reparsed.constraintDefs[1].goods.size, 4);
+
+  free(str);
+  cjCspFree(&reparsed);
+  cjCspFree(&csp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cjCspExpandPredicates
+
+/** |x - y| != 10 always holds over [0, 3]: its constraint is dropped, not printed as {"noGoods": []}. */
+void cjCspExpandPredicatesTestRoundtrip() {
+  const char* json = "{\"meta\": {\"id\": \"\", \"algo\": \"\", \"params\": null},"
+    "\"domains\": [{\"range\": [0, 3]}], \"vars\": [0, 0, 0],"
+    "\"constraintDefs\": [{\"predicate\": {\"op\": \"absDiffNeq\", \"k\": 10}}, {\"predicate\": {\"op\": \"lt\"}}],"
+    "\"constraints\": [{\"id\": 0, \"vars\": [0, 1]}, {\"id\": 1, \"vars\": [1, 2]}, {\"id\": 0, \"vars\": [2, 0]}]}";
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(json, strlen(json), &csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspExpandPredicates(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.constraintDefsSize, 1);
+  EXPECT_EQ(csp.constraintsSize, 1);
+  EXPECT_EQ(csp.constraints[0].vars.data[0], 1);
+
+  char* str = cspToStr(&csp);
+  EXPECT_PTR_NEQ(str, NULL);
+  CjCsp reparsed = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(str, strlen(str), &reparsed), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspValidate(&reparsed), CJ_ERROR_OK);
+  EXPECT_EQ(reparsed.constraintDefs[0].noGoods.size, 10);
+
+  free(str);
+  cjCspFree(&reparsed);
+  cjCspFree(&csp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cjCspViewJsonPrint
+
+/** The view of vars {3, 1} keeps domain 1, def 1 and the first constraint only. */
+void cjCspViewJsonPrintTestMaterialized() {
+  const char* json = "{\"meta\": {\"id\": \"test/view\", \"algo\": \"test\", \"params\": null},"
+    "\"domains\": [{\"values\": [0]}, {\"range\": [0, 2]}, {\"values\": [0, 1]}], \"vars\": [2, 1, 2, 1],"
+    "\"constraintDefs\": [{\"noGoods\": [[0, 0]]}, {\"noGoods\": [[1, 1], [2, 0]]}, {\"goods\": [[0, 1]]}],"
+    "\"constraints\": [{\"id\": 1, \"vars\": [3, 1]}, {\"id\": 2, \"vars\": [0, 2]}, {\"id\": 0, \"vars\": [0, 1]}]}";
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(json, strlen(json), &csp), CJ_ERROR_OK);
+  const int vars[] = {3, 1};
+  CjCspView view = cjCspViewInit();
+  EXPECT_RETURN(cjCspViewAlloc(&csp, NULL, vars, 2, &view), CJ_ERROR_OK);
+  EXPECT_EQ(view.domains.size, 1);
+  EXPECT_EQ(cjCspViewDomainOf(&view, 1), 0);
+  EXPECT_EQ(cjCspViewDomainOf(&view, 2), -1);
+  EXPECT_EQ(view.constraintDefs.size, 1);
+  EXPECT_EQ(cjCspViewConstraintDefOf(&view, 1), 0);
+
+  CjStats stats = cjStatsInit();
+  cjSetThreadStats(&stats);
+  char* viewStr = NULL;
+  size_t viewStrSize = 0;
+  FILE* f = open_memstream(&viewStr, &viewStrSize);
+  const uint64_t allocations = stats.allocations;
+  EXPECT_RETURN(cjCspViewJsonPrint(f, &view), CJ_ERROR_OK);
+  EXPECT_EQ(stats.allocations, allocations);
+  fclose(f);
+  cjSetThreadStats(NULL);
+  if (cjStatsEnabled()) { EXPECT_EQ(stats.bytesWritten, viewStrSize); }
+  EXPECT_PTR_NEQ(strstr(viewStr, "\"vars\": [0, 0],"), NULL);
+  EXPECT_PTR_NEQ(strstr(viewStr, "{\"id\": 0, \"vars\": [1, 0]}"), NULL);
+
+  CjCsp materialized = cjCspInit();
+  EXPECT_RETURN(cjCspViewMaterialize(&view, &materialized), CJ_ERROR_OK);
+  char* materializedStr = cspToStr(&materialized);
+  EXPECT_PTR_NEQ(materializedStr, NULL);
+  EXPECT_STR_EQ(viewStr, materializedStr);
+
+  CjMemoryUsage viewUsage;
+  CjMemoryUsage materializedUsage;
+  EXPECT_RETURN(cjCspViewMemoryUsage(&view, &viewUsage), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspMemoryUsage(&materialized, &materializedUsage), CJ_ERROR_OK);
+  EXPECT_EQ(viewUsage.constraintDefs.bytes, materializedUsage.constraintDefs.bytes);
+  EXPECT_EQ(viewUsage.total.bytes, materializedUsage.total.bytes);
+  EXPECT_EQ(viewUsage.total.allocations, materializedUsage.total.allocations);
+
+  free(viewStr);
+  free(materializedStr);
+  cjCspFree(&materialized);
+  cjCspViewFree(&view);
+  cjCspFree(&csp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cjStats
+
+void cjStatsTestParsePrint() {
+  CjStats stats = cjStatsInit();
+  cjSetThreadStats(&stats);
+  EXPECT_PTR_EQ(cjThreadStats(), &stats);
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParse(cspJsonMin, strlen(cspJsonMin), &csp), CJ_ERROR_OK);
+  FILE* f = tmpfile();
+  EXPECT_RETURN(cjCspJsonPrint(f, &csp), CJ_ERROR_OK);
+  cjCspFree(&csp);
+  cjSetThreadStats(NULL);
+  if (cjStatsEnabled()) {
+    EXPECT_EQ(stats.tokens > 0, 1);
+    EXPECT_EQ(stats.bytesRead, strlen(cspJsonMin));
+    EXPECT_EQ(stats.bytesWritten, (uint64_t) ftell(f));
+    EXPECT_EQ(stats.allocations > 0, 1);
+  }
+  else {
+    EXPECT_EQ(stats.tokens, 0);
+  }
+  EXPECT_RETURN(cjStatsJsonPrint(f, &stats), CJ_ERROR_OK);
+  EXPECT_RETURN(cjStatsJsonPrint(NULL, &stats), CJ_ERROR_ARG);
+  fclose(f);
+}
+
+void cjStatsTestParseValidate() {
+  CjStats stats = cjStatsInit();
+  cjSetThreadStats(&stats);
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspJsonParseFlags(cspJsonMin, strlen(cspJsonMin), CJ_PARSE_VALIDATE, &csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.validated, 1);
+  cjCspFree(&csp);
+  cjSetThreadStats(NULL);
+  // The fused checks count as validate, not parse.
+  EXPECT_EQ(stats.ns[CJ_PHASE_VALIDATE] > 0, cjStatsEnabled());
+  EXPECT_EQ(stats.ns[CJ_PHASE_PARSE] > 0, cjStatsEnabled());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // main
 
@@ -465,13 +882,26 @@ int main(int argc, char** argv) {
   TEST(cjConstraintDefJsonPrintTestNull());
   TEST(cjConstraintDefJsonPrintTestNoGoods());
 
+  TEST(cjMddBinaryTestRoundtrip());
+
   TEST(cjCspJsonParseTestMin());
   TEST(cjCspJsonParseTestNull());
   TEST(cjCspJsonParseTestEmpty());
   TEST(cjCspJsonParseTestSmall());
+  TEST(cjCspJsonParseTestVarRuns());
+  TEST(cjCspJsonParseTestDomainRange());
+  TEST(cjCspJsonParseTestValidate());
 
   TEST(cjCspJsonPrintTestNull());
 
+  TEST(cjCspCanonicalizeTestEquivalent());
+  TEST(cjCspCompactTablesTestEveryTupleRoundtrip());
+  TEST(cjCspExpandPredicatesTestRoundtrip());
+  TEST(cjCspViewJsonPrintTestMaterialized());
+
+  TEST(cjStatsTestParsePrint());
+  TEST(cjStatsTestParseValidate());
+
   return 0;
 }
 
@@ -1,4 +1,6 @@
 #include <dirent.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -81,6 +83,940 @@ void cjCspInitFree() {
   cjCspFree(&csp);
 }
 
+/** Alloc a binary no-goods def from a flat array of size tuples. */
+void allocNoGoods2(int size, const int* tuples, CjConstraintDef* out) {
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(size, 2, out), CJ_ERROR_OK);
+  for (int i = 0; i < 2*size; ++i) {
+    out->noGoods.data[i] = tuples[i];
+  }
+}
+
+/** Alloc a constraint over vars (var0, var1) referencing def id. */
+void allocConstraint2(int id, int var0, int var1, CjConstraint* out) {
+  EXPECT_RETURN(cjConstraintAlloc(2, out), CJ_ERROR_OK);
+  out->id = id;
+  out->vars.data[0] = var0;
+  out->vars.data[1] = var1;
+}
+
+/** A csp with one domain {0, 1}, 3 vars and no constraintDefs or constraints. */
+CjCsp makeCsp3Vars() {
+  CjCsp csp = cjCspInit();
+  csp.domainsSize = 1;
+  csp.domains = cjDomainArray(1);
+  EXPECT_RETURN(cjDomainValuesAlloc(2, &csp.domains[0]), CJ_ERROR_OK);
+  csp.domains[0].values.data[0] = 0;
+  csp.domains[0].values.data[1] = 1;
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &csp.vars), CJ_ERROR_OK);
+  for (int i = 0; i < 3; ++i) { csp.vars.data[i] = 0; }
+  return csp;
+}
+
+/** Return 1 if the tuples of ts are in lexicographic order. */
+int isSortedTuples(const CjIntTuples* ts) {
+  const int arity = ts->arity < 0 ? 1 : ts->arity;
+  for (int i = 1; i < ts->size; ++i) {
+    for (int j = 0; j < arity; ++j) {
+      const int prev = ts->data[(i-1)*arity + j];
+      const int cur = ts->data[i*arity + j];
+      if (prev < cur) { break; }
+      if (prev > cur) { return 0; }
+    }
+  }
+  return 1;
+}
+
+void cjCspNormalizeTestArity3() {
+  CjCsp csp = makeCsp3Vars();
+  csp.constraintDefsSize = 1;
+  csp.constraintDefs = cjConstraintDefArray(1);
+  CjIntTuples* ts = &csp.constraintDefs[0].noGoods;
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(3, 3, &csp.constraintDefs[0]), CJ_ERROR_OK);
+  const int data[] = {1, 0, 0,  0, 1, 1,  0, 1, 0};
+  for (int i = 0; i < 9; ++i) { ts->data[i] = data[i]; }
+
+  EXPECT_RETURN(cjCspNormalize(&csp), CJ_ERROR_OK);
+  const int expected[] = {0, 1, 0,  0, 1, 1,  1, 0, 0};
+  for (int i = 0; i < 9; ++i) { EXPECT_EQ(ts->data[i], expected[i]); }
+  cjCspFree(&csp);
+}
+
+void cjCspNormalizeTestLarge() {
+  CjCsp csp = makeCsp3Vars();
+  const int size = 5000;
+  for (int iDom = 0; iDom < csp.domains[0].values.size; ++iDom) {
+    csp.domains[0].values.data[iDom] = 1 - iDom;
+  }
+  csp.constraintDefsSize = 2;
+  csp.constraintDefs = cjConstraintDefArray(2);
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(size, 2, &csp.constraintDefs[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(size, 4, &csp.constraintDefs[1]), CJ_ERROR_OK);
+  unsigned x = 12345;
+  for (int i = 0; i < size * 2; ++i) {
+    x = x * 1103515245u + 12345u;
+    csp.constraintDefs[0].noGoods.data[i] = (i % 7 == 0) ? (int) x : (int) (x >> 20) - 2048;
+  }
+  csp.constraintDefs[0].noGoods.data[0] = -2147483647 - 1;
+  csp.constraintDefs[0].noGoods.data[1] = 2147483647;
+  for (int i = 0; i < size * 4; ++i) {
+    x = x * 1103515245u + 12345u;
+    csp.constraintDefs[1].noGoods.data[i] = (int) (x >> 28);
+  }
+
+  EXPECT_RETURN(cjCspNormalize(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.domains[0].values.data[0], 0);
+  EXPECT_EQ(csp.domains[0].values.data[1], 1);
+  EXPECT_EQ(isSortedTuples(&csp.constraintDefs[0].noGoods), 1);
+  EXPECT_EQ(isSortedTuples(&csp.constraintDefs[1].noGoods), 1);
+  EXPECT_EQ(csp.constraintDefs[0].noGoods.data[0], -2147483647 - 1);
+  cjCspFree(&csp);
+}
+
+void cjCspNormalizeParallelTestLarge() {
+  CjCsp csp = makeCsp3Vars();
+  const int size = 300000;
+  csp.constraintDefsSize = 3;
+  csp.constraintDefs = cjConstraintDefArray(3);
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(size, 2, &csp.constraintDefs[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(100, 2, &csp.constraintDefs[1]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(0, 2, &csp.constraintDefs[2]), CJ_ERROR_OK);
+  unsigned x = 54321;
+  long long sum = 0;
+  for (int i = 0; i < size * 2; ++i) {
+    x = x * 1103515245u + 12345u;
+    csp.constraintDefs[0].noGoods.data[i] = (int) (x >> 8);
+    sum += csp.constraintDefs[0].noGoods.data[i];
+  }
+  for (int i = 0; i < 100 * 2; ++i) {
+    csp.constraintDefs[1].noGoods.data[i] = 200 - i;
+  }
+
+  EXPECT_RETURN(cjCspNormalizeParallel(&csp, 4), CJ_ERROR_OK);
+  EXPECT_EQ(isSortedTuples(&csp.constraintDefs[0].noGoods), 1);
+  EXPECT_EQ(isSortedTuples(&csp.constraintDefs[1].noGoods), 1);
+  for (int i = 0; i < size * 2; ++i) {
+    sum -= csp.constraintDefs[0].noGoods.data[i];
+  }
+  EXPECT_EQ(sum == 0, 1);
+  cjCspFree(&csp);
+}
+
+void cjCspDedupConstraintDefsTestIdentical() {
+  CjCsp csp = makeCsp3Vars();
+  const int a[] = {0, 1, 1, 0};
+  const int b[] = {1, 0, 0, 1};
+  const int c[] = {0, 0};
+  csp.constraintDefsSize = 3;
+  csp.constraintDefs = cjConstraintDefArray(3);
+  allocNoGoods2(2, a, &csp.constraintDefs[0]);
+  allocNoGoods2(2, b, &csp.constraintDefs[1]);
+  allocNoGoods2(1, c, &csp.constraintDefs[2]);
+  csp.constraintsSize = 3;
+  csp.constraints = cjConstraintArray(3);
+  allocConstraint2(0, 0, 1, &csp.constraints[0]);
+  allocConstraint2(1, 1, 2, &csp.constraints[1]);
+  allocConstraint2(2, 0, 2, &csp.constraints[2]);
+
+  EXPECT_RETURN(cjCspDedupConstraintDefs(&csp, 0), CJ_ERROR_OK);
+  EXPECT_EQ(csp.constraintDefsSize, 2);
+  EXPECT_EQ(csp.constraintDefs[0].noGoods.size, 2);
+  EXPECT_EQ(csp.constraintDefs[1].noGoods.size, 1);
+  EXPECT_EQ(csp.constraints[0].id, 0);
+  EXPECT_EQ(csp.constraints[1].id, 0);
+  EXPECT_EQ(csp.constraints[2].id, 1);
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+  cjCspFree(&csp);
+}
+
+void cjCspDedupConstraintDefsTestTransposed() {
+  CjCsp csp = makeCsp3Vars();
+  const int a[] = {0, 1};
+  const int b[] = {1, 0};
+  csp.constraintDefsSize = 2;
+  csp.constraintDefs = cjConstraintDefArray(2);
+  allocNoGoods2(1, a, &csp.constraintDefs[0]);
+  allocNoGoods2(1, b, &csp.constraintDefs[1]);
+  csp.constraintsSize = 2;
+  csp.constraints = cjConstraintArray(2);
+  allocConstraint2(0, 0, 1, &csp.constraints[0]);
+  allocConstraint2(1, 1, 2, &csp.constraints[1]);
+
+  EXPECT_RETURN(cjCspDedupConstraintDefs(&csp, 0), CJ_ERROR_OK);
+  EXPECT_EQ(csp.constraintDefsSize, 2);
+
+  EXPECT_RETURN(cjCspDedupConstraintDefs(&csp, 1), CJ_ERROR_OK);
+  EXPECT_EQ(csp.constraintDefsSize, 1);
+  EXPECT_EQ(csp.constraints[0].id, 0);
+  EXPECT_EQ(csp.constraints[0].vars.data[0], 0);
+  EXPECT_EQ(csp.constraints[0].vars.data[1], 1);
+  EXPECT_EQ(csp.constraints[1].id, 0);
+  EXPECT_EQ(csp.constraints[1].vars.data[0], 2);
+  EXPECT_EQ(csp.constraints[1].vars.data[1], 1);
+  cjCspFree(&csp);
+}
+
+void cjIntTuplesNarrowTestWidths() {
+  const int maxs[] = {127, 128, 32767, 32768};
+  const int widths[] = {1, 2, 2, (int) sizeof(int)};
+  for (int iCase = 0; iCase < 4; ++iCase) {
+    CjIntTuples ts = cjIntTuplesInit();
+    EXPECT_RETURN(cjIntTuplesAlloc(3, 2, &ts), CJ_ERROR_OK);
+    const int data[] = {-maxs[iCase] - 1, 0, 1, -1, 5, maxs[iCase]};
+    for (int i = 0; i < 6; ++i) { ts.data[i] = data[i]; }
+    EXPECT_RETURN(cjIntTuplesNarrow(&ts), CJ_ERROR_OK);
+    EXPECT_EQ(ts.width, widths[iCase]);
+    for (int i = 0; i < 6; ++i) { EXPECT_EQ(cjIntTuplesGet(&ts, i), data[i]); }
+    EXPECT_RETURN(cjIntTuplesWiden(&ts), CJ_ERROR_OK);
+    EXPECT_EQ(ts.width, (int) sizeof(int));
+    for (int i = 0; i < 6; ++i) { EXPECT_EQ(ts.data[i], data[i]); }
+    cjIntTuplesFree(&ts);
+  }
+}
+
+void cjCspNarrowTestNormalizeIsSolved() {
+  CjCsp csp = makeCsp3Vars();
+  const int size = 2000;
+  csp.constraintDefsSize = 1;
+  csp.constraintDefs = cjConstraintDefArray(1);
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(size, 2, &csp.constraintDefs[0]), CJ_ERROR_OK);
+  unsigned x = 777;
+  for (int i = 0; i < size * 2; ++i) {
+    x = x * 1103515245u + 12345u;
+    csp.constraintDefs[0].noGoods.data[i] = (int) (x >> 24) - 128;
+  }
+  csp.constraintDefs[0].noGoods.data[0] = 0;
+  csp.constraintDefs[0].noGoods.data[1] = 1;
+  csp.constraintsSize = 1;
+  csp.constraints = cjConstraintArray(1);
+  allocConstraint2(0, 0, 1, &csp.constraints[0]);
+
+  EXPECT_RETURN(cjCspNarrow(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(csp.constraintDefs[0].noGoods.width, 1);
+  EXPECT_EQ(csp.vars.width, 1);
+  EXPECT_RETURN(cjCspNormalize(&csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspWiden(&csp), CJ_ERROR_OK);
+  EXPECT_EQ(isSortedTuples(&csp.constraintDefs[0].noGoods), 1);
+  EXPECT_RETURN(cjCspNarrow(&csp), CJ_ERROR_OK);
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &solution), CJ_ERROR_OK);
+  solution.data[0] = 0;
+  solution.data[1] = 1;
+  solution.data[2] = 0;
+  EXPECT_RETURN(cjIntTuplesNarrow(&solution), CJ_ERROR_OK);
+  int solved = -1;
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 0);
+  cjIntTuplesFree(&solution);
+  cjCspFree(&csp);
+}
+
+/**
+ * Defs of at least 64 tuples shared by two constraints each take the indexed
+ * path of cjCspIsSolved(): check it and cjCspIsSolvedIndexed() agree with the
+ * tables. v0, v1 and v2 must have the same parity and v0 < v2 < v3.
+ */
+void cjCspIsSolvedTestIndexed() {
+  const int d = 12;
+  CjCsp csp = cjCspInit();
+  csp.domainsSize = 1;
+  csp.domains = cjDomainArray(1);
+  EXPECT_RETURN(cjDomainRangeInit(0, d - 1, &csp.domains[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjIntTuplesAlloc(4, -1, &csp.vars), CJ_ERROR_OK);
+  for (int i = 0; i < 4; ++i) { csp.vars.data[i] = 0; }
+
+  csp.constraintDefsSize = 2;
+  csp.constraintDefs = cjConstraintDefArray(2);
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(d * d / 2, 2, &csp.constraintDefs[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjConstraintDefGoodAlloc(d * (d - 1) / 2, 2, &csp.constraintDefs[1]), CJ_ERROR_OK);
+  int iNoGood = 0;
+  int iGood = 0;
+  for (int v = 0; v < d; ++v) {
+    for (int w = 0; w < d; ++w) {
+      if ((v + w) % 2) {
+        csp.constraintDefs[0].noGoods.data[2*iNoGood + 0] = v;
+        csp.constraintDefs[0].noGoods.data[2*iNoGood + 1] = w;
+        ++iNoGood;
+      }
+      if (v < w) {
+        csp.constraintDefs[1].goods.data[2*iGood + 0] = v;
+        csp.constraintDefs[1].goods.data[2*iGood + 1] = w;
+        ++iGood;
+      }
+    }
+  }
+  EXPECT_EQ(csp.constraintDefs[0].noGoods.size >= 64, 1);
+  EXPECT_EQ(csp.constraintDefs[1].goods.size >= 64, 1);
+
+  const int scopes[4][3] = {{0, 0, 1}, {0, 1, 2}, {1, 0, 2}, {1, 2, 3}};
+  csp.constraintsSize = 4;
+  csp.constraints = cjConstraintArray(4);
+  for (int iC = 0; iC < 4; ++iC) {
+    EXPECT_RETURN(cjConstraintAlloc(2, &csp.constraints[iC]), CJ_ERROR_OK);
+    csp.constraints[iC].id = scopes[iC][0];
+    csp.constraints[iC].vars.data[0] = scopes[iC][1];
+    csp.constraints[iC].vars.data[1] = scopes[iC][2];
+  }
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+
+  CjTableIndex* indexes = NULL;
+  EXPECT_RETURN(cjCspTableIndexArrayAlloc(&csp, 64, &indexes), CJ_ERROR_OK);
+  EXPECT_EQ(indexes[0].capacity > 0, 1);
+  EXPECT_EQ(indexes[1].capacity > 0, 1);
+
+  const int solutions[][5] = {
+    // v0, v1, v2, v3, solved
+    {0, 2, 4, 5, 1},
+    {1, 7, 3, 11, 1},
+    {0, 3, 4, 5, 0},
+    {0, 2, 4, 4, 0},
+    {6, 2, 4, 5, 0},
+  };
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(4, -1, &solution), CJ_ERROR_OK);
+  for (size_t iS = 0; iS < sizeof(solutions) / sizeof(solutions[0]); ++iS) {
+    for (int i = 0; i < 4; ++i) { solution.data[i] = solutions[iS][i]; }
+    int solved = -1;
+    EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+    EXPECT_EQ(solved, solutions[iS][4]);
+    solved = -1;
+    EXPECT_RETURN(cjCspIsSolvedIndexed(&csp, indexes, &solution, &solved), CJ_ERROR_OK);
+    EXPECT_EQ(solved, solutions[iS][4]);
+  }
+  cjIntTuplesFree(&solution);
+  cjTableIndexArrayFree(&indexes, csp.constraintDefsSize);
+  cjCspFree(&csp);
+}
+
+void cjCspIsSolvedTestErrorLeavesSolved() {
+  CjCsp csp = cjCspInit();
+  csp.domainsSize = 1;
+  csp.domains = cjDomainArray(1);
+  EXPECT_RETURN(cjDomainRangeInit(0, 1, &csp.domains[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjIntTuplesAlloc(2, -1, &csp.vars), CJ_ERROR_OK);
+  csp.vars.data[0] = 0;
+  csp.vars.data[1] = 0;
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &solution), CJ_ERROR_OK);
+  int solved = -1;
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_VALIDATION_SOLUTION_VARS_SIZE_MISMATCH);
+  EXPECT_EQ(solved, -1);
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, NULL), CJ_ERROR_ARG);
+  cjIntTuplesFree(&solution);
+  cjCspFree(&csp);
+}
+
+void cjCspIsSolvedTestAllDifferent() {
+  const int size = 1000;
+  CjCsp csp = cjCspInit();
+  csp.domainsSize = 1;
+  csp.domains = cjDomainArray(1);
+  EXPECT_RETURN(cjDomainRangeInit(0, size - 1, &csp.domains[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjIntTuplesAlloc(size, -1, &csp.vars), CJ_ERROR_OK);
+  for (int i = 0; i < size; ++i) { csp.vars.data[i] = 0; }
+  csp.constraintDefsSize = 1;
+  csp.constraintDefs = cjConstraintDefArray(1);
+  cjConstraintDefAllDifferentInit(&csp.constraintDefs[0]);
+  csp.constraintsSize = 1;
+  csp.constraints = cjConstraintArray(1);
+  EXPECT_RETURN(cjConstraintAlloc(size, &csp.constraints[0]), CJ_ERROR_OK);
+  csp.constraints[0].id = 0;
+  for (int i = 0; i < size; ++i) { csp.constraints[0].vars.data[i] = i; }
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspNormalize(&csp), CJ_ERROR_OK);
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(size, -1, &solution), CJ_ERROR_OK);
+  for (int i = 0; i < size; ++i) { solution.data[i] = (i * 7) % size; }
+  int solved = -1;
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 1);
+  solution.data[size - 1] = solution.data[0];
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 0);
+  cjIntTuplesFree(&solution);
+  cjCspFree(&csp);
+}
+
+/** 3 vars, x <= y, |y - z| == 2 and z <= x over two domains. */
+CjCsp makePredicatesCsp() {
+  CjCsp csp = cjCspInit();
+  csp.domainsSize = 2;
+  csp.domains = cjDomainArray(2);
+  EXPECT_RETURN(cjDomainRangeInit(-2, 2, &csp.domains[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjDomainValuesAlloc(3, &csp.domains[1]), CJ_ERROR_OK);
+  csp.domains[1].values.data[0] = 0;
+  csp.domains[1].values.data[1] = 2;
+  csp.domains[1].values.data[2] = 4;
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &csp.vars), CJ_ERROR_OK);
+  csp.vars.data[0] = 0;
+  csp.vars.data[1] = 1;
+  csp.vars.data[2] = 0;
+  csp.constraintDefsSize = 2;
+  csp.constraintDefs = cjConstraintDefArray(2);
+  EXPECT_RETURN(cjConstraintDefPredicateInit(CJ_PREDICATE_LE, 0, &csp.constraintDefs[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjConstraintDefPredicateInit(CJ_PREDICATE_ABS_DIFF_EQ, 2, &csp.constraintDefs[1]), CJ_ERROR_OK);
+  csp.constraintsSize = 3;
+  csp.constraints = cjConstraintArray(3);
+  allocConstraint2(0, 0, 1, &csp.constraints[0]);
+  allocConstraint2(1, 1, 2, &csp.constraints[1]);
+  allocConstraint2(0, 2, 0, &csp.constraints[2]);
+
+  return csp;
+}
+
+void cjCspExpandPredicatesTestSameSolutions() {
+  CjCsp csp = makePredicatesCsp();
+  CjCsp expanded = makePredicatesCsp();
+  EXPECT_RETURN(cjCspExpandPredicates(&expanded), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspValidate(&expanded), CJ_ERROR_OK);
+  EXPECT_EQ(expanded.constraintDefsSize, 3);
+  for (int iDef = 0; iDef < expanded.constraintDefsSize; ++iDef) {
+    EXPECT_EQ(expanded.constraintDefs[iDef].type, CJ_CONSTRAINT_DEF_NO_GOODS);
+  }
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &solution), CJ_ERROR_OK);
+  for (int v0 = -2; v0 <= 2; ++v0) {
+    for (int v1 = 0; v1 <= 4; v1 += 2) {
+      for (int v2 = -2; v2 <= 2; ++v2) {
+        solution.data[0] = v0;
+        solution.data[1] = v1;
+        solution.data[2] = v2;
+        int solved = -1;
+        int expandedSolved = -1;
+        EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+        EXPECT_RETURN(cjCspIsSolved(&expanded, &solution, &expandedSolved), CJ_ERROR_OK);
+        EXPECT_EQ(expandedSolved, solved);
+        const int expected = v0 <= v1 && abs(v1 - v2) == 2 && v2 <= v0;
+        EXPECT_EQ(solved, expected);
+      }
+    }
+  }
+  cjIntTuplesFree(&solution);
+  cjCspFree(&expanded);
+  cjCspFree(&csp);
+}
+
+void cjPredicateHoldsTestExtremes() {
+  EXPECT_EQ(cjPredicateHolds(CJ_PREDICATE_ABS_DIFF_EQ, INT_MAX, INT_MAX, 0), 1);
+  EXPECT_EQ(cjPredicateHolds(CJ_PREDICATE_ABS_DIFF_EQ, INT_MAX, 0, INT_MAX), 1);
+  EXPECT_EQ(cjPredicateHolds(CJ_PREDICATE_ABS_DIFF_EQ, INT_MAX, INT_MIN, INT_MAX), 0);
+  EXPECT_EQ(cjPredicateHolds(CJ_PREDICATE_ABS_DIFF_NEQ, INT_MAX, INT_MIN, INT_MAX), 1);
+  EXPECT_EQ(cjPredicateHolds(CJ_PREDICATE_ABS_DIFF_NEQ, 0, INT_MIN, INT_MIN), 0);
+}
+
+/** A tight no-goods def becomes goods and a loose one is left as it is. */
+void cjCspCompactTablesTestSameSolutions() {
+  const int tight[] = {0,0, 0,2, 1,0, 1,1, 2,0, 2,1, 2,2};
+  const int loose[] = {0,0};
+  CjCsp csp[2];
+  for (int i = 0; i < 2; ++i) {
+    csp[i] = cjCspInit();
+    csp[i].domainsSize = 1;
+    csp[i].domains = cjDomainArray(1);
+    EXPECT_RETURN(cjDomainValuesAlloc(3, &csp[i].domains[0]), CJ_ERROR_OK);
+    for (int v = 0; v < 3; ++v) { csp[i].domains[0].values.data[v] = v; }
+    EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &csp[i].vars), CJ_ERROR_OK);
+    for (int v = 0; v < 3; ++v) { csp[i].vars.data[v] = 0; }
+    csp[i].constraintDefsSize = 2;
+    csp[i].constraintDefs = cjConstraintDefArray(2);
+    allocNoGoods2(7, tight, &csp[i].constraintDefs[0]);
+    allocNoGoods2(1, loose, &csp[i].constraintDefs[1]);
+    csp[i].constraintsSize = 2;
+    csp[i].constraints = cjConstraintArray(2);
+    allocConstraint2(0, 0, 1, &csp[i].constraints[0]);
+    allocConstraint2(1, 1, 2, &csp[i].constraints[1]);
+  }
+
+  EXPECT_RETURN(cjCspCompactTables(&csp[1]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspValidate(&csp[1]), CJ_ERROR_OK);
+  EXPECT_EQ(csp[1].constraintDefs[0].type, CJ_CONSTRAINT_DEF_GOODS);
+  EXPECT_EQ(csp[1].constraintDefs[0].goods.size, 2);
+  EXPECT_EQ(csp[1].constraintDefs[1].type, CJ_CONSTRAINT_DEF_NO_GOODS);
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &solution), CJ_ERROR_OK);
+  for (int v = 0; v < 27; ++v) {
+    solution.data[0] = v / 9;
+    solution.data[1] = v / 3 % 3;
+    solution.data[2] = v % 3;
+    int solved = -1;
+    int compactSolved = -1;
+    EXPECT_RETURN(cjCspIsSolved(&csp[0], &solution, &solved), CJ_ERROR_OK);
+    EXPECT_RETURN(cjCspIsSolved(&csp[1], &solution, &compactSolved), CJ_ERROR_OK);
+    EXPECT_EQ(compactSolved, solved);
+  }
+  cjIntTuplesFree(&solution);
+  cjCspFree(&csp[1]);
+  cjCspFree(&csp[0]);
+}
+
+/** Every tuple of a narrowed arity 3 table is found and no other one. */
+void cjTableIndexTestFind() {
+  CjIntTuples table = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(1000, 3, &table), CJ_ERROR_OK);
+  for (int i = 0; i < table.size; ++i) {
+    table.data[3*i + 0] = i / 100;
+    table.data[3*i + 1] = i / 10 % 10;
+    table.data[3*i + 2] = i % 10;
+  }
+  EXPECT_RETURN(cjIntTuplesNarrow(&table), CJ_ERROR_OK);
+  CjTableIndex index = cjTableIndexInit();
+  EXPECT_RETURN(cjTableIndexAlloc(&table, &index), CJ_ERROR_OK);
+  EXPECT_EQ(index.capacity >= 2 * table.size, 1);
+  for (int i = 0; i < table.size; ++i) {
+    const int tuple[] = {i / 100, i / 10 % 10, i % 10};
+    EXPECT_EQ(cjTableIndexFind(&index, &table, tuple), i);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    const int tuple[] = {i / 100, i / 10 % 10, 10 + i % 10};
+    EXPECT_EQ(cjTableIndexFind(&index, &table, tuple), -1);
+  }
+  cjTableIndexFree(&index);
+  EXPECT_EQ(index.capacity, 0);
+  cjIntTuplesFree(&table);
+}
+
+/** Tuples of values in [0, 10) with an even sum share a 2 node per level MDD. */
+void cjMddTestHasExpand() {
+  CjIntTuples table = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(500, 3, &table), CJ_ERROR_OK);
+  int size = 0;
+  for (int v = 999; v >= 0; --v) {
+    if ((v / 100 + v / 10 % 10 + v % 10) % 2 == 0) {
+      table.data[3*size + 0] = v / 100;
+      table.data[3*size + 1] = v / 10 % 10;
+      table.data[3*size + 2] = v % 10;
+      ++size;
+    }
+  }
+  EXPECT_EQ(size, 500);
+
+  CjMdd mdd = cjMddInit();
+  EXPECT_RETURN(cjMddAlloc(&table, &mdd), CJ_ERROR_OK);
+  EXPECT_EQ(mdd.arity, 3);
+  EXPECT_EQ(mdd.nodes.size - 1, 5);
+  EXPECT_EQ(mdd.edges.size, 40);
+  for (int v = 0; v < 1000; ++v) {
+    const int tuple[] = {v / 100, v / 10 % 10, v % 10};
+    const int expected = (tuple[0] + tuple[1] + tuple[2]) % 2 == 0;
+    EXPECT_EQ(cjMddHas(&mdd, tuple), expected);
+  }
+
+  CjIntTuples expanded = cjIntTuplesInit();
+  EXPECT_RETURN(cjMddExpand(&mdd, &expanded), CJ_ERROR_OK);
+  EXPECT_EQ(expanded.size, 500);
+  EXPECT_EQ(expanded.arity, 3);
+  EXPECT_EQ(isSortedTuples(&expanded), 1);
+  EXPECT_EQ(expanded.data[0] + expanded.data[1] + expanded.data[2], 0);
+
+  cjIntTuplesFree(&expanded);
+  cjMddFree(&mdd);
+  cjIntTuplesFree(&table);
+}
+
+/** Ranges, dense and sparse values map to 0..d-1 in order and back. */
+void cjValueIndexTestTypes() {
+  CjDomain domains[3];
+  EXPECT_RETURN(cjDomainRangeInit(-5, 5, &domains[0]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjDomainValuesAlloc(4, &domains[1]), CJ_ERROR_OK);
+  domains[1].values.data[0] = 5;
+  domains[1].values.data[1] = 1;
+  domains[1].values.data[2] = 2;
+  domains[1].values.data[3] = 3;
+  EXPECT_RETURN(cjDomainValuesAlloc(1000, &domains[2]), CJ_ERROR_OK);
+  for (int i = 0; i < 1000; ++i) { domains[2].values.data[i] = 7919 * (500 - i); }
+  const int types[] = {CJ_VALUE_INDEX_RANGE, CJ_VALUE_INDEX_DENSE, CJ_VALUE_INDEX_HASH};
+  const int sizes[] = {11, 4, 1000};
+
+  for (int iDom = 0; iDom < 3; ++iDom) {
+    CjValueIndex index = cjValueIndexInit();
+    EXPECT_RETURN(cjValueIndexAlloc(&domains[iDom], &index), CJ_ERROR_OK);
+    EXPECT_EQ(index.type, types[iDom]);
+    EXPECT_EQ(index.size, sizes[iDom]);
+    for (int i = 0; i < index.size; ++i) {
+      const int value = cjValueIndexValue(&index, i);
+      EXPECT_EQ(cjValueIndexOf(&index, value), i);
+      EXPECT_EQ(cjDomainHasValue(&domains[iDom], value), 1);
+      if (i > 0) { EXPECT_EQ(cjValueIndexValue(&index, i - 1) < value, 1); }
+    }
+    EXPECT_EQ(cjValueIndexOf(&index, 6), -1);
+    EXPECT_EQ(cjValueIndexOf(&index, INT_MIN), -1);
+    EXPECT_EQ(cjValueIndexOf(&index, INT_MAX), -1);
+    cjValueIndexFree(&index);
+    cjDomainFree(&domains[iDom]);
+  }
+}
+
+/** A csp of a sparse and a range domain for the index space tests. */
+CjCsp makeIndexSpaceCsp() {
+  CjCsp csp = cjCspInit();
+  csp.domainsSize = 2;
+  csp.domains = cjDomainArray(2);
+  EXPECT_RETURN(cjDomainValuesAlloc(3, &csp.domains[0]), CJ_ERROR_OK);
+  csp.domains[0].values.data[0] = 1000000;
+  csp.domains[0].values.data[1] = -100;
+  csp.domains[0].values.data[2] = 0;
+  EXPECT_RETURN(cjDomainRangeInit(5, 7, &csp.domains[1]), CJ_ERROR_OK);
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &csp.vars), CJ_ERROR_OK);
+  csp.vars.data[0] = 0;
+  csp.vars.data[1] = 1;
+  csp.vars.data[2] = 0;
+  csp.constraintDefsSize = 1;
+  csp.constraintDefs = cjConstraintDefArray(1);
+  // [3, 5] has a value outside of the domain and is dropped.
+  const int noGoods[] = {-100,5, 3,5, 1000000,7};
+  allocNoGoods2(3, noGoods, &csp.constraintDefs[0]);
+  csp.constraintsSize = 2;
+  csp.constraints = cjConstraintArray(2);
+  allocConstraint2(0, 0, 1, &csp.constraints[0]);
+  allocConstraint2(0, 2, 1, &csp.constraints[1]);
+  return csp;
+}
+
+/** A sparse and a range domain: tables and solutions map to indexes and back. */
+void cjCspToIndexSpaceTestRoundtrip() {
+  CjCsp csp = makeIndexSpaceCsp();
+  CjValueIndex* indexes = NULL;
+  EXPECT_RETURN(cjCspBuildValueIndex(&csp, &indexes), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspToIndexSpace(&csp, indexes), CJ_ERROR_OK);
+  EXPECT_EQ(csp.domains[0].type, CJ_DOMAIN_RANGE);
+  EXPECT_EQ(csp.domains[0].range.hi, 2);
+  EXPECT_EQ(csp.domains[1].range.lo, 0);
+  const CjIntTuples* table = &csp.constraintDefs[0].noGoods;
+  EXPECT_EQ(table->size, 2);
+  EXPECT_EQ(cjIntTuplesGet(table, 0), 0);
+  EXPECT_EQ(cjIntTuplesGet(table, 1), 0);
+  EXPECT_EQ(cjIntTuplesGet(table, 2), 2);
+  EXPECT_EQ(cjIntTuplesGet(table, 3), 2);
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(3, -1, &solution), CJ_ERROR_OK);
+  solution.data[0] = 0;
+  solution.data[1] = 7;
+  solution.data[2] = 1000000;
+  EXPECT_RETURN(cjCspSolutionToIndexSpace(&csp, indexes, &solution), CJ_ERROR_OK);
+  EXPECT_EQ(solution.data[0], 1);
+  EXPECT_EQ(solution.data[1], 2);
+  EXPECT_EQ(solution.data[2], 2);
+  int solved = -1;
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 0);
+  EXPECT_RETURN(cjCspSolutionFromIndexSpace(&csp, indexes, &solution), CJ_ERROR_OK);
+  EXPECT_EQ(solution.data[2], 1000000);
+
+  EXPECT_RETURN(cjCspFromIndexSpace(&csp, indexes), CJ_ERROR_OK);
+  EXPECT_EQ(csp.domains[0].type, CJ_DOMAIN_VALUES);
+  EXPECT_EQ(csp.domains[0].values.data[0], -100);
+  EXPECT_EQ(csp.domains[1].range.lo, 5);
+  EXPECT_EQ(cjIntTuplesGet(table, 0), -100);
+  EXPECT_EQ(cjIntTuplesGet(table, 3), 7);
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 0);
+
+  cjIntTuplesFree(&solution);
+  cjValueIndexArrayFree(&indexes, csp.domainsSize);
+  cjCspFree(&csp);
+}
+
+/** Fail once (*user) allocations have succeeded. */
+static void* failingAllocate(void* user, size_t size) {
+  int* left = (int*) user;
+  if (*left == 0) { return NULL; }
+  --(*left);
+  return malloc(size);
+}
+
+static void* failingReallocate(void* user, void* ptr, size_t size) {
+  int* left = (int*) user;
+  if (*left == 0) { return NULL; }
+  --(*left);
+  return realloc(ptr, size);
+}
+
+static void failingDeallocate(void* user, void* ptr) {
+  (void) user;
+  free(ptr);
+}
+
+/**
+ * Whichever allocation fails, cjCspToIndexSpace() and cjCspFromIndexSpace()
+ * leave the csp as it was. From the index space, the table is rewritten
+ * before the sparse domain is allocated.
+ */
+void cjCspToIndexSpaceTestFailureKeepsCsp() {
+  for (int toIndex = 1; toIndex >= 0; --toIndex) {
+    for (int budget = 0; ; ++budget) {
+      CjCsp csp = makeIndexSpaceCsp();
+      CjValueIndex* indexes = NULL;
+      EXPECT_RETURN(cjCspBuildValueIndex(&csp, &indexes), CJ_ERROR_OK);
+      if (!toIndex) { EXPECT_RETURN(cjCspToIndexSpace(&csp, indexes), CJ_ERROR_OK); }
+      int left = budget;
+      const CjAllocator allocator = {failingAllocate, failingReallocate, failingDeallocate, &left};
+      cjSetThreadAllocator(&allocator);
+      const CjError err = toIndex ? cjCspToIndexSpace(&csp, indexes) : cjCspFromIndexSpace(&csp, indexes);
+      cjSetThreadAllocator(NULL);
+      const int done = err == CJ_ERROR_OK;
+      if (!done) {
+        EXPECT_RETURN(err, CJ_ERROR_NOMEM);
+        const CjIntTuples* table = &csp.constraintDefs[0].noGoods;
+        EXPECT_EQ(csp.domains[0].type, (toIndex ? CJ_DOMAIN_VALUES : CJ_DOMAIN_RANGE));
+        EXPECT_EQ(csp.domains[1].range.lo, (toIndex ? 5 : 0));
+        EXPECT_EQ(table->size, (toIndex ? 3 : 2));
+        EXPECT_EQ(cjIntTuplesGet(table, 0), (toIndex ? -100 : 0));
+      }
+      cjValueIndexArrayFree(&indexes, csp.domainsSize);
+      cjCspFree(&csp);
+      if (done) { break; }
+    }
+  }
+}
+
+/** A clone shares the constraints until either side modifies them. */
+void cjCspCloneTestCopyOnWrite() {
+  CjCsp csp = makePredicatesCsp();
+  CjCsp clone = cjCspInit();
+  EXPECT_RETURN(cjCspClone(&csp, &clone), CJ_ERROR_OK);
+  EXPECT_PTR_EQ(clone.constraintDefs, csp.constraintDefs);
+  EXPECT_PTR_EQ(clone.constraints, csp.constraints);
+  EXPECT_PTR_NEQ(clone.domains, csp.domains);
+  EXPECT_RETURN(cjCspValidate(&clone), CJ_ERROR_OK);
+
+  // Modify the clone: the original keeps its predicates.
+  EXPECT_RETURN(cjCspExpandPredicates(&clone), CJ_ERROR_OK);
+  EXPECT_PTR_NEQ(clone.constraintDefs, csp.constraintDefs);
+  EXPECT_EQ(csp.constraintDefs[0].type, CJ_CONSTRAINT_DEF_PREDICATE);
+  EXPECT_EQ(clone.constraintDefs[0].type, CJ_CONSTRAINT_DEF_NO_GOODS);
+  EXPECT_PTR_EQ(clone.constraintDefsRefs, NULL);
+
+  // A clone of a clone outlives both.
+  CjCsp clone2 = cjCspInit();
+  EXPECT_RETURN(cjCspClone(&clone, &clone2), CJ_ERROR_OK);
+  cjCspFree(&clone);
+  cjCspFree(&csp);
+  EXPECT_RETURN(cjCspValidate(&clone2), CJ_ERROR_OK);
+  EXPECT_EQ(clone2.constraintDefs[0].type, CJ_CONSTRAINT_DEF_NO_GOODS);
+  EXPECT_RETURN(cjCspUnshareConstraints(&clone2), CJ_ERROR_OK);
+  EXPECT_PTR_EQ(clone2.constraintsRefs, NULL);
+  cjCspFree(&clone2);
+}
+
+/**
+ * Writing one def of a clone copies that def only: the others stay shared
+ * and outlive the csp they were cloned from.
+ */
+void cjCspCloneTestUnshareOneDef() {
+  CjCsp csp = makeCsp3Vars();
+  const int noGoods[3][2] = {{0, 0}, {0, 1}, {1, 1}};
+  csp.constraintDefsSize = 3;
+  csp.constraintDefs = cjConstraintDefArray(3);
+  csp.constraintsSize = 3;
+  csp.constraints = cjConstraintArray(3);
+  for (int i = 0; i < 3; ++i) {
+    allocNoGoods2(1, noGoods[i], &csp.constraintDefs[i]);
+    allocConstraint2(i, i, (i + 1) % 3, &csp.constraints[i]);
+  }
+  CjCsp clone = cjCspInit();
+  EXPECT_RETURN(cjCspClone(&csp, &clone), CJ_ERROR_OK);
+  EXPECT_PTR_EQ(clone.vars.data, csp.vars.data);
+
+  EXPECT_RETURN(cjCspUnshareConstraintDef(&clone, 1), CJ_ERROR_OK);
+  EXPECT_PTR_NEQ(clone.constraintDefs, csp.constraintDefs);
+  EXPECT_PTR_EQ(clone.constraintDefs[0].noGoods.data, csp.constraintDefs[0].noGoods.data);
+  EXPECT_PTR_NEQ(clone.constraintDefs[1].noGoods.data, csp.constraintDefs[1].noGoods.data);
+  EXPECT_PTR_EQ(clone.constraintDefs[2].noGoods.data, csp.constraintDefs[2].noGoods.data);
+  clone.constraintDefs[1].noGoods.data[0] = 1;
+  EXPECT_EQ(csp.constraintDefs[1].noGoods.data[0], 0);
+
+  EXPECT_RETURN(cjCspVarsCompress(&clone), CJ_ERROR_OK);
+  EXPECT_EQ(csp.vars.size, 3);
+  EXPECT_PTR_EQ(clone.varsRefs, NULL);
+
+  // The borrowed defs outlive csp, then are copied once written.
+  cjCspFree(&csp);
+  EXPECT_RETURN(cjCspValidate(&clone), CJ_ERROR_OK);
+  EXPECT_EQ(clone.constraintDefs[2].noGoods.data[0], 1);
+  EXPECT_RETURN(cjCspUnshareConstraintDef(&clone, 0), CJ_ERROR_OK);
+  EXPECT_PTR_NEQ(clone.constraintDefsRefs, NULL);
+  EXPECT_RETURN(cjCspUnshareConstraintDefs(&clone), CJ_ERROR_OK);
+  EXPECT_PTR_EQ(clone.constraintDefsRefs, NULL);
+
+  // A clone of a clone that borrows: writing one constraint.
+  CjCsp clone2 = cjCspInit();
+  EXPECT_RETURN(cjCspClone(&clone, &clone2), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspUnshareConstraint(&clone2, 2), CJ_ERROR_OK);
+  CjCsp clone3 = cjCspInit();
+  EXPECT_RETURN(cjCspClone(&clone2, &clone3), CJ_ERROR_OK);
+  cjCspFree(&clone);
+  cjCspFree(&clone2);
+  EXPECT_RETURN(cjCspValidate(&clone3), CJ_ERROR_OK);
+  EXPECT_EQ(clone3.constraints[2].vars.data[1], 0);
+  cjCspFree(&clone3);
+}
+
+/** A chain of 1000 x_i != x_i+1 constraints, growing each array many times. */
+void cjCspBuilderTestChain() {
+  const int size = 1000;
+  CjCspBuilder b = cjCspBuilderInit();
+  CjDomain domain = cjDomainInit();
+  EXPECT_RETURN(cjDomainRangeInit(0, 1, &domain), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspBuilderAddDomain(&b, &domain), CJ_ERROR_OK);
+  EXPECT_EQ(domain.type, CJ_DOMAIN_UNDEF);
+  CjConstraintDef def = cjConstraintDefInit();
+  EXPECT_RETURN(cjConstraintDefNoGoodAlloc(2, 2, &def), CJ_ERROR_OK);
+  def.noGoods.data[0] = 0; def.noGoods.data[1] = 0;
+  def.noGoods.data[2] = 1; def.noGoods.data[3] = 1;
+  EXPECT_RETURN(cjCspBuilderAddConstraintDef(&b, &def), CJ_ERROR_OK);
+  EXPECT_EQ(def.type, CJ_CONSTRAINT_DEF_UNDEF);
+  for (int i = 0; i < size; ++i) {
+    EXPECT_RETURN(cjCspBuilderAddVar(&b, 0), CJ_ERROR_OK);
+    if (i > 0) {
+      const int vars[2] = {i - 1, i};
+      EXPECT_RETURN(cjCspBuilderAddConstraint(&b, 0, vars, 2), CJ_ERROR_OK);
+    }
+  }
+  EXPECT_EQ(b.constraintsCapacity >= size - 1, 1);
+
+  CjCsp csp = cjCspInit();
+  EXPECT_RETURN(cjCspBuilderFinish(&b, &csp), CJ_ERROR_OK);
+  EXPECT_EQ(b.csp.constraintsSize, 0);
+  EXPECT_EQ(cjCspVarsSize(&csp), size);
+  EXPECT_EQ(csp.constraintsSize, size - 1);
+  EXPECT_EQ(csp.constraints[size - 2].vars.data[1], size - 1);
+  EXPECT_RETURN(cjCspValidate(&csp), CJ_ERROR_OK);
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(size, -1, &solution), CJ_ERROR_OK);
+  for (int i = 0; i < size; ++i) { solution.data[i] = i % 2; }
+  int solved = -1;
+  EXPECT_RETURN(cjCspIsSolved(&csp, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 1);
+  cjIntTuplesFree(&solution);
+  cjCspFree(&csp);
+  cjCspBuilderFree(&b);
+}
+
+/** The view of vars {2, 0} keeps the constraint z <= x only. */
+void cjCspViewTestPredicates() {
+  CjCsp csp = makePredicatesCsp();
+  CjVarConstraints varConstraints = cjVarConstraintsInit();
+  EXPECT_RETURN(cjVarConstraintsAlloc(&csp, &varConstraints), CJ_ERROR_OK);
+  EXPECT_EQ(varConstraints.offsets.data[1] - varConstraints.offsets.data[0], 2);
+
+  const int vars[] = {2, 0};
+  CjCspView view = cjCspViewInit();
+  EXPECT_RETURN(cjCspViewAlloc(&csp, &varConstraints, vars, 2, &view), CJ_ERROR_OK);
+  EXPECT_EQ(view.vars.size, 2);
+  EXPECT_EQ(view.vars.data[0], 0);
+  EXPECT_EQ(cjCspViewVarOf(&view, 2), 1);
+  EXPECT_EQ(cjCspViewVarOf(&view, 1), -1);
+  EXPECT_EQ(view.constraints.size, 1);
+  EXPECT_EQ(view.constraints.data[0], 2);
+
+  CjIntTuples solution = cjIntTuplesInit();
+  EXPECT_RETURN(cjIntTuplesAlloc(2, -1, &solution), CJ_ERROR_OK);
+  solution.data[0] = 1;
+  solution.data[1] = 0;
+  int solved = -1;
+  EXPECT_RETURN(cjCspViewIsSolved(&view, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 1);
+  solution.data[1] = 2;
+  EXPECT_RETURN(cjCspViewIsSolved(&view, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 0);
+
+  CjCsp sub = cjCspInit();
+  EXPECT_RETURN(cjCspViewMaterialize(&view, &sub), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspValidate(&sub), CJ_ERROR_OK);
+  EXPECT_EQ(sub.domainsSize, 1);
+  EXPECT_EQ(sub.constraintDefsSize, 1);
+  EXPECT_EQ(sub.constraints[0].vars.data[0], 1);
+  EXPECT_EQ(sub.constraints[0].vars.data[1], 0);
+  EXPECT_RETURN(cjCspIsSolved(&sub, &solution, &solved), CJ_ERROR_OK);
+  EXPECT_EQ(solved, 0);
+
+  const int dup[] = {1, 1};
+  CjCspView bad = cjCspViewInit();
+  EXPECT_RETURN(cjCspViewAlloc(&csp, NULL, dup, 2, &bad), CJ_ERROR_ARG);
+
+  cjCspFree(&sub);
+  cjIntTuplesFree(&solution);
+  cjCspViewFree(&view);
+  cjVarConstraintsFree(&varConstraints);
+  cjCspFree(&csp);
+}
+
+/** Counts the live allocations of an allocator wrapping malloc. */
+typedef struct CountingAllocator {
+  atomic_int live;
+  atomic_int total;
+} CountingAllocator;
+
+static void* countingAllocate(void* user, size_t size) {
+  CountingAllocator* a = (CountingAllocator*) user;
+  void* ptr = malloc(size);
+  if (ptr) { atomic_fetch_add(&a->live, 1); atomic_fetch_add(&a->total, 1); }
+  return ptr;
+}
+
+static void* countingReallocate(void* user, void* ptr, size_t size) {
+  CountingAllocator* a = (CountingAllocator*) user;
+  void* newPtr = realloc(ptr, size);
+  if (newPtr && !ptr) { atomic_fetch_add(&a->live, 1); atomic_fetch_add(&a->total, 1); }
+  return newPtr;
+}
+
+static void countingDeallocate(void* user, void* ptr) {
+  CountingAllocator* a = (CountingAllocator*) user;
+  if (ptr) { atomic_fetch_sub(&a->live, 1); }
+  free(ptr);
+}
+
+/** Every allocation, including those of worker threads, goes through the thread allocator. */
+void cjSetThreadAllocatorTestCounting() {
+  CountingAllocator counts;
+  atomic_init(&counts.live, 0);
+  atomic_init(&counts.total, 0);
+  const CjAllocator allocator = {countingAllocate, countingReallocate, countingDeallocate, &counts};
+  cjSetThreadAllocator(&allocator);
+  EXPECT_PTR_EQ(cjGetAllocator().user, &counts);
+
+  CjCsp csp = makePredicatesCsp();
+  EXPECT_RETURN(cjCspExpandPredicates(&csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspNormalizeParallel(&csp, 4), CJ_ERROR_OK);
+  CjCsp clone = cjCspInit();
+  EXPECT_RETURN(cjCspClone(&csp, &clone), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspCanonicalize(&clone), CJ_ERROR_OK);
+  EXPECT_EQ(atomic_load(&counts.total) > 0, 1);
+  cjCspFree(&clone);
+  cjCspFree(&csp);
+  EXPECT_EQ(atomic_load(&counts.live), 0);
+
+  cjSetThreadAllocator(NULL);
+  EXPECT_PTR_EQ(cjGetAllocator().user, NULL);
+}
+
+void cjCspMemoryUsageTestNarrow() {
+  CjCsp csp = makePredicatesCsp();
+  CjMemoryUsage mem;
+  EXPECT_RETURN(cjCspMemoryUsage(&csp, &mem), CJ_ERROR_OK);
+  EXPECT_EQ(mem.meta.bytes, 0);
+  // The domains array and the 3 values of domain 1, 3 bytes each too wide.
+  EXPECT_EQ(mem.domains.allocations, 2);
+  EXPECT_EQ(mem.domains.bytes, 2 * sizeof(CjDomain) + 3 * sizeof(int));
+  EXPECT_EQ(mem.domains.wasted, 3 * (sizeof(int) - 1));
+  EXPECT_EQ(mem.constraints.allocations, 4);
+  EXPECT_EQ(mem.total.bytes, mem.domains.bytes + mem.vars.bytes + mem.constraintDefs.bytes + mem.constraints.bytes);
+
+  EXPECT_RETURN(cjCspNarrow(&csp), CJ_ERROR_OK);
+  EXPECT_RETURN(cjCspMemoryUsage(&csp, &mem), CJ_ERROR_OK);
+  EXPECT_EQ(mem.total.wasted, 0);
+  EXPECT_EQ(mem.domains.bytes, 2 * sizeof(CjDomain) + 3);
+  cjCspFree(&csp);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // main
 
@@ -98,12 +1034,36 @@ int main(int argc, char** argv) {
 
   TEST(cjIntTuplesArrayTestSize2());
   TEST(cjIntTuplesInitFree());
+  TEST(cjIntTuplesNarrowTestWidths());
+  TEST(cjTableIndexTestFind());
+  TEST(cjMddTestHasExpand());
 
   TEST(cjDomainArrayTestSize2());
+  TEST(cjValueIndexTestTypes());
 
   TEST(cjConstraintDefArrayTestSize2());
 
   TEST(cjCspInitFree());
+  TEST(cjCspNormalizeTestArity3());
+  TEST(cjCspNormalizeTestLarge());
+  TEST(cjCspNormalizeParallelTestLarge());
+  TEST(cjCspDedupConstraintDefsTestIdentical());
+  TEST(cjCspDedupConstraintDefsTestTransposed());
+  TEST(cjCspNarrowTestNormalizeIsSolved());
+  TEST(cjCspIsSolvedTestIndexed());
+  TEST(cjCspIsSolvedTestErrorLeavesSolved());
+  TEST(cjCspIsSolvedTestAllDifferent());
+  TEST(cjCspExpandPredicatesTestSameSolutions());
+  TEST(cjPredicateHoldsTestExtremes());
+  TEST(cjCspCompactTablesTestSameSolutions());
+  TEST(cjCspToIndexSpaceTestRoundtrip());
+  TEST(cjCspToIndexSpaceTestFailureKeepsCsp());
+  TEST(cjCspCloneTestCopyOnWrite());
+  TEST(cjCspCloneTestUnshareOneDef());
+  TEST(cjCspBuilderTestChain());
+  TEST(cjCspViewTestPredicates());
+  TEST(cjSetThreadAllocatorTestCounting());
+  TEST(cjCspMemoryUsageTestNarrow());
 
   return 0;
 }
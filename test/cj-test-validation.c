@@ -14,11 +14,20 @@ int testCjCspIsValid(const char* cspJson, size_t cspJsonLen) {
   }
 
   CjError err = cjCspValidate(&csp);
+  cjCspFree(&csp);
   if (err != CJ_ERROR_OK) {
     printf("FAIL: cjCspValidate(%d) invalidated incorrectly.\n", err);
     return 1;
   }
 
+  err = cjCspJsonParseFlags(cspJson, cspJsonLen, CJ_PARSE_VALIDATE, &csp);
+  const int validated = csp.validated;
+  cjCspFree(&csp);
+  if (err != CJ_ERROR_OK || !validated) {
+    printf("FAIL: CJ_PARSE_VALIDATE(%d) invalidated incorrectly.\n", err);
+    return 1;
+  }
+
   return 0;
 }
 
@@ -31,11 +40,19 @@ int testCjCspIsInvalid(const char* cspJson, size_t cspJsonLen) {
   }
 
   CjError err = cjCspValidate(&csp);
+  cjCspFree(&csp);
   if (err == CJ_ERROR_OK) {
     printf("FAIL: cjCspValidate(%d) validated incorrectly.\n", err);
     return 1;
   }
 
+  CjError parseErr = cjCspJsonParseFlags(cspJson, cspJsonLen, CJ_PARSE_VALIDATE, &csp);
+  cjCspFree(&csp);
+  if (parseErr != err || !cjErrorIsValidation(parseErr)) {
+    printf("FAIL: CJ_PARSE_VALIDATE(%d) differs from cjCspValidate(%d).\n", parseErr, err);
+    return 1;
+  }
+
   return 0;
 }
 
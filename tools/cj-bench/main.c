@@ -0,0 +1,461 @@
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../cj/cj-csp.h"
+#include "../../cj/cj-csp-io.h"
+#include "../cj-gen-urbcsp/urbcsp.h"
+
+void printUsage() {
+  fprintf(stderr,
+    "Usage: cj-bench [--warmup N] [--reps N] [--threads N] [--seed S] [--scale small|medium|large|N,D,C,T]...\n"
+    "\n"
+    "  Generates urbcsp instances of N vars, D values, C constraints and T < D*D\n"
+    "  noGoods per constraint in-process and times parse, print, validate, normalize\n"
+    "  and isSolved on each. Each scale runs in its own process, so that its max RSS\n"
+    "  is its own. Prints the results as JSON. Default scales: small, medium.\n");
+}
+
+/** Parse value as a whole number in [min, max] into (*out). @return false if it is not one. */
+static bool parseInt(const char* value, long min, long max, int* out) {
+  char* end = NULL;
+  const long parsed = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || parsed < min || parsed > max) { return false; }
+  *out = (int) parsed;
+  return true;
+}
+
+/** An urbcsp instance size. */
+typedef struct Scale {
+  const char* name;
+  int n;
+  int d;
+  int c;
+  int t;
+} Scale;
+
+static const Scale namedScales[] = {
+  {"small",   100, 10,   500,  30},
+  {"medium",  500, 20,  5000, 150},
+  {"large",  2000, 30, 20000, 300},
+};
+
+/** The library entry points timed for each scale. */
+typedef enum BenchOp {
+  BENCH_PARSE,
+  BENCH_PRINT,
+  BENCH_VALIDATE,
+  BENCH_NORMALIZE,
+  BENCH_IS_SOLVED,
+  BENCH_OP_SIZE
+} BenchOp;
+
+static const char* benchOpNames[BENCH_OP_SIZE] = {"parse", "print", "validate", "normalize", "isSolved"};
+
+/** Allocator counting the live and peak bytes of the library. Blocks are prefixed by their size. */
+typedef struct PeakAllocator {
+  atomic_size_t live;
+  atomic_size_t peak;
+} PeakAllocator;
+
+/** Keeps the blocks handed out max_align_t aligned. */
+#define PEAK_HEADER_SIZE 16
+
+static void peakAdd(PeakAllocator* a, size_t size) {
+  const size_t live = atomic_fetch_add(&a->live, size) + size;
+  size_t peak = atomic_load(&a->peak);
+  while (live > peak && !atomic_compare_exchange_weak(&a->peak, &peak, live)) {}
+}
+
+static void* peakAllocate(void* user, size_t size) {
+  char* block = (char*) malloc(size + PEAK_HEADER_SIZE);
+  if (!block) { return NULL; }
+  *(size_t*) block = size;
+  peakAdd((PeakAllocator*) user, size);
+  return block + PEAK_HEADER_SIZE;
+}
+
+static void* peakReallocate(void* user, void* ptr, size_t size) {
+  if (!ptr) { return peakAllocate(user, size); }
+  char* block = (char*) ptr - PEAK_HEADER_SIZE;
+  const size_t oldSize = *(size_t*) block;
+  block = (char*) realloc(block, size + PEAK_HEADER_SIZE);
+  if (!block) { return NULL; }
+  *(size_t*) block = size;
+  // Count the old block until the new one exists, like realloc may need.
+  peakAdd((PeakAllocator*) user, size);
+  atomic_fetch_sub(&((PeakAllocator*) user)->live, oldSize);
+  return block + PEAK_HEADER_SIZE;
+}
+
+static void peakDeallocate(void* user, void* ptr) {
+  if (!ptr) { return; }
+  char* block = (char*) ptr - PEAK_HEADER_SIZE;
+  atomic_fetch_sub(&((PeakAllocator*) user)->live, *(size_t*) block);
+  free(block);
+}
+
+/** The inputs of the timed calls of one scale. */
+typedef struct Bench {
+  int threads;
+  PeakAllocator* allocator;
+  FILE* devNull;
+  /** The generated instance, as printed by cjCspJsonPrint(). */
+  char* json;
+  size_t jsonLen;
+  CjCsp csp;
+  /** csp changed so that solution, all zeros, solves it. */
+  CjCsp planted;
+  CjIntTuples solution;
+  /** Set by benchStart() and benchStop(). */
+  size_t liveAtStart;
+  size_t peakBytes;
+} Bench;
+
+/** @return the start time of a timed call, from which on peak bytes are counted. */
+static uint64_t benchStart(Bench* b) {
+  b->liveAtStart = atomic_load(&b->allocator->live);
+  atomic_store(&b->allocator->peak, b->liveAtStart);
+  return cjStatsNowNs();
+}
+
+/** Set (*ns) to the time since start and keep the max peak bytes above the start. */
+static void benchStop(Bench* b, uint64_t start, uint64_t* ns) {
+  *ns = cjStatsNowNs() - start;
+  const size_t peak = atomic_load(&b->allocator->peak) - b->liveAtStart;
+  if (peak > b->peakBytes) { b->peakBytes = peak; }
+}
+
+/** Reverse the rows of tuples, so that sorting them has work to do. */
+static void reverseRows(CjIntTuples* tuples) {
+  const int arity = tuples->arity < 0 ? 1 : tuples->arity;
+  for (int lo = 0, hi = tuples->size - 1; lo < hi; ++lo, --hi) {
+    for (int i = 0; i < arity; ++i) {
+      const int tmp = cjIntTuplesGet(tuples, (size_t) lo * arity + i);
+      cjIntTuplesSet(tuples, (size_t) lo * arity + i, cjIntTuplesGet(tuples, (size_t) hi * arity + i));
+      cjIntTuplesSet(tuples, (size_t) hi * arity + i, tmp);
+    }
+  }
+}
+
+/** @return 1 if the row [a, b] is in the arity 2 tuples. */
+static int hasRow(const CjIntTuples* tuples, int a, int b) {
+  for (int iRow = 0; iRow < tuples->size; ++iRow) {
+    if (cjIntTuplesGet(tuples, 2 * iRow) == a && cjIntTuplesGet(tuples, 2 * iRow + 1) == b) { return 1; }
+  }
+  return 0;
+}
+
+/**
+ * Replace the noGood [0, 0] of each constraintDef with a pair it lacks, so
+ * that assigning 0 to every var solves csp and isSolved checks all constraints.
+ * Fails with CJ_ERROR_ARG if a def lacks no pair, ie. has all d*d noGoods.
+ */
+static CjError plantZeroSolution(CjCsp* csp, int d) {
+  for (int iDef = 0; iDef < csp->constraintDefsSize; ++iDef) {
+    CjIntTuples* noGoods = &csp->constraintDefs[iDef].noGoods;
+    for (int iRow = 0; iRow < noGoods->size; ++iRow) {
+      if (cjIntTuplesGet(noGoods, 2 * iRow) != 0 || cjIntTuplesGet(noGoods, 2 * iRow + 1) != 0) { continue; }
+      int pair = 1;
+      while (pair < d * d && hasRow(noGoods, pair / d, pair % d)) { ++pair; }
+      if (pair == d * d) { return CJ_ERROR_ARG; }
+      cjIntTuplesSet(noGoods, 2 * iRow, pair / d);
+      cjIntTuplesSet(noGoods, 2 * iRow + 1, pair % d);
+    }
+  }
+  return cjCspNormalize(csp);
+}
+
+/** Time one call of op into (*ns); setup and cleanup are not timed. */
+static CjError benchRep(BenchOp op, Bench* b, uint64_t* ns) {
+  CjError err = CJ_ERROR_OK;
+  CjCsp csp = cjCspInit();
+  uint64_t start = 0;
+  int solved = 0;
+  switch (op) {
+    case BENCH_PARSE:
+      start = benchStart(b);
+      err = cjCspJsonParse(b->json, b->jsonLen, &csp);
+      benchStop(b, start, ns);
+      break;
+    case BENCH_PRINT:
+      start = benchStart(b);
+      err = cjCspJsonPrint(b->devNull, &b->csp);
+      fflush(b->devNull);
+      benchStop(b, start, ns);
+      break;
+    case BENCH_VALIDATE:
+      start = benchStart(b);
+      err = cjCspValidate(&b->csp);
+      benchStop(b, start, ns);
+      break;
+    case BENCH_NORMALIZE:
+      err = cjCspJsonParse(b->json, b->jsonLen, &csp);
+      if (err != CJ_ERROR_OK) { break; }
+      for (int iDom = 0; iDom < csp.domainsSize; ++iDom) {
+        if (csp.domains[iDom].type == CJ_DOMAIN_VALUES) { reverseRows(&csp.domains[iDom].values); }
+      }
+      for (int iDef = 0; iDef < csp.constraintDefsSize; ++iDef) {
+        if (csp.constraintDefs[iDef].type == CJ_CONSTRAINT_DEF_NO_GOODS) { reverseRows(&csp.constraintDefs[iDef].noGoods); }
+      }
+      start = benchStart(b);
+      err = cjCspNormalizeParallel(&csp, b->threads);
+      benchStop(b, start, ns);
+      break;
+    case BENCH_IS_SOLVED:
+      start = benchStart(b);
+      err = cjCspIsSolved(&b->planted, &b->solution, &solved);
+      benchStop(b, start, ns);
+      if (err == CJ_ERROR_OK && !solved) { err = CJ_ERROR; }
+      break;
+    default:
+      err = CJ_ERROR_ARG;
+  }
+  cjCspFree(&csp);
+  return err;
+}
+
+static int compareNs(const void* a, const void* b) {
+  const uint64_t x = *(const uint64_t*) a;
+  const uint64_t y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+/** @return the nearest-rank percentile p of the sorted samples. */
+static uint64_t percentile(const uint64_t* sorted, int size, int p) {
+  int rank = (p * size + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/** Print the JSON result of the sorted samples of op. */
+static void printResult(BenchOp op, const Bench* b, const Scale* scale, const uint64_t* sorted, int reps) {
+  uint64_t sum = 0;
+  for (int iRep = 0; iRep < reps; ++iRep) { sum += sorted[iRep]; }
+  const uint64_t p50 = percentile(sorted, reps, 50);
+  const double seconds = p50 > 0 ? p50 / 1e9 : 1e-9;
+  printf("        {\"op\": \"%s\", \"ns\": {\"min\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu, \"mean\": %llu}, "
+    "\"mbPerS\": %.1f, \"constraintsPerS\": %.0f, \"peakBytes\": %zu}",
+    benchOpNames[op],
+    (unsigned long long) sorted[0], (unsigned long long) p50,
+    (unsigned long long) percentile(sorted, reps, 90), (unsigned long long) percentile(sorted, reps, 99),
+    (unsigned long long) sorted[reps - 1], (unsigned long long) (sum / reps),
+    b->jsonLen / 1e6 / seconds, scale->c / seconds, b->peakBytes);
+}
+
+static void benchFree(Bench* b) {
+  free(b->json);
+  b->json = NULL;
+  b->jsonLen = 0;
+  cjCspFree(&b->csp);
+  cjCspFree(&b->planted);
+  cjIntTuplesFree(&b->solution);
+}
+
+/**
+ * Check cjCspMemoryUsage() against reality: parse the instance once more and
+ * print the bytes it reports next to the heap bytes the parsed csp holds and
+ * the max RSS of the process, then close the JSON object of the scale.
+ */
+static CjError benchMemory(Bench* b) {
+  CjCsp csp = cjCspInit();
+  const size_t liveBefore = atomic_load(&b->allocator->live);
+  CjError err = cjCspJsonParse(b->json, b->jsonLen, &csp);
+  const size_t heapBytes = atomic_load(&b->allocator->live) - liveBefore;
+  CjMemoryUsage usage;
+  if (err == CJ_ERROR_OK) { err = cjCspMemoryUsage(&csp, &usage); }
+  cjCspFree(&csp);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  // Per scale, as each scale runs in its own process.
+  struct rusage rusage;
+  getrusage(RUSAGE_SELF, &rusage);
+  const size_t usageBytes = usage.total.bytes;
+  if (usageBytes != heapBytes) {
+    fprintf(stderr, "WARNING: cjCspMemoryUsage() reports %zu bytes, the parsed csp holds %zu.\n", usageBytes, heapBytes);
+  }
+  if (usageBytes > (size_t) rusage.ru_maxrss * 1024) {
+    fprintf(stderr, "WARNING: cjCspMemoryUsage() reports %zu bytes, over the max RSS of %ld kB.\n", usageBytes, rusage.ru_maxrss);
+  }
+  printf("      \"memory\": {\"usageBytes\": %zu, \"heapBytes\": %zu, \"maxRssPerUsage\": %.2f},\n",
+    usageBytes, heapBytes, usageBytes > 0 ? rusage.ru_maxrss * 1024.0 / usageBytes : 0.0);
+  printf("      \"maxRssKb\": %ld}", rusage.ru_maxrss);
+  return CJ_ERROR_OK;
+}
+
+/** Generate the instance of scale and print the JSON results of every op on it. */
+static CjError benchScale(const Scale* scale, int32_t seed, int warmup, int reps, Bench* b) {
+  CjError err = CJ_ERROR_OK;
+  int32_t Seed = seed > 0 ? -seed : seed;
+  const uint64_t generateStart = cjStatsNowNs();
+  if (!MakeURBCSP(scale->n, scale->d, scale->c, scale->c, scale->t, seed, &Seed, false, b->threads, &b->csp)) {
+    return CJ_ERROR_ARG;
+  }
+  const uint64_t generateNs = cjStatsNowNs() - generateStart;
+
+  FILE* jsonFile = open_memstream(&b->json, &b->jsonLen);
+  if (!jsonFile) { return CJ_ERROR_NOMEM; }
+  err = cjCspJsonPrint(jsonFile, &b->csp);
+  fclose(jsonFile);
+  if (err != CJ_ERROR_OK) { return err; }
+
+  err = cjCspJsonParseFlags(b->json, b->jsonLen, CJ_PARSE_VALIDATE, &b->planted);
+  if (err == CJ_ERROR_OK) { err = plantZeroSolution(&b->planted, scale->d); }
+  if (err == CJ_ERROR_OK) { err = cjIntTuplesAlloc(scale->n, -1, &b->solution); }
+  if (err != CJ_ERROR_OK) { return err; }
+  for (int iVar = 0; iVar < scale->n; ++iVar) { cjIntTuplesSet(&b->solution, iVar, 0); }
+
+  printf("    {\"name\": \"%s\", \"n\": %d, \"d\": %d, \"c\": %d, \"t\": %d, \"seed\": %d, \"jsonBytes\": %zu, \"generateNs\": %llu,\n",
+    scale->name, scale->n, scale->d, scale->c, scale->t, seed, b->jsonLen, (unsigned long long) generateNs);
+  printf("      \"results\": [\n");
+  uint64_t* samples = (uint64_t*) malloc(sizeof(uint64_t) * reps);
+  if (!samples) { return CJ_ERROR_NOMEM; }
+  for (int op = 0; op < BENCH_OP_SIZE && err == CJ_ERROR_OK; ++op) {
+    for (int iRep = 0; iRep < warmup && err == CJ_ERROR_OK; ++iRep) {
+      err = benchRep((BenchOp) op, b, &samples[0]);
+    }
+    b->peakBytes = 0;
+    for (int iRep = 0; iRep < reps && err == CJ_ERROR_OK; ++iRep) {
+      err = benchRep((BenchOp) op, b, &samples[iRep]);
+    }
+    if (err != CJ_ERROR_OK) {
+      fprintf(stderr, "ERROR(%d): %s failed on scale %s.\n", err, benchOpNames[op], scale->name);
+      break;
+    }
+    qsort(samples, reps, sizeof(uint64_t), compareNs);
+    printResult((BenchOp) op, b, scale, samples, reps);
+    printf(op < BENCH_OP_SIZE - 1 ? ",\n" : "\n");
+  }
+  free(samples);
+  printf("      ],\n");
+  if (err != CJ_ERROR_OK) { return err; }
+  return benchMemory(b);
+}
+
+/**
+ * benchScale() in a child process, so that the max RSS it reports is of this
+ * scale only and not the peak of every scale so far.
+ */
+static CjError benchScaleProcess(const Scale* scale, int32_t seed, int warmup, int reps, Bench* b) {
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid < 0) { return CJ_ERROR; }
+  if (pid == 0) {
+    CjError err = benchScale(scale, seed, warmup, reps, b);
+    benchFree(b);
+    fflush(stdout);
+    _exit(err == CJ_ERROR_OK ? 0 : 1);
+  }
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) { return CJ_ERROR; }
+  return CJ_ERROR_OK;
+}
+
+int main(int argc, char** argv) {
+  int warmup = 2;
+  int reps = 10;
+  int threads = 1;
+  int seed = 1;
+  const int scalesCapacity = argc;
+  Scale* scales = (Scale*) malloc(sizeof(Scale) * scalesCapacity);
+  int scalesSize = 0;
+  if (!scales) { return 1; }
+  for (int iArg = 1; iArg < argc; ) {
+    const char* value = iArg < argc - 1 ? argv[iArg+1] : NULL;
+    if (strcmp(argv[iArg], "--warmup") == 0 && value) {
+      if (!parseInt(value, 0, INT_MAX, &warmup)) {
+        fprintf(stderr, "ERROR: --warmup takes a number >= 0: %s\n\n", value);
+        printUsage();
+        return 1;
+      }
+    }
+    else if (strcmp(argv[iArg], "--reps") == 0 && value) {
+      if (!parseInt(value, 1, INT_MAX, &reps)) {
+        fprintf(stderr, "ERROR: --reps takes a number >= 1: %s\n\n", value);
+        printUsage();
+        return 1;
+      }
+    }
+    else if (strcmp(argv[iArg], "--threads") == 0 && value) {
+      if (!parseInt(value, 0, INT_MAX, &threads)) {
+        fprintf(stderr, "ERROR: --threads takes a number >= 0: %s\n\n", value);
+        printUsage();
+        return 1;
+      }
+    }
+    else if (strcmp(argv[iArg], "--seed") == 0 && value) {
+      if (!parseInt(value, INT32_MIN, INT32_MAX, &seed)) {
+        fprintf(stderr, "ERROR: --seed takes a 32 bit number: %s\n\n", value);
+        printUsage();
+        return 1;
+      }
+    }
+    else if (strcmp(argv[iArg], "--scale") == 0 && value) {
+      Scale* scale = &scales[scalesSize];
+      *scale = (Scale) {value, 0, 0, 0, 0};
+      for (size_t iNamed = 0; iNamed < sizeof(namedScales) / sizeof(Scale); ++iNamed) {
+        if (strcmp(value, namedScales[iNamed].name) == 0) { *scale = namedScales[iNamed]; }
+      }
+      if (scale->n == 0 && sscanf(value, "%d,%d,%d,%d", &scale->n, &scale->d, &scale->c, &scale->t) != 4) {
+        fprintf(stderr, "ERROR: unknown scale: %s\n\n", value);
+        printUsage();
+        return 1;
+      }
+      // A zero solution is planted by replacing a noGood with a pair the constraint lacks.
+      // MakeURBCSP() needs D >= 2 and T >= 1 too.
+      if (scale->d < 2 || scale->t < 1 || scale->t >= (long long) scale->d * scale->d) {
+        fprintf(stderr, "ERROR: scale %s needs D >= 2 and 1 <= T < D*D.\n\n", value);
+        printUsage();
+        return 1;
+      }
+      scalesSize++;
+    }
+    else {
+      fprintf(stderr, "ERROR: unknown argument: %s\n\n", argv[iArg]);
+      printUsage();
+      return 1;
+    }
+    iArg += 2;
+  }
+  if (scalesSize == 0) {
+    scales[scalesSize++] = namedScales[0];
+    scales[scalesSize++] = namedScales[1];
+  }
+
+  // Every library allocation is counted from here on, including worker threads.
+  PeakAllocator peak;
+  atomic_init(&peak.live, 0);
+  atomic_init(&peak.peak, 0);
+  const CjAllocator allocator = {peakAllocate, peakReallocate, peakDeallocate, &peak};
+  cjSetAllocator(&allocator);
+
+  Bench b = {threads, &peak, fopen("/dev/null", "w"), NULL, 0, cjCspInit(), cjCspInit(), cjIntTuplesInit(), 0, 0};
+  if (!b.devNull) {
+    fprintf(stderr, "ERROR: failed to open /dev/null.\n");
+    return 1;
+  }
+
+  CjError err = CJ_ERROR_OK;
+  printf("{\"warmup\": %d, \"reps\": %d, \"threads\": %d, \"statsEnabled\": %s,\n", warmup, reps, threads, cjStatsEnabled() ? "true" : "false");
+  printf("  \"scales\": [\n");
+  for (int iScale = 0; iScale < scalesSize && err == CJ_ERROR_OK; ++iScale) {
+    err = benchScaleProcess(&scales[iScale], seed, warmup, reps, &b);
+    printf(iScale < scalesSize - 1 && err == CJ_ERROR_OK ? ",\n" : "\n");
+  }
+  printf("  ]\n}\n");
+
+  fclose(b.devNull);
+  free(scales);
+  if (err != CJ_ERROR_OK) {
+    fprintf(stderr, "ERROR(%d): benchmark failed.\n", err);
+    return 1;
+  }
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
@@ -8,24 +9,134 @@
 #include "../../cj/cj-csp-io.h"
 #include "../../common/io.h"
 
+/**
+ * Parse the comma separated var indexes of list into (*vars), malloced.
+ * @return false if an entry is empty or not a number in [0, INT_MAX].
+ */
+bool parseVars(const char* list, int** vars, int* varsSize) {
+  *varsSize = 1;
+  for (const char* c = list; *c; ++c) { *varsSize += *c == ','; }
+  *vars = (int*) malloc(sizeof(int) * *varsSize);
+  if (!*vars) { return false; }
+  const char* start = list;
+  for (int i = 0; i < *varsSize; ++i) {
+    char* end = NULL;
+    long value = strtol(start, &end, 10);
+    if (*start < '0' || *start > '9' || (*end != ',' && *end != '\0') || value > INT_MAX) {
+      free(*vars);
+      *vars = NULL;
+      return false;
+    }
+    (*vars)[i] = (int) value;
+    start = end + 1;
+  }
+  return true;
+}
+
 void printUsage() {
-  fprintf(stderr, "Usage: csp-json-satisfied --csp INSTANCE_FILENAME\n");
+  fprintf(stderr, "Usage: cj-echo [--normalize [--threads N]] [--dedup | --dedup-transposed] [--canonical] [--expand-predicates] [--compact-tables] [--compress-mdd | --expand-mdd] [--index-space] [--vars-runs] [--view VAR,VAR,...] [--stats] --csp INSTANCE_FILENAME\n");
 }
 
 int main(int argc, char** argv) {
   int err = 0;
-  if (argc != 3 && argc != 4) {
+  if (argc < 3) {
     fprintf(stderr, "ERROR: number of command line parameters.\n\n");
     printUsage();
     return 1;
   }
   bool normalize = false;
+  bool dedup = false;
+  bool dedupTransposed = false;
+  bool canonical = false;
+  bool varsRuns = false;
+  bool expandPredicates = false;
+  bool compactTables = false;
+  bool compressMdd = false;
+  bool expandMdd = false;
+  bool indexSpace = false;
+  bool stats = false;
+  int threads = 1;
+  char* viewVars = NULL;
+  int* vars = NULL;
+  int varsSize = 0;
   char* cspInstanceFilename = NULL;
   for (int iArg = 1; iArg < argc; ) {
     if (strcmp(argv[iArg], "--normalize") == 0) {
       normalize = true;
       iArg++;
     }
+    else if (strcmp(argv[iArg], "--threads") == 0) {
+      if (iArg >= argc - 1) {
+        fprintf(stderr, "ERROR: --threads flag takes 1 argument.\n\n");
+        printUsage();
+        return 1;
+      }
+      char* end = NULL;
+      long value = strtol(argv[iArg+1], &end, 10);
+      if (end == argv[iArg+1] || *end != '\0' || value < 0 || value > INT_MAX) {
+        fprintf(stderr, "ERROR: --threads takes a number >= 0: %s\n\n", argv[iArg+1]);
+        printUsage();
+        return 1;
+      }
+      threads = (int) value;
+      iArg += 2;
+    }
+    else if (strcmp(argv[iArg], "--canonical") == 0) {
+      canonical = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--expand-predicates") == 0) {
+      expandPredicates = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--compact-tables") == 0) {
+      compactTables = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--compress-mdd") == 0) {
+      compressMdd = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--expand-mdd") == 0) {
+      expandMdd = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--index-space") == 0) {
+      indexSpace = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--vars-runs") == 0) {
+      varsRuns = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--dedup") == 0) {
+      dedup = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--dedup-transposed") == 0) {
+      dedup = true;
+      dedupTransposed = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--stats") == 0) {
+      stats = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--view") == 0) {
+      if (iArg >= argc - 1) {
+        fprintf(stderr, "ERROR: --view flag takes 1 argument.\n\n");
+        printUsage();
+        return 1;
+      }
+      viewVars = argv[iArg+1];
+      free(vars);
+      if (!parseVars(viewVars, &vars, &varsSize)) {
+        fprintf(stderr, "ERROR: --view takes var indexes >= 0 separated by commas: %s\n\n", viewVars);
+        printUsage();
+        return 1;
+      }
+      iArg += 2;
+    }
     else if (strcmp(argv[iArg], "--csp") == 0) {
       if (iArg >= argc - 1) {
         fprintf(stderr, "ERROR: --csp flag takes 1 argument.\n\n");
@@ -60,24 +171,101 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  CjStats cjStats = cjStatsInit();
+  if (stats) { cjSetThreadStats(&cjStats); }
+
   CjCsp csp = cjCspInit();
-  if (CJ_ERROR_OK != (err = cjCspJsonParse(cspJson, cspJsonLen, &csp))) {
+  const int parseFlags = CJ_PARSE_NARROW | (varsRuns ? CJ_PARSE_VARS_RUNS : 0);
+  if (CJ_ERROR_OK != (err = cjCspJsonParseFlags(cspJson, cspJsonLen, parseFlags, &csp))) {
     fprintf(stderr, "ERROR(%d): failed to parse csp instance file.", err);
     return 1;
   }
 
+  if (viewVars) {
+    // Keep the sub-instance induced by the listed vars.
+    CjCspView view = cjCspViewInit();
+    CjCsp viewCsp = cjCspInit();
+    err = cjCspViewAlloc(&csp, NULL, vars, varsSize, &view);
+    if (err == CJ_ERROR_OK) { err = cjCspViewMaterialize(&view, &viewCsp); }
+    cjCspViewFree(&view);
+    free(vars);
+    if (err != CJ_ERROR_OK) {
+      fprintf(stderr, "ERROR(%d): failed to view the csp instance vars: %s", err, viewVars);
+      return 1;
+    }
+    cjCspFree(&csp);
+    csp = viewCsp;
+  }
+
+  if (expandPredicates) {
+    if (CJ_ERROR_OK != (err = cjCspExpandPredicates(&csp))) {
+      fprintf(stderr, "ERROR(%d): failed to expand the csp instance predicates.", err);
+      return 1;
+    }
+  }
+
+  if (expandMdd) {
+    if (CJ_ERROR_OK != (err = cjCspExpandMdd(&csp))) {
+      fprintf(stderr, "ERROR(%d): failed to expand the csp instance MDDs.", err);
+      return 1;
+    }
+  }
+
+  if (indexSpace) {
+    CjValueIndex* indexes = NULL;
+    if (CJ_ERROR_OK != (err = cjCspBuildValueIndex(&csp, &indexes))
+        || CJ_ERROR_OK != (err = cjCspToIndexSpace(&csp, indexes))) {
+      fprintf(stderr, "ERROR(%d): failed to rewrite the csp instance into index space.", err);
+      return 1;
+    }
+    cjValueIndexArrayFree(&indexes, csp.domainsSize);
+  }
+
   if (normalize) {
-    if (CJ_ERROR_OK != (err = cjCspNormalize(&csp))) {
+    if (CJ_ERROR_OK != (err = cjCspNormalizeParallel(&csp, threads))) {
       fprintf(stderr, "ERROR(%d): failed to normalize the csp instance.", err);
       return 1;
     }
   }
 
+  if (compactTables) {
+    if (CJ_ERROR_OK != (err = cjCspCompactTables(&csp))) {
+      fprintf(stderr, "ERROR(%d): failed to compact the csp instance tables.", err);
+      return 1;
+    }
+  }
+
+  if (compressMdd) {
+    if (CJ_ERROR_OK != (err = cjCspCompressMdd(&csp, 0))) {
+      fprintf(stderr, "ERROR(%d): failed to compress the csp instance noGoods to MDDs.", err);
+      return 1;
+    }
+  }
+
+  if (dedup) {
+    if (CJ_ERROR_OK != (err = cjCspDedupConstraintDefs(&csp, dedupTransposed))) {
+      fprintf(stderr, "ERROR(%d): failed to dedup the csp instance constraintDefs.", err);
+      return 1;
+    }
+  }
+
+  if (canonical) {
+    if (CJ_ERROR_OK != (err = cjCspCanonicalize(&csp))) {
+      fprintf(stderr, "ERROR(%d): failed to canonicalize the csp instance.", err);
+      return 1;
+    }
+  }
+
   if (CJ_ERROR_OK != (err = cjCspJsonPrint(stdout, &csp))) {
     fprintf(stderr, "ERROR(%d): failed to print CSP.", err);
   }
 
   cjCspFree(&csp);
 
+  if (stats) {
+    cjSetThreadStats(NULL);
+    cjStatsJsonPrint(stderr, &cjStats);
+  }
+
   return 0;
 }
@@ -1,25 +1,32 @@
 /* urbcsp.c -- generates uniform random binary constraint satisfaction problems
 */
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-
+#include <string.h>
+#include <unistd.h>
+
+#ifdef URBCSP_NO_MAIN
+/* Built into another tool, which links the library sources itself. */
+#include "../../cj/cj-csp.h"
+#include "../../cj/cj-csp-io.h"
+#else
 #include "../../cj-csp-json.h"
+#endif
 
 /* function declarations */
-float ran2(int32_t *idum);
-CjError StartCSP(int N, int D, int K, int C, int T, int32_t S, int Instance, CjCsp* csp);
-CjError EndCSP(CjCsp* csp, bool print);
-CjError AddConstraint(int var1, int var2, CjConstraint* constraint);
-CjError AddNogood(int tupleIdx, int val1, int val2, CjConstraintDef* constraintDef);
-int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool print);
+#include "urbcsp.h"
 
 /*********************************************************************
-  This file has 5 parts:
+  This file has 6 parts:
   0. This introduction.
   1. A main() function, which can be used to demonstrate MakeURBCSP().
-  2. MakeURBCSP().
+     It is left out when URBCSP_NO_MAIN is defined.
+  2. MakeURBCSP() and SkipURBCSP().
   3. ran2(), a random number generator.
   4. The four functions StartCSP(), AddConstraint(), AddNogood(), and
      EndCSP(), which are called by MakeURBCSP().  The versions
@@ -27,6 +34,8 @@ int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool
      the incompatible value pairs of each constraint.  You will need
      to replace these functions with versions that mesh with your
      system and data structures.
+  5. MakeAllURBCSP(), which writes every instance of a sequence to
+     its own file, generating them concurrently.
 *********************************************************************/
 
 
@@ -35,31 +44,66 @@ int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool
      and generates CSPs.
 *********************************************************************/
 
+#ifndef URBCSP_NO_MAIN
 int main(int argc, char* argv[])
 {
   int N, D, K, C, T, I, i;
   int32_t S, Seed;
+  int threads = 1;
+  bool all = false;
+  char* outDir = NULL;
+  char* args[7];
+  int nargs = 0;
+
+  for (i=1; i<argc; ++i) {
+    if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+      char* end = NULL;
+      long value = strtol(argv[++i], &end, 10);
+      if (end == argv[i] || *end != '\0' || value < 0 || value > INT_MAX) {
+        fprintf(stderr, "ERROR: --threads takes a number >= 0: %s\n\n", argv[i]);
+        nargs = 0;
+        break;
+      }
+      threads = (int) value;
+    }
+    else if (strcmp(argv[i], "--all") == 0) {
+      all = true;
+    }
+    else if (strcmp(argv[i], "--out-dir") == 0 && i+1 < argc) {
+      outDir = argv[++i];
+    }
+    else if (nargs < 7) {
+      args[nargs++] = argv[i];
+    }
+    else {
+      nargs = 0;
+      break;
+    }
+  }
 
-  if (argc != 7 && argc != 8) {
+  if ((nargs != 6 && nargs != 7) || all != (outDir != NULL)) {
     fprintf(
       stderr,
-      "Usage: cj-gen-urbcsp #vars #vals #constraints #nogoods seed #instances [#constraintDefs]\n"
+      "Usage: cj-gen-urbcsp [--threads N] [--all --out-dir DIR] #vars #vals #constraints #nogoods seed #instances [#constraintDefs]\n"
       "\n"
       "  If #constraintDefs is missing it is set to equal #constraints which matches the\n"
-      "  behaviour of the original urbcsp which didn't allow this argument.\n");
+      "  behaviour of the original urbcsp which didn't allow this argument.\n"
+      "  --threads sets the number of threads used to normalize (0 for one per CPU).\n"
+      "  --all writes every instance 0..#instances to DIR/ID.json instead of printing\n"
+      "  the last one, generating them on --threads threads.\n");
     return 1;
   }
 
-  N = atoi(argv[1]);
-  D = atoi(argv[2]);
-  C = atoi(argv[3]);
-  T = atoi(argv[4]);
-  S = atoi(argv[5]);
-  I = atoi(argv[6]);
+  N = atoi(args[0]);
+  D = atoi(args[1]);
+  C = atoi(args[2]);
+  T = atoi(args[3]);
+  S = atoi(args[4]);
+  I = atoi(args[5]);
 
   K = C;
-  if (argc == 8) {
-    K = atoi(argv[7]);
+  if (nargs == 7) {
+    K = atoi(args[6]);
   }
 
   /* Seed passed to ran2() must initially be negative. */
@@ -68,14 +112,23 @@ int main(int argc, char* argv[])
     Seed = -Seed;
   }
 
+  if (all) {
+    return MakeAllURBCSP(N, D, K, C, T, S, &Seed, I, threads, outDir) ? 0 : 2;
+  }
+
   for (i=0; i<=I; ++i) {
-    if (!MakeURBCSP(N, D, K, C, T, S, &Seed, i == I)) {
+    /* Only the last instance is printed, so skip building the others. */
+    if (i < I && !SkipURBCSP(N, D, K, C, T, &Seed)) {
+      return 2;
+    }
+    if (i == I && !MakeURBCSP(N, D, K, C, T, S, &Seed, true, threads, NULL)) {
       return 2;
     }
   }
 
   return 0;
 }
+#endif // URBCSP_NO_MAIN
 
 
 /*********************************************************************
@@ -98,23 +151,25 @@ int main(int argc, char* argv[])
    Seed: a negative number means start a new sequence of
       pseudo-random numbers; a positive number means continue
       with the same sequence.  S is turned positive by ran2().
+   print: print the instance as CSP-JSON to stdout.
+   threads: the number of threads used to normalize the instance.
+   out: if not null, receives the instance (cjCspFree() it), otherwise
+      the instance is freed.
   RETURN VALUE:
       Returns 0 if there is a problem; 1 for normal completion.
 *********************************************************************/
 
-int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool print)
-{
-  int PossibleCTs, PossibleNGs;       /* CT means "constraint" */
-  uint32_t *CTarray, *NGarray;   /* NG means "nogood pair" */
-  int32_t selectedCT, selectedNG;
-  int i, c, r, t;
-  int var1, var2, val1, val2;
-  static int instance;
+/* The index of the last instance of the current random sequence, per
+   thread like the ran2() state. */
+static _Thread_local int instance;
 
-  PossibleCTs = N * (N - 1) / 2;
-  PossibleNGs = D * D;
+/* Check for valid values of N, D, K, C, and T.  Returns 0 if one is
+   illegal, after printing why. */
+static int CheckURBCSP(int N, int D, int K, int C, int T)
+{
+  int PossibleCTs = N * (N - 1) / 2;
+  int PossibleNGs = D * D;
 
-  /* Check for valid values of N, D, C, and T. */
   if (N < 2)
     {
       fprintf(stderr, "MakeURBCSP: ***Illegal value for N: %d (N >= 2)\n", N);
@@ -156,6 +211,23 @@ int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool
       return 0;
     }
 
+  return 1;
+}
+
+int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool print, int threads, CjCsp* out)
+{
+  int PossibleCTs, PossibleNGs;       /* CT means "constraint" */
+  uint32_t *CTarray, *NGarray;   /* NG means "nogood pair" */
+  int32_t selectedCT, selectedNG;
+  int i, c, r, t;
+  int var1, var2, val1, val2;
+
+  PossibleCTs = N * (N - 1) / 2;
+  PossibleNGs = D * D;
+
+  if (!CheckURBCSP(N, D, K, C, T))
+    return 0;
+
   if (*Seed < 0)      /* starting a new sequence of random numbers */
     instance = 0;
   else
@@ -229,8 +301,49 @@ int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool
   free(CTarray);
   free(NGarray);
 
-  err = EndCSP(&csp, print);
-  if (err != CJ_ERROR_OK) { return 0; }
+  err = EndCSP(&csp, print, threads);
+  if (err != CJ_ERROR_OK) { cjCspFree(&csp); return 0; }
+
+  if (out) {
+    *out = csp;
+  }
+  else {
+    cjCspFree(&csp);
+  }
+  return 1;
+}
+
+
+
+/*********************************************************************
+  SkipURBCSP() moves past the instance MakeURBCSP() would create with
+  the same parameters, without creating it: MakeURBCSP() draws one
+  random number per constraint and one per nogood of each
+  constraint, C * (T + 1) in all, so SkipURBCSP() draws as many and
+  advances the instance index.  The next MakeURBCSP() then creates
+  the same instance as if the skipped ones were created.  ran2()
+  shuffles its output through a table, so the draws cannot be jumped
+  over in fewer steps.
+
+  RETURN VALUE:
+      Returns 0 if there is a problem; 1 for normal completion.
+*********************************************************************/
+
+int SkipURBCSP(int N, int D, int K, int C, int T, int32_t *Seed)
+{
+  int64_t draws, d;
+
+  if (!CheckURBCSP(N, D, K, C, T))
+    return 0;
+
+  if (*Seed < 0)
+    instance = 0;
+  else
+    ++instance;
+
+  draws = (int64_t) C * (T + 1);
+  for (d=0; d<draws; ++d)
+    ran2(Seed);
 
   return 1;
 }
@@ -256,7 +369,7 @@ int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool
 #define IQ2   52774
 #define IR1   12211
 #define IR2   3791
-#define NTAB  32
+#define NTAB  URBCSP_NTAB
 #define NDIV  (1+IMM1/NTAB)
 #define EPS   1.2e-7
 #define RNMX  (1.0 - EPS)
@@ -266,13 +379,16 @@ int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool
    idum is made positive so that subsequent calls using an unchanged
    idum will continue in the same sequence). */
 
+/* The ran2() state besides idum, per thread so that threads can
+   generate instances concurrently (see MakeAllURBCSP()). */
+static _Thread_local int32_t idum2 = 123456789;
+static _Thread_local int32_t iy = 0;
+static _Thread_local int32_t iv[NTAB];
+
 float ran2(int32_t *idum)
 {
   int j;
   int32_t k;
-  static int32_t idum2 = 123456789;
-  static int32_t iy = 0;
-  static int32_t iv[NTAB];
   float temp;
 
   if (*idum <= 0) {                             /* initialize */
@@ -311,6 +427,29 @@ float ran2(int32_t *idum)
     return temp;
 }
 
+/* GetURBCSPState() saves the state of the calling thread's generator,
+   with Seed, before its next instance.  SetURBCSPState() restores it,
+   possibly on another thread, so that the next MakeURBCSP() creates
+   that same instance. */
+
+void GetURBCSPState(int32_t Seed, URBCSPState* state)
+{
+  state->seed = Seed;
+  state->instance = instance;
+  state->idum2 = idum2;
+  state->iy = iy;
+  memcpy(state->iv, iv, sizeof(iv));
+}
+
+void SetURBCSPState(const URBCSPState* state, int32_t *Seed)
+{
+  *Seed = state->seed;
+  instance = state->instance;
+  idum2 = state->idum2;
+  iy = state->iy;
+  memcpy(iv, state->iv, sizeof(iv));
+}
+
 
 /*********************************************************************
   4. An implementation of StartCSP, AddConstraint, AddNogood, and EndCSP
@@ -325,24 +464,24 @@ CjError StartCSP(int N, int D, int K,int C, int T, int32_t S, int Instance, CjCs
 
   // Populate meta fields.
   const size_t strAllocSize = 1024;
-  csp->meta.id = malloc(strAllocSize);
+  csp->meta.id = cjMalloc(strAllocSize);
   if (!csp->meta.id) { return CJ_ERROR_NOMEM; }
   int stat = snprintf(csp->meta.id, strAllocSize, "urbcsp/n%dd%dc%dt%ds%di%dk%d", N, D, C, T, S, Instance, K);
   if (stat < 0) { return CJ_ERROR; }
 
-  csp->meta.algo = malloc(strAllocSize);
+  csp->meta.algo = cjMalloc(strAllocSize);
   if (!csp->meta.algo) { return CJ_ERROR_NOMEM; }
   stat = snprintf(csp->meta.algo, strAllocSize, "urbcsp");
   if (stat < 0) { return CJ_ERROR; }
 
-  csp->meta.paramsJSON = malloc(strAllocSize);
+  csp->meta.paramsJSON = cjMalloc(strAllocSize);
   if (!csp->meta.paramsJSON) { return CJ_ERROR_NOMEM; }
   stat = snprintf(csp->meta.paramsJSON, strAllocSize, "{\"n\": %d, \"d\": %d, \"c\": %d, \"t\": %d, \"s\": %d, \"i\": %d, \"k\": %d}", N, D, C, T, S, Instance, K);
   if (stat < 0) { return CJ_ERROR; }
 
   // Make a single domain [0, D-1].
   csp->domainsSize = 1;
-  csp->domains = (CjDomain*) malloc(sizeof(CjDomain));
+  csp->domains = (CjDomain*) cjMalloc(sizeof(CjDomain));
   if (!csp->domains) { return CJ_ERROR_NOMEM; }
   csp->domains[0] = cjDomainInit();
   csp->domains[0].type = CJ_DOMAIN_VALUES;
@@ -359,7 +498,7 @@ CjError StartCSP(int N, int D, int K,int C, int T, int32_t S, int Instance, CjCs
 
   // Allocate and init constraintDefs.
   csp->constraintDefsSize = K;
-  csp->constraintDefs = (CjConstraintDef*) malloc(K * sizeof(CjConstraintDef));
+  csp->constraintDefs = (CjConstraintDef*) cjMalloc(K * sizeof(CjConstraintDef));
   for (int i = 0; i < K; ++i) {
     csp->constraintDefs[i] = cjConstraintDefInit();
     csp->constraintDefs[i].type = CJ_CONSTRAINT_DEF_NO_GOODS;
@@ -368,14 +507,14 @@ CjError StartCSP(int N, int D, int K,int C, int T, int32_t S, int Instance, CjCs
     err = cjIntTuplesAlloc(size, arity, &csp->constraintDefs[i].noGoods);
     if (err != CJ_ERROR_OK) { return err; }
     for (int iData = 0; iData < size*arity; ++iData) {
-      csp->constraintDefs[i].noGoods.data[i] = 0;
+      csp->constraintDefs[i].noGoods.data[iData] = 0;
     }
   }
 
   // Alloc and init constraints.
   // Reference relevant constraintDef.
   csp->constraintsSize = C;
-  csp->constraints = (CjConstraint*) malloc(C * sizeof(CjConstraint));
+  csp->constraints = (CjConstraint*) cjMalloc(C * sizeof(CjConstraint));
   for (int i = 0; i < C; ++i) {
     csp->constraints[i] = cjConstraintInit();
     csp->constraints[i].id = i % K;
@@ -408,10 +547,10 @@ CjError AddNogood(int tupleIdx, int val1, int val2, CjConstraintDef* constraintD
   return CJ_ERROR_OK;
 }
 
-CjError EndCSP(CjCsp* csp, bool print)
+CjError EndCSP(CjCsp* csp, bool print, int threads)
 {
   if (!csp) { return CJ_ERROR_ARG; }
-  int err = cjCspNormalize(csp);
+  int err = cjCspNormalizeParallel(csp, threads);
   if (err != CJ_ERROR_OK) { return err; }
   if (print) {
     return cjCspJsonPrint(stdout, csp);
@@ -419,3 +558,119 @@ CjError EndCSP(CjCsp* csp, bool print)
   return CJ_ERROR_OK;
 }
 
+
+/*********************************************************************
+  5. MakeAllURBCSP() writes each instance 0..I of a sequence to the file
+     outDir/ID.json, where ID is the meta id without "urbcsp/", eg.
+     n100d10c10t10s100i99k10.json.  The random sequence is walked once
+     with SkipURBCSP(), saving the state before each instance, and then
+     threads worker threads (0 for one per CPU) each take the next
+     instance, restore its state and create it.  So each file holds
+     the instance the sequential generator creates for that index.
+  RETURN VALUE:
+      Returns 0 if there is a problem; 1 for normal completion.
+*********************************************************************/
+
+typedef struct MakeAllJob {
+  int N, D, K, C, T, I;
+  int32_t S;
+  const char* outDir;
+  const URBCSPState* states;
+  atomic_int next;
+  atomic_int failed;
+} MakeAllJob;
+
+static void* MakeAllWorker(void* arg)
+{
+  MakeAllJob* job = (MakeAllJob*) arg;
+  char path[4096];
+  const char* id;
+  int i, ok, len;
+  int32_t Seed;
+  FILE* f;
+  CjCsp csp;
+
+  while (!atomic_load(&job->failed) && (i = atomic_fetch_add(&job->next, 1)) <= job->I)
+    {
+      SetURBCSPState(&job->states[i], &Seed);
+      if (!MakeURBCSP(job->N, job->D, job->K, job->C, job->T, job->S, &Seed, false, 1, &csp))
+        {
+          atomic_store(&job->failed, 1);
+          break;
+        }
+
+      id = strchr(csp.meta.id, '/') ? strchr(csp.meta.id, '/') + 1 : csp.meta.id;
+      len = snprintf(path, sizeof(path), "%s/%s.json", job->outDir, id);
+      if (len < 0 || (size_t) len >= sizeof(path))
+        {
+          fprintf(stderr, "MakeAllURBCSP: ***Path too long: %s/%s.json\n", job->outDir, id);
+          atomic_store(&job->failed, 1);
+          cjCspFree(&csp);
+          break;
+        }
+      f = fopen(path, "w");
+      ok = f && cjCspJsonPrint(f, &csp) == CJ_ERROR_OK;
+      if (f && fclose(f) != 0)
+        ok = 0;
+      if (!ok)
+        {
+          fprintf(stderr, "MakeAllURBCSP: ***Failed to write %s\n", path);
+          atomic_store(&job->failed, 1);
+        }
+      cjCspFree(&csp);
+    }
+  return NULL;
+}
+
+int MakeAllURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, int I, int threads, const char* outDir)
+{
+  URBCSPState* states;
+  pthread_t* workers;
+  int i, started;
+  MakeAllJob job;
+
+  if (I < 0)
+    return 1;
+
+  /* Walk the sequence, the params of the last instance are checked when
+     it is made. */
+  states = (URBCSPState*) malloc(sizeof(URBCSPState) * (I + 1));
+  if (!states)
+    return 0;
+  for (i=0; i<=I; ++i)
+    {
+      GetURBCSPState(*Seed, &states[i]);
+      if (i < I && !SkipURBCSP(N, D, K, C, T, Seed))
+        {
+          free(states);
+          return 0;
+        }
+    }
+
+  job.N = N; job.D = D; job.K = K; job.C = C; job.T = T; job.I = I;
+  job.S = S;
+  job.outDir = outDir;
+  job.states = states;
+  atomic_init(&job.next, 0);
+  atomic_init(&job.failed, 0);
+
+  if (threads <= 0)
+    threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > I + 1)
+    threads = I + 1;
+  if (threads < 1)
+    threads = 1;
+  workers = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+  started = 0;
+  while (workers && started < threads && pthread_create(&workers[started], NULL, MakeAllWorker, &job) == 0)
+    ++started;
+  /* Without any worker, make the instances on this thread. */
+  if (started == 0)
+    MakeAllWorker(&job);
+  for (i=0; i<started; ++i)
+    pthread_join(workers[i], NULL);
+
+  free(workers);
+  free(states);
+  return !atomic_load(&job.failed);
+}
@@ -0,0 +1,35 @@
+/* urbcsp.h -- the urbcsp generator functions of urbcsp.c, for tools that
+   build urbcsp.c in with URBCSP_NO_MAIN defined, eg. cj-bench.
+   Include after cj-csp.h.
+*/
+#ifndef __URBCSP_H__
+#define __URBCSP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The size of the ran2() shuffle table. */
+#define URBCSP_NTAB 32
+
+/* The state of the generator before an instance: the ran2() sequence
+   and the instance index.  See GetURBCSPState(). */
+typedef struct URBCSPState {
+  int32_t seed;
+  int instance;
+  int32_t idum2;
+  int32_t iy;
+  int32_t iv[URBCSP_NTAB];
+} URBCSPState;
+
+float ran2(int32_t *idum);
+void GetURBCSPState(int32_t Seed, URBCSPState* state);
+void SetURBCSPState(const URBCSPState* state, int32_t *Seed);
+CjError StartCSP(int N, int D, int K, int C, int T, int32_t S, int Instance, CjCsp* csp);
+CjError EndCSP(CjCsp* csp, bool print, int threads);
+CjError AddConstraint(int var1, int var2, CjConstraint* constraint);
+CjError AddNogood(int tupleIdx, int val1, int val2, CjConstraintDef* constraintDef);
+int MakeURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, bool print, int threads, CjCsp* out);
+int SkipURBCSP(int N, int D, int K, int C, int T, int32_t *Seed);
+int MakeAllURBCSP(int N, int D, int K, int C, int T, int32_t S, int32_t *Seed, int I, int threads, const char* outDir);
+
+#endif // __URBCSP_H__
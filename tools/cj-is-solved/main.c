@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdio.h>
@@ -8,13 +9,13 @@
 #include "../../common/io.h"
 
 void printUsage() {
-  fprintf(stderr, "Usage: csp-json-satisfied --csp INSTANCE_FILENAME --solution SOLUTION_JSON\n");
+  fprintf(stderr, "Usage: csp-json-satisfied --csp INSTANCE_FILENAME --solution SOLUTION_JSON [--stats]\n");
 }
 
 int main(int argc, char** argv) {
   int stat = 0;
   CjError err = CJ_ERROR_OK;
-  if (argc != 5) {
+  if (argc != 5 && argc != 6) {
     fprintf(stderr, "ERROR: number of command line parameters.\n\n");
     printUsage();
     return 1;
@@ -29,6 +30,12 @@ int main(int argc, char** argv) {
     printUsage();
     return 1;
   }
+  else if (argc == 6 && strcmp(argv[5], "--stats") != 0) {
+    fprintf(stderr, "ERROR: unknown argument: %s\n\n", argv[5]);
+    printUsage();
+    return 1;
+  }
+  const bool stats = argc == 6;
   char* cspInstanceFilename = argv[2];
   char* solutionJson = argv[4];
 
@@ -45,16 +52,22 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  CjStats cjStats = cjStatsInit();
+  if (stats) { cjSetThreadStats(&cjStats); }
   CjCsp csp = cjCspInit();
-  if (CJ_ERROR_OK != (err = cjCspJsonParse(cspJson, cspJsonLen, &csp))) {
-    fprintf(stderr, "ERROR(%d): failed to parse csp instance file: %s\n", err, cspInstanceFilename);
-    return err;
+  err = cjCspJsonParseFlags(cspJson, cspJsonLen, CJ_PARSE_NARROW | CJ_PARSE_VARS_RUNS | CJ_PARSE_VALIDATE, &csp);
+  if (stats) {
+    cjSetThreadStats(NULL);
+    cjStatsJsonPrint(stderr, &cjStats);
   }
-
-  if (CJ_ERROR_OK != (err = cjCspValidate(&csp))) {
+  if (cjErrorIsValidation(err)) {
     fprintf(stderr, "ERROR: CSP does not pass validation: %d\n", err);
     return err; // TODO: check other tools that they return err from main
   }
+  else if (CJ_ERROR_OK != err) {
+    fprintf(stderr, "ERROR(%d): failed to parse csp instance file: %s\n", err, cspInstanceFilename);
+    return err;
+  }
 
   if (strcmp(solutionJson, "null") == 0) {
     printf("true\n");
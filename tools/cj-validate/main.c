@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdio.h>
@@ -8,22 +9,53 @@
 #include "../../common/io.h"
 
 void printUsage() {
-  fprintf(stderr, "Usage: csp-json-satisfied --csp INSTANCE_FILENAME\n");
+  fprintf(stderr, "Usage: cj-validate [--mem] [--stats] --csp INSTANCE_FILENAME\n");
+}
+
+void printMemorySection(const char* name, const CjMemorySection* section) {
+  printf("%-16s %14zu %12zu %14zu\n", name, section->bytes, section->allocations, section->wasted);
+}
+
+/** Print the cjCspMemoryUsage() of csp, one line per section. */
+void printMemoryUsage(const CjMemoryUsage* mem) {
+  printf("%-16s %14s %12s %14s\n", "section", "bytes", "allocations", "wasted");
+  printMemorySection("meta", &mem->meta);
+  printMemorySection("domains", &mem->domains);
+  printMemorySection("vars", &mem->vars);
+  printMemorySection("constraintDefs", &mem->constraintDefs);
+  printMemorySection("constraints", &mem->constraints);
+  printMemorySection("total", &mem->total);
 }
 
 int main(int argc, char** argv) {
   int err = 0;
-  if (argc != 3) {
-    fprintf(stderr, "ERROR: number of command line parameters.\n\n");
-    printUsage();
-    return 1;
+  bool mem = false;
+  bool stats = false;
+  char* cspInstanceFilename = NULL;
+  for (int iArg = 1; iArg < argc; ) {
+    if (strcmp(argv[iArg], "--mem") == 0) {
+      mem = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--stats") == 0) {
+      stats = true;
+      iArg++;
+    }
+    else if (strcmp(argv[iArg], "--csp") == 0 && iArg < argc - 1) {
+      cspInstanceFilename = argv[iArg+1];
+      iArg += 2;
+    }
+    else {
+      fprintf(stderr, "ERROR: unknown argument: %s\n\n", argv[iArg]);
+      printUsage();
+      return 1;
+    }
   }
-  else if (strcmp(argv[1], "--csp") != 0) {
+  if (! cspInstanceFilename) {
     fprintf(stderr, "ERROR: missing --csp flag.\n\n");
     printUsage();
     return 1;
   }
-  char* cspInstanceFilename = argv[2];
 
   FILE* cspInstanceFile = fopen(cspInstanceFilename, "r");
   if (! cspInstanceFile) {
@@ -38,22 +70,34 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  // Validating while parsing checks each section while it is still in cache.
+  // The memory report is of the csp as parsed, so that wasted shows what
+  // narrowing saves.
+  CjStats cjStats = cjStatsInit();
+  if (stats) { cjSetThreadStats(&cjStats); }
   CjCsp csp = cjCspInit();
-  if (0 != (err = cjCspJsonParse(cspJson, cspJsonLen, &csp))) {
-    fprintf(stderr, "ERROR(%d): failed to parse csp instance file.", err);
-    return 1;
+  const int flags = CJ_PARSE_VARS_RUNS | CJ_PARSE_VALIDATE | (mem ? 0 : CJ_PARSE_NARROW);
+  err = cjCspJsonParseFlags(cspJson, cspJsonLen, flags, &csp);
+  free(cspJson);
+  if (stats) {
+    cjSetThreadStats(NULL);
+    cjStatsJsonPrint(stderr, &cjStats);
   }
-
-  err = cjCspValidate(&csp);
   if (err == CJ_ERROR_OK) {
     printf("OK\n");
+    CjMemoryUsage usage;
+    if (mem && CJ_ERROR_OK == cjCspMemoryUsage(&csp, &usage)) {
+      printMemoryUsage(&usage);
+    }
+    cjCspFree(&csp);
     return 0;
   }
-
-  printf("Invalid\n");
-  return err;
-
   cjCspFree(&csp);
+  if (cjErrorIsValidation(err)) {
+    printf("Invalid\n");
+    return err;
+  }
 
-  return 0;
+  fprintf(stderr, "ERROR(%d): failed to parse csp instance file.", err);
+  return 1;
 }